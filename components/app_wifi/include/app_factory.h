@@ -0,0 +1,54 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define APP_FACTORY_RANDOM_MAX      64
+#define APP_FACTORY_MAC_STR_SIZE    18
+#define APP_FACTORY_POP_STR_SIZE    9
+#define APP_FACTORY_SERVICE_NAME_SIZE   12
+
+// Identity of the node, read once from the fctry partition and the eFuse MAC
+typedef struct {
+    // Random bytes stored during claiming, random_len is 0 if there are none
+    uint8_t random[APP_FACTORY_RANDOM_MAX];
+    size_t random_len;
+    uint8_t mac[6];
+    char mac_str[APP_FACTORY_MAC_STR_SIZE];
+    // Provisioning service name, prefix followed by the last 3 random (or MAC) bytes
+    char service_name[APP_FACTORY_SERVICE_NAME_SIZE];
+    // PoP from the MAC address, always set
+    char pop_mac[APP_FACTORY_POP_STR_SIZE];
+    // PoP from the random bytes, empty if there are none
+    char pop_random[APP_FACTORY_POP_STR_SIZE];
+} app_factory_data_t;
+
+/** Load the factory data
+ *
+ * Reads the fctry partition once, later calls return straight away.
+ * Missing random bytes are not an error, the MAC is used instead.
+ *
+ * @return ESP_OK on success, or the error reading the MAC address.
+ */
+esp_err_t app_factory_init(void);
+
+/** Get the factory data
+ *
+ * @return The data loaded by app_factory_init(), or NULL if it was not loaded.
+ */
+const app_factory_data_t *app_factory_get(void);
+
+#ifdef __cplusplus
+}
+#endif
\ No newline at end of file
@@ -51,6 +51,13 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type);
 esp_err_t get_dev_mac(char *mac);
 esp_err_t get_dev_pop(char *pop, app_wifi_pop_type_t pop_type);
 
+/** Get the internal heap reclaimed from the BT stack after provisioning
+ *
+ * @return Bytes of internal DRAM returned to the heap, or 0 if the BT memory
+ * has not been released (yet).
+ */
+size_t app_wifi_get_bt_mem_reclaimed(void);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
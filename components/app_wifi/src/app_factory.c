@@ -0,0 +1,100 @@
+/*
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <stdio.h>
+#include <stdbool.h>
+#include <esp_log.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+#include "app_factory.h"
+
+static const char *TAG = "app_factory";
+
+#define CREDENTIALS_NAMESPACE   "rmaker_creds"
+#define RANDOM_NVS_KEY          "random"
+
+static app_factory_data_t factory_data;
+static bool factory_loaded;
+
+static esp_err_t read_random_bytes(uint8_t *random_bytes, size_t *len)
+{
+    nvs_handle handle;
+    esp_err_t err;
+    size_t required = 0;
+    *len = 0;
+
+    /* RainMaker initialises this partition too, a second init is harmless */
+    if ((err = nvs_flash_init_partition(CONFIG_ESP_RMAKER_FACTORY_PARTITION_NAME)) != ESP_OK) {
+        ESP_LOGD(TAG, "NVS init for %s failed with error %d", CONFIG_ESP_RMAKER_FACTORY_PARTITION_NAME, err);
+        return err;
+    }
+    if ((err = nvs_open_from_partition(CONFIG_ESP_RMAKER_FACTORY_PARTITION_NAME, CREDENTIALS_NAMESPACE,
+                                NVS_READONLY, &handle)) != ESP_OK) {
+        ESP_LOGD(TAG, "NVS open for %s %s failed with error %d", CONFIG_ESP_RMAKER_FACTORY_PARTITION_NAME, CREDENTIALS_NAMESPACE, err);
+        return err;
+    }
+    if ((err = nvs_get_blob(handle, RANDOM_NVS_KEY, NULL, &required)) != ESP_OK) {
+        ESP_LOGD(TAG, "Error %d. Failed to read key %s.", err, RANDOM_NVS_KEY);
+        nvs_close(handle);
+        return err;
+    }
+    if (required > APP_FACTORY_RANDOM_MAX) {
+        ESP_LOGW(TAG, "Random bytes too long (%u), ignoring them", (unsigned)required);
+        nvs_close(handle);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    err = nvs_get_blob(handle, RANDOM_NVS_KEY, random_bytes, &required);
+    nvs_close(handle);
+    if (err == ESP_OK) {
+        *len = required;
+    }
+    return err;
+}
+
+esp_err_t app_factory_init(void)
+{
+    if (factory_loaded) {
+        return ESP_OK;
+    }
+    int64_t start = esp_timer_get_time();
+    app_factory_data_t *data = &factory_data;
+
+    esp_err_t err = esp_read_mac(data->mac, ESP_MAC_WIFI_STA);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to get MAC address.");
+        return err;
+    }
+    snprintf(data->mac_str, sizeof(data->mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
+            data->mac[0], data->mac[1], data->mac[2], data->mac[3], data->mac[4], data->mac[5]);
+    snprintf(data->pop_mac, sizeof(data->pop_mac), "%02x%02x%02x%02x",
+            data->mac[2], data->mac[3], data->mac[4], data->mac[5]);
+
+    if (read_random_bytes(data->random, &data->random_len) != ESP_OK) {
+        data->random_len = 0;
+    }
+    if (data->random_len >= 4) {
+        snprintf(data->pop_random, sizeof(data->pop_random), "%02x%02x%02x%02x",
+                data->random[0], data->random[1], data->random[2], data->random[3]);
+    }
+
+    /* Service name from the tail of the random bytes, or of the MAC without them */
+    const uint8_t *tail = data->random_len >= 3 ? &data->random[data->random_len - 3] : &data->mac[3];
+    snprintf(data->service_name, sizeof(data->service_name), "%s_%02x%02x%02x",
+            CONFIG_APP_WIFI_PROV_NAME_PREFIX, tail[0], tail[1], tail[2]);
+
+    factory_loaded = true;
+    ESP_LOGI(TAG, "Loaded factory data in %lu us (%u random bytes)",
+            (unsigned long)(esp_timer_get_time() - start), (unsigned)data->random_len);
+    return ESP_OK;
+}
+
+const app_factory_data_t *app_factory_get(void)
+{
+    return factory_loaded ? &factory_data : NULL;
+}
\ No newline at end of file
@@ -32,10 +32,13 @@
 #endif /* CONFIG_APP_WIFI_PROV_TRANSPORT_BLE */
 
 #include <qrcode.h>
-#include <nvs.h>
-#include <nvs_flash.h>
 #include <esp_timer.h>
+#include <esp_heap_caps.h>
+#ifdef CONFIG_APP_WIFI_PROV_RELEASE_BT_MEM
+#include <esp_bt.h>
+#endif /* CONFIG_APP_WIFI_PROV_RELEASE_BT_MEM */
 #include "app_wifi.h"
+#include "app_factory.h"
 
 ESP_EVENT_DEFINE_BASE(APP_WIFI_EVENT);
 static const char *TAG = "app_wifi";
@@ -49,16 +52,13 @@ static app_wifi_connect_fn wifi_connect = NULL;
 #define PROV_TRANSPORT_BLE      "ble"
 #define QRCODE_BASE_URL     "https://rainmaker.espressif.com/qrcode.html"
 
-#define CREDENTIALS_NAMESPACE   "rmaker_creds"
-#define RANDOM_NVS_KEY          "random"
-
-#define MAC_STR_SIZE    18
-#define POP_STR_SIZE    9
 static esp_timer_handle_t prov_stop_timer;
 /* Timeout period in minutes */
 #define APP_WIFI_PROV_TIMEOUT_PERIOD   CONFIG_APP_WIFI_PROV_TIMEOUT_PERIOD
 /* Autofetch period in micro-seconds */
 static uint64_t prov_timeout_period = (APP_WIFI_PROV_TIMEOUT_PERIOD * 60 * 1000000LL);
+/* Internal DRAM handed back to the heap by app_wifi_release_bt_mem() */
+static size_t bt_mem_reclaimed;
 #ifdef CONFIG_APP_WIFI_SHOW_DEMO_INTRO_TEXT
 
 #define IO_CONNECT_PHONE_APP_G_LINK   "https://play.google.com/store/apps/details?id=com.codor.stelian.ioconnect"
@@ -126,6 +126,45 @@ static void app_wifi_print_qr(const char *name, const char *pop, const char *tra
     esp_event_post(APP_WIFI_EVENT, APP_WIFI_EVENT_QR_DISPLAY, payload, strlen(payload) + 1, portMAX_DELAY);
 }
 
+#ifdef CONFIG_APP_WIFI_PROV_RELEASE_BT_MEM
+/* Give the BT controller and NimBLE host memory back to the heap. This must
+ * only run once the provisioning manager is de-initialised, since the
+ * controller has to be idle and the memory cannot be reclaimed twice.
+ */
+static void app_wifi_release_bt_mem(void)
+{
+    static bool released;
+    if (released) {
+        return;
+    }
+    if (esp_bt_controller_get_status() != ESP_BT_CONTROLLER_STATUS_IDLE) {
+        ESP_LOGW(TAG, "BT controller still active, not releasing BT memory");
+        return;
+    }
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    esp_err_t err = esp_bt_mem_release(ESP_BT_MODE_BTDM);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to release BT memory: %d", err);
+        return;
+    }
+    released = true;
+    size_t free_after = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    bt_mem_reclaimed = free_after > free_before ? free_after - free_before : 0;
+    ESP_LOGI(TAG, "Released BT memory: +%u bytes internal heap (free %u -> %u)",
+             (unsigned)bt_mem_reclaimed, (unsigned)free_before, (unsigned)free_after);
+}
+#else
+static void app_wifi_release_bt_mem(void)
+{
+    /* Do nothing */
+}
+#endif /* CONFIG_APP_WIFI_PROV_RELEASE_BT_MEM */
+
+size_t app_wifi_get_bt_mem_reclaimed(void)
+{
+    return bt_mem_reclaimed;
+}
+
 /* Event handler for catching system events */
 static void event_handler(void* arg, esp_event_base_t event_base,
                           int32_t event_id, void* event_data)
@@ -181,6 +220,8 @@ static void event_handler(void* arg, esp_event_base_t event_base,
                 }
                 /* De-initialize manager once provisioning is finished */
                 wifi_prov_mgr_deinit();
+                /* BLE transport is stopped by now, hand its memory back */
+                app_wifi_release_bt_mem();
                 break;
             default:
                 break;
@@ -206,92 +247,20 @@ static void wifi_init_sta()
     ESP_ERROR_CHECK(esp_wifi_start());
 }
 
-/* Free random_bytes after use only if function returns ESP_OK */
-static esp_err_t read_random_bytes_from_nvs(uint8_t **random_bytes, size_t *len)
-{
-    nvs_handle handle;
-    esp_err_t err;
-    *len = 0;
-
-    if ((err = nvs_open_from_partition(CONFIG_ESP_RMAKER_FACTORY_PARTITION_NAME, CREDENTIALS_NAMESPACE,
-                                NVS_READONLY, &handle)) != ESP_OK) {
-        ESP_LOGD(TAG, "NVS open for %s %s %s failed with error %d", CONFIG_ESP_RMAKER_FACTORY_PARTITION_NAME, CREDENTIALS_NAMESPACE, RANDOM_NVS_KEY, err);
-        return ESP_FAIL;
-    }
-
-    if ((err = nvs_get_blob(handle, RANDOM_NVS_KEY, NULL, len)) != ESP_OK) {
-        ESP_LOGD(TAG, "Error %d. Failed to read key %s.", err, RANDOM_NVS_KEY);
-        nvs_close(handle);
-        return ESP_ERR_NOT_FOUND;
-    }
-
-    *random_bytes = calloc(*len, 1);
-    if (*random_bytes) {
-        nvs_get_blob(handle, RANDOM_NVS_KEY, *random_bytes, len);
-        nvs_close(handle);
-        return ESP_OK;
-    }
-    nvs_close(handle);
-    return ESP_ERR_NO_MEM;
-}
-
-static esp_err_t get_device_service_name(char *service_name, size_t max)
-{
-    uint8_t *nvs_random = NULL;
-    const char *ssid_prefix = CONFIG_APP_WIFI_PROV_NAME_PREFIX;
-    size_t nvs_random_size = 0;
-    if ((read_random_bytes_from_nvs(&nvs_random, &nvs_random_size) != ESP_OK) || nvs_random_size < 3) {
-        uint8_t eth_mac[6];
-        esp_wifi_get_mac(WIFI_IF_STA, eth_mac);
-        snprintf(service_name, max, "%s_%02x%02x%02x", ssid_prefix, eth_mac[3], eth_mac[4], eth_mac[5]);
-    } else {
-        snprintf(service_name, max, "%s_%02x%02x%02x", ssid_prefix, nvs_random[nvs_random_size - 3],
-                nvs_random[nvs_random_size - 2], nvs_random[nvs_random_size - 1]);
-    }
-    if (nvs_random) {
-        free(nvs_random);
-    }
-    return ESP_OK;
-}
-
-static char *get_device_pop(app_wifi_pop_type_t pop_type)
+/* PoP for the given type from the factory data, NULL if there is none */
+static const char *get_device_pop(app_wifi_pop_type_t pop_type)
 {
-    if (pop_type == POP_TYPE_NONE) {
+    const app_factory_data_t *factory = app_factory_get();
+    if (!factory || pop_type == POP_TYPE_NONE) {
         return NULL;
     }
-    char *pop = calloc(1, POP_STR_SIZE);
-    if (!pop) {
-        ESP_LOGE(TAG, "Failed to allocate memory for PoP.");
-        return NULL;
-    }
-
     if (pop_type == POP_TYPE_MAC) {
-        uint8_t eth_mac[6];
-        esp_err_t err = esp_wifi_get_mac(WIFI_IF_STA, eth_mac);
-        if (err == ESP_OK) {
-            snprintf(pop, POP_STR_SIZE, "%02x%02x%02x%02x", eth_mac[2], eth_mac[3], eth_mac[4], eth_mac[5]);
-            return pop;
-        } else {
-            ESP_LOGE(TAG, "Failed to get MAC address to generate PoP.");
-            goto pop_err;
-        }
-    } else if (pop_type == POP_TYPE_RANDOM) {
-        uint8_t *nvs_random = NULL;
-        size_t nvs_random_size = 0;
-        if ((read_random_bytes_from_nvs(&nvs_random, &nvs_random_size) != ESP_OK) || nvs_random_size < 4) {
-            ESP_LOGE(TAG, "Failed to read random bytes from NVS to generate PoP.");
-            if (nvs_random) {
-                free(nvs_random);
-            }
-            goto pop_err;
-        } else {
-            snprintf(pop, POP_STR_SIZE, "%02x%02x%02x%02x", nvs_random[0], nvs_random[1], nvs_random[2], nvs_random[3]);
-            free(nvs_random);
-            return pop;
-        }
+        return factory->pop_mac;
     }
-pop_err:
-    free(pop);
+    if (pop_type == POP_TYPE_RANDOM && factory->pop_random[0]) {
+        return factory->pop_random;
+    }
+    ESP_LOGE(TAG, "Failed to read random bytes from NVS to generate PoP.");
     return NULL;
 }
 
@@ -325,6 +294,11 @@ esp_err_t app_wifi_init(const struct app_wifi_config *config)
 #endif
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    /* Read the factory data once, provisioning and the devices use it later */
+    if (app_factory_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Could not load factory data");
+    }
 	return ESP_OK;
 }
 
@@ -376,8 +350,13 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
          * (in case when device is already provisioned). Choosing
          * appropriate scheme specific event handler allows the manager
          * to take care of this automatically. This can be set to
-         * WIFI_PROV_EVENT_HANDLER_NONE when using wifi_prov_scheme_softap*/
-#ifdef CONFIG_APP_WIFI_PROV_TRANSPORT_BLE
+         * WIFI_PROV_EVENT_HANDLER_NONE when using wifi_prov_scheme_softap.
+         * With CONFIG_APP_WIFI_PROV_RELEASE_BT_MEM the manager only frees
+         * classic BT, and the BLE controller and host memory is released by
+         * app_wifi_release_bt_mem() so that the gain can be measured */
+#if defined(CONFIG_APP_WIFI_PROV_RELEASE_BT_MEM)
+        .scheme_event_handler = WIFI_PROV_SCHEME_BLE_EVENT_HANDLER_FREE_BT
+#elif defined(CONFIG_APP_WIFI_PROV_TRANSPORT_BLE)
         .scheme_event_handler = WIFI_PROV_SCHEME_BLE_EVENT_HANDLER_FREE_BTDM
 #else /* CONFIG_APP_WIFI_PROV_TRANSPORT_SOFTAP */
         .scheme_event_handler = WIFI_PROV_EVENT_HANDLER_NONE,
@@ -403,8 +382,12 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
          *     - Wi-Fi SSID when scheme is wifi_prov_scheme_softap
          *     - device name when scheme is wifi_prov_scheme_ble
          */
-        char service_name[12];
-        get_device_service_name(service_name, sizeof(service_name));
+        const app_factory_data_t *factory = app_factory_get();
+        if (!factory) {
+            ESP_LOGE(TAG, "Factory data not loaded, cannot start provisioning");
+            return ESP_ERR_INVALID_STATE;
+        }
+        const char *service_name = factory->service_name;
 		
 		/* What is the service key (Wi-Fi password)
          * NULL = Open network
@@ -424,9 +407,9 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
          *      - this should be a string with length > 0
          *      - NULL if not used
          */
-        char *pop = get_device_pop(pop_type);
+        const char *pop = get_device_pop(pop_type);
         if ((pop_type != POP_TYPE_NONE) && (pop == NULL)) {
-            return ESP_ERR_NO_MEM;
+            return ESP_ERR_NOT_FOUND;
         }
 
 #ifdef CONFIG_APP_WIFI_PROV_TRANSPORT_BLE
@@ -462,9 +445,6 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
 #endif /* CONFIG_APP_WIFI_PROV_TRANSPORT_BLE */
         intro_print(provisioned);
        ESP_LOGI(TAG, "Provisioning Started. Name : %s, POP : %s", service_name, pop ? pop : "<null>");
-        if (pop) {
-            free(pop);
-        }
         app_wifi_start_timer();
     } else {
         ESP_LOGI(TAG, "Already provisioned, starting Wi-Fi STA");
@@ -472,6 +452,8 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
         /* We don't need the manager as device is already provisioned,
          * so let's release it's resources */
         wifi_prov_mgr_deinit();
+        /* BLE was never started, so the BT memory can go straight back */
+        app_wifi_release_bt_mem();
 
         /* Start Wi-Fi station */
         wifi_init_sta();
@@ -483,19 +465,21 @@ esp_err_t app_wifi_start(app_wifi_pop_type_t pop_type)
 
 esp_err_t get_dev_mac(char *mac)
 {
-    uint8_t eth_mac[6];
-    esp_err_t err = esp_wifi_get_mac(WIFI_IF_STA, eth_mac);
-    if (err == ESP_OK) {
-        snprintf(mac, MAC_STR_SIZE, "%02x:%02x:%02x:%02x:%02x:%02x", eth_mac[0], eth_mac[1], eth_mac[2], eth_mac[3], eth_mac[4], eth_mac[5]);
-        return ESP_OK;
-    } else {
+    const app_factory_data_t *factory = app_factory_get();
+    if (!factory) {
 		ESP_LOGE(TAG, "Failed to get MAC address.");
-        return err;
+        return ESP_ERR_INVALID_STATE;
     }
+    snprintf(mac, APP_FACTORY_MAC_STR_SIZE, "%s", factory->mac_str);
+    return ESP_OK;
 }
 
 esp_err_t get_dev_pop(char *pop, app_wifi_pop_type_t pop_type)
 {
-	snprintf(pop, POP_STR_SIZE, "%s", get_device_pop(pop_type));
+	const char *device_pop = get_device_pop(pop_type);
+	if (!device_pop) {
+		return ESP_ERR_NOT_FOUND;
+	}
+	snprintf(pop, APP_FACTORY_POP_STR_SIZE, "%s", device_pop);
 	return ESP_OK;
 }
\ No newline at end of file
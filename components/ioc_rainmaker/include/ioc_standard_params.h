@@ -37,6 +37,7 @@ extern "C"
 #define IOC_DEF_REBOOT_NAME			"Reboot"
 #define IOC_DEF_FACTORY_RESET_NAME	"Factory Reset"
 #define IOC_DEF_WIFI_RESET_NAME		"Wi-Fi Reset"
+#define IOC_DEF_EFFECT_NAME			"Effect"
 
 /**
  * Create standard name param
@@ -264,6 +265,23 @@ esp_rmaker_param_t *ioc_factory_reset_param_create(const char *param_name);
  */
 esp_rmaker_param_t *ioc_wifi_reset_param_create(const char *param_name);
 
+/**
+ * Create standard Light Effect param
+ *
+ * This will create the standard light effect parameter, shown as a dropdown
+ * with one entry per effect name.
+ *
+ * @param[in] param_name Name of the parameter
+ * @param[in] val Default Value of the parameter, one of the effect names
+ * @param[in] effects Array of effect names the parameter accepts. Only the
+ * pointer is stored, so the array and the strings must outlive the parameter.
+ * @param[in] count Number of entries in effects
+ *
+ * @return Parameter handle on success.
+ * @return NULL in case of failures.
+ */
+esp_rmaker_param_t *ioc_effect_param_create(const char *param_name, const char *val, const char *effects[], uint8_t count);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
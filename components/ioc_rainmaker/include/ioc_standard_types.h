@@ -55,6 +55,7 @@ extern "C"
 #define IOC_PARAM_REBOOT			"esp.param.reboot"
 #define IOC_PARAM_FACTORY_RESET		"esp.param.factory-reset"
 #define IOC_PARAM_WIFI_RESET		"esp.param.wifi-reset"
+#define IOC_PARAM_LIGHT_EFFECT		"esp.param.light-effect"
 
 #ifdef __cplusplus
 }
@@ -172,4 +172,15 @@ esp_rmaker_param_t *ioc_wifi_reset_param_create(const char *param_name)
         esp_rmaker_param_add_ui_type(param, IOC_UI_TYPE_TRIGGER);
 	}
     return param;
+}
+
+esp_rmaker_param_t *ioc_effect_param_create(const char *param_name, const char *val, const char *effects[], uint8_t count)
+{
+    esp_rmaker_param_t *param = esp_rmaker_param_create(param_name, IOC_PARAM_LIGHT_EFFECT,
+            esp_rmaker_str(val), PROP_FLAG_READ | PROP_FLAG_WRITE);
+	if (param) {
+        esp_rmaker_param_add_ui_type(param, IOC_UI_TYPE_DROPDOWN);
+        esp_rmaker_param_add_valid_str_list(param, effects, count);
+	}
+    return param;
 }
\ No newline at end of file
@@ -7,7 +7,10 @@
 #pragma once
 
 #include <esp_err.h>
+#include <esp_event.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifndef WIFI_RECONNECT_CONNECT_TIMEOUT_MS
 #define WIFI_RECONNECT_CONNECT_TIMEOUT_MS CONFIG_WIFI_RECONNECT_CONNECT_TIMEOUT_MS
@@ -17,8 +20,81 @@
 extern "C" {
 #endif
 
+// RSSI samples kept by the link quality monitor
+#define WIFI_RECONNECT_RSSI_HISTORY 32
+
+ESP_EVENT_DECLARE_BASE(WIFI_RECONNECT_EVENT);
+
+typedef enum
+{
+    WIFI_RECONNECT_EVENT_QUALITY, // wifi_reconnect_quality_t, every monitor period while connected
+    WIFI_RECONNECT_EVENT_ROAMED,  // wifi_reconnect_roam_t, moved to a stronger AP
+} wifi_reconnect_event_t;
+
+typedef struct
+{
+    uint32_t sample; // Sequence number, since boot
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;     // This sample, in dBm
+    int8_t rssi_min; // Over the history
+    int8_t rssi_avg;
+    int8_t rssi_max;
+} wifi_reconnect_quality_t;
+
+typedef struct
+{
+    uint8_t from_bssid[6];
+    uint8_t to_bssid[6];
+    int8_t from_rssi;
+    int8_t to_rssi; // As scanned
+    uint8_t channel;
+    uint32_t duration_ms; // Leaving the old AP to IP address on the new one
+} wifi_reconnect_roam_t;
+
+// Disconnect reasons, grouped by how the reconnect reacts to them
+typedef enum
+{
+    WIFI_RECONNECT_REASON_BEACON_TIMEOUT, // AP went silent, the strongest other known AP is tried, or the same one when there is none
+    WIFI_RECONNECT_REASON_NO_AP,          // AP not found, all channels are scanned
+    WIFI_RECONNECT_REASON_AUTH,           // Refused by the AP, repeated failures back off to the maximum
+    WIFI_RECONNECT_REASON_OTHER,
+    WIFI_RECONNECT_REASON_MAX,
+} wifi_reconnect_reason_t;
+
+typedef struct
+{
+    uint32_t disconnects;      // Disconnect events with this reason
+    uint32_t recoveries;       // Lost connections that got an IP address again
+    uint32_t last_recover_ms;  // Connection lost to IP address
+    uint32_t max_recover_ms;
+    uint64_t total_recover_ms; // Divide by recoveries for the mean
+} wifi_reconnect_reason_stats_t;
+
+typedef struct
+{
+    uint32_t count;    // Successful connections
+    uint32_t failures; // Attempts that timed out or were refused
+    uint32_t last_ms;  // Connect call to IP address
+    uint32_t max_ms;
+    uint64_t total_ms; // Divide by count for the mean
+} wifi_reconnect_path_stats_t;
+
+typedef struct
+{
+    wifi_reconnect_path_stats_t fast; // Straight to the cached AP and channel
+    wifi_reconnect_path_stats_t full; // Scan of all channels and DHCP
+    uint32_t leases_reused;           // Fast connections that skipped DHCP
+    uint32_t roam_scans;              // Scans made because the link was weak
+    uint32_t roams;                   // Completed moves to a stronger AP
+    wifi_reconnect_reason_stats_t reasons[WIFI_RECONNECT_REASON_MAX]; // Recoveries are counted under the reason that lost the connection
+} wifi_reconnect_stats_t;
+
 esp_err_t wifi_reconnect_start();
 
+// Placement of the background task, core -1 for either. Call before wifi_reconnect_start().
+void wifi_reconnect_set_task(int core, uint32_t priority, uint32_t stack);
+
 void wifi_reconnect_enable(bool enable);
 
 esp_err_t wifi_reconnect_resume();
@@ -31,6 +107,25 @@ bool wifi_reconnect_is_connected();
 
 bool wifi_reconnect_wait_for_connection(uint32_t timeout_ms);
 
+void wifi_reconnect_get_stats(wifi_reconnect_stats_t *stats);
+
+/* Networks to choose from, besides the one left by provisioning, which is
+ * added by itself once connected. Stored in NVS. Call after
+ * wifi_reconnect_start().
+ */
+esp_err_t wifi_reconnect_add_network(const char *ssid, const char *password);
+
+esp_err_t wifi_reconnect_remove_network(const char *ssid);
+
+/* Forget every network, the APs seen for them and the cached connection, in
+ * RAM, RTC memory and NVS. Call on a Wi-Fi or factory reset, so the next
+ * provisioning starts from the new network only.
+ */
+esp_err_t wifi_reconnect_forget_all();
+
+// Copies up to max RSSI samples, oldest first, and returns their count
+size_t wifi_reconnect_get_rssi_history(int8_t *rssi, size_t max);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
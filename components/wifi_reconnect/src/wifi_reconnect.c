@@ -4,25 +4,149 @@
  * Forked from <https://github.com/mdvorak-iot/esp-wifi-reconnect>
  * NO LICENSE
  */
+#include <esp_attr.h>
+#include <esp_crc.h>
 #include <esp_log.h>
+#include <esp_netif.h>
+#include <esp_system.h>
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
 #include <esp_wifi.h>
+#include <lwip/dhcp.h>
+#include <nvs.h>
 
 #include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
 #include <wifi_reconnect.h>
 
 static const char TAG[] = "wifi_reconnect";
 
-// Reconnect incremental backoff, in seconds
-static const uint8_t DELAYS[] = {0, 1, 2, 3, 5, 8, 13, 21, 34, 55, 89, 144, 233};
+// Reconnect backoff bounds, in milliseconds
+#define BACKOFF_BASE_MS CONFIG_WIFI_RECONNECT_BACKOFF_BASE_MS
+#define BACKOFF_MAX_MS CONFIG_WIFI_RECONNECT_BACKOFF_MAX_MS
+
+#define MAX_NETWORKS CONFIG_WIFI_RECONNECT_MAX_NETWORKS
+#define MAX_APS CONFIG_WIFI_RECONNECT_MAX_APS
+#define SCAN_RECORDS 16
+// Per channel dwell of the scans made by this component, in milliseconds
+#define SCAN_DWELL_MIN_MS 20
+#define SCAN_DWELL_MAX_MS 60
+// Samples averaged before the link counts as weak
+#define ROAM_SAMPLES 3
 
 #define RECONNECT_BIT BIT0
 #define CONNECTED_BIT BIT1
 // Negative state is used for wait_for_reconnect, to avoid state polling
 #define NOT_CONNECTED_BIT BIT2
+// Set by a disconnect, ends a connection attempt before its timeout
+#define ATTEMPT_FAILED_BIT BIT3
+// Something the task has to look at happened, it sleeps otherwise
+#define WAKE_BIT BIT4
+// Link got weak, look for a better AP
+#define ROAM_BIT BIT5
+
+#define CACHE_MAGIC 0x57524332
+#define CACHE_NVS_NAMESPACE "wifi_reconnect"
+#define CACHE_NVS_KEY "cache"
+#define NETWORKS_NVS_KEY "networks"
+// time() below this still counts from boot, SNTP has not set the clock yet (2021-01-01)
+#define CLOCK_SET_AFTER 1609459200
+
+/* Last good connection. The lease is reused until its renewal time (T1, half
+ * of the lease), from then on DHCP takes over again. A lease timed before
+ * SNTP set the clock only survives a software reset, where the time since
+ * boot carries on; flash never keeps it.
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+    int64_t lease_start; // time(), seconds
+    uint32_t lease_time; // Seconds, 0 when unknown
+    bool lease_synced;   // lease_start is wall clock time, not time since boot
+    uint32_t crc;
+} wifi_reconnect_cache_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+} network_t;
+
+// AP of a known network, learned from scans and connections
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t network;    // Index into networks
+    int8_t rssi;        // When last seen
+    uint8_t generation; // Scan round it was last seen in
+} known_ap_t;
+
+typedef enum
+{
+    STATE_IDLE,       // Reconnect disabled or nothing to connect to
+    STATE_CONNECTED,  // Got IP, waiting for a disconnect
+    STATE_BACKOFF,    // Waiting before the next attempt
+    STATE_CONNECTING, // Attempt running, waiting for IP, disconnect or timeout
+} reconnect_state_t;
+
+static const char *const REASON_NAMES[WIFI_RECONNECT_REASON_MAX] = {
+    [WIFI_RECONNECT_REASON_BEACON_TIMEOUT] = "beacon timeout",
+    [WIFI_RECONNECT_REASON_NO_AP] = "AP not found",
+    [WIFI_RECONNECT_REASON_AUTH] = "auth failure",
+    [WIFI_RECONNECT_REASON_OTHER] = "other",
+};
 
 static EventGroupHandle_t wifi_event_group;
 static uint32_t connect_timeout = WIFI_RECONNECT_CONNECT_TIMEOUT_MS;
+static BaseType_t task_core = tskNO_AFFINITY;
+static UBaseType_t task_priority = tskIDLE_PRIORITY + 1;
+static uint32_t task_stack = 4096;
+
+// Kept over a software reset, NVS covers power loss
+static RTC_NOINIT_ATTR wifi_reconnect_cache_t rtc_cache;
+static wifi_reconnect_cache_t cache;
+static bool fast_path;      // Current attempt goes straight to the cached AP
+static bool fast_failed;    // Last fast attempt failed, scan until connected again
+static bool lease_applied;  // Cached lease is set as a static address, DHCP is stopped
+static int64_t connect_start_us;
+static esp_timer_handle_t renew_timer;
+static wifi_reconnect_stats_t stats;
+static volatile wifi_reconnect_reason_t last_reason; // Of the latest disconnect event
+static uint32_t backoff_ms;                          // Previous delay, 0 while connected
+static uint8_t auth_failures;                        // Consecutive attempts refused by the AP
+static int64_t lost_at_us;                           // Connection lost and not recovered yet, 0 otherwise
+static wifi_reconnect_reason_t lost_reason;
+
+// Networks and APs, shared with the API
+static SemaphoreHandle_t networks_lock;
+static network_t networks[MAX_NETWORKS];
+static uint8_t network_count;
+static known_ap_t aps[MAX_APS];
+static uint8_t ap_count;
+static uint8_t scan_generation;
+static known_ap_t roam_target; // AP the next attempt goes to, when roam_pending
+static bool roam_pending;
+
+// Quality monitor and roaming, reconnect task only
+static int8_t rssi_history[WIFI_RECONNECT_RSSI_HISTORY];
+static uint32_t rssi_samples;
+static int64_t last_roam_scan_us;
+static volatile bool roaming; // Disconnected on purpose, not counted as a lost connection
+static int64_t roam_started_us;
+static wifi_reconnect_roam_t roam_event;
+
+ESP_EVENT_DEFINE_BASE(WIFI_RECONNECT_EVENT);
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 
@@ -32,84 +156,776 @@ static inline bool is_ssid_stored(wifi_config_t *conf)
     return err == ESP_OK && conf->sta.ssid[0] != '\0';
 }
 
-static bool wait_for_reconnect()
+static inline esp_netif_t *sta_netif()
+{
+    return esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+}
+
+static uint32_t cache_crc(const wifi_reconnect_cache_t *c)
+{
+    return esp_crc32_le(0, (const uint8_t *)c, offsetof(wifi_reconnect_cache_t, crc));
+}
+
+static inline bool clock_is_set()
 {
-    // NOTE this will return immediately, if both bits are already set
-    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, RECONNECT_BIT | NOT_CONNECTED_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
-    return (bits & RECONNECT_BIT) != 0 && (bits & NOT_CONNECTED_BIT) != 0;
+    return time(NULL) >= CLOCK_SET_AFTER;
+}
+
+static bool cache_is_valid(const wifi_reconnect_cache_t *c)
+{
+    return c->magic == CACHE_MAGIC && c->crc == cache_crc(c);
+}
+
+static void cache_load()
+{
+    if (cache_is_valid(&rtc_cache))
+    {
+        cache = rtc_cache;
+        return;
+    }
+    nvs_handle_t handle;
+    if (nvs_open(CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return;
+    size_t size = sizeof(cache);
+    if (nvs_get_blob(handle, CACHE_NVS_KEY, &cache, &size) != ESP_OK || size != sizeof(cache) || !cache_is_valid(&cache))
+        memset(&cache, 0, sizeof(cache));
+    nvs_close(handle);
+    rtc_cache = cache;
+}
+
+static void cache_store(bool persist)
+{
+    cache.magic = CACHE_MAGIC;
+    cache.crc = cache_crc(&cache);
+    rtc_cache = cache;
+    if (!persist)
+        return;
+    // The time since boot starts again after a power loss, a lease timed with it cannot be aged then
+    wifi_reconnect_cache_t stored = cache;
+    if (!stored.lease_synced)
+    {
+        stored.lease_time = 0;
+        stored.crc = cache_crc(&stored);
+    }
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, CACHE_NVS_KEY, &stored, sizeof(stored));
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Could not save connection cache: %s", esp_err_to_name(err));
+}
+
+static void networks_load()
+{
+    nvs_handle_t handle;
+    if (nvs_open(CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return;
+    size_t size = sizeof(networks);
+    if (nvs_get_blob(handle, NETWORKS_NVS_KEY, networks, &size) == ESP_OK)
+        network_count = size / sizeof(network_t);
+    nvs_close(handle);
+}
+
+static esp_err_t networks_save_locked()
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = network_count ? nvs_set_blob(handle, NETWORKS_NVS_KEY, networks, network_count * sizeof(network_t))
+                            : nvs_erase_key(handle, NETWORKS_NVS_KEY);
+        if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND)
+            err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Could not save networks: %s", esp_err_to_name(err));
+    return err;
+}
+
+static int network_find_locked(const uint8_t *ssid)
+{
+    for (uint8_t i = 0; i < network_count; i++)
+    {
+        if (strncmp((const char *)networks[i].ssid, (const char *)ssid, sizeof(networks[i].ssid)) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static bool network_apply_locked(uint8_t network, wifi_config_t *conf)
+{
+    if (network >= network_count)
+        return false;
+    memcpy(conf->sta.ssid, networks[network].ssid, sizeof(conf->sta.ssid));
+    memcpy(conf->sta.password, networks[network].password, sizeof(conf->sta.password));
+    return true;
+}
+
+// Keep the credentials of a network that worked, provisioning only leaves them in the driver
+static void network_learn(const wifi_config_t *conf)
+{
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    int index = network_find_locked(conf->sta.ssid);
+    if (index < 0 || memcmp(networks[index].password, conf->sta.password, sizeof(networks[index].password)) != 0)
+    {
+        // When full, the last added network makes room
+        if (index < 0)
+            index = network_count < MAX_NETWORKS ? network_count++ : MAX_NETWORKS - 1;
+        memcpy(networks[index].ssid, conf->sta.ssid, sizeof(networks[index].ssid));
+        memcpy(networks[index].password, conf->sta.password, sizeof(networks[index].password));
+        networks_save_locked();
+    }
+    xSemaphoreGive(networks_lock);
+}
+
+static void ap_learn_locked(const uint8_t *bssid, uint8_t channel, uint8_t network, int8_t rssi)
+{
+    int slot = -1;
+    for (uint8_t i = 0; i < ap_count && slot < 0; i++)
+    {
+        if (memcmp(aps[i].bssid, bssid, sizeof(aps[i].bssid)) == 0)
+            slot = i;
+    }
+    if (slot < 0)
+    {
+        if (ap_count < MAX_APS)
+            slot = ap_count++;
+        else
+        {
+            // Full, forget the weakest
+            slot = 0;
+            for (uint8_t i = 1; i < ap_count; i++)
+            {
+                if (aps[i].rssi < aps[slot].rssi)
+                    slot = i;
+            }
+        }
+        memcpy(aps[slot].bssid, bssid, sizeof(aps[slot].bssid));
+    }
+    aps[slot].channel = channel;
+    aps[slot].network = network;
+    aps[slot].rssi = rssi;
+    aps[slot].generation = scan_generation;
+}
+
+// Strongest known AP other than exclude, only those seen by the latest scan round when fresh
+static int best_ap_locked(const uint8_t *exclude, bool fresh)
+{
+    int best = -1;
+    for (uint8_t i = 0; i < ap_count; i++)
+    {
+        if ((fresh && aps[i].generation != scan_generation) || aps[i].network >= network_count)
+            continue;
+        if (exclude && memcmp(aps[i].bssid, exclude, sizeof(aps[i].bssid)) == 0)
+            continue;
+        if (best < 0 || aps[i].rssi > aps[best].rssi)
+            best = i;
+    }
+    return best;
+}
+
+// Blocking scan of one channel, or of all of them for 0, remembering the APs of known networks
+static void scan(uint8_t channel)
+{
+    static wifi_ap_record_t records[SCAN_RECORDS];
+    wifi_scan_config_t config = {
+        .channel = channel,
+        .scan_type = WIFI_SCAN_TYPE_ACTIVE,
+        .scan_time.active = {.min = SCAN_DWELL_MIN_MS, .max = SCAN_DWELL_MAX_MS},
+    };
+    uint16_t count = SCAN_RECORDS;
+    if (esp_wifi_scan_start(&config, true) != ESP_OK || esp_wifi_scan_get_ap_records(&count, records) != ESP_OK)
+        return;
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        int network = network_find_locked(records[i].ssid);
+        if (network >= 0)
+            ap_learn_locked(records[i].bssid, records[i].primary, network, records[i].rssi);
+    }
+    xSemaphoreGive(networks_lock);
+}
+
+// Seconds of the cached lease left before renewal is due, 0 when it must not be reused
+static int64_t lease_reusable_for()
+{
+#if CONFIG_WIFI_RECONNECT_REUSE_LEASE
+    int64_t now = time(NULL);
+    // Wall clock and time since boot cannot be compared, and an earlier time means the lease age is unknown
+    if (!cache.lease_time || !cache.ip || cache.lease_synced != clock_is_set() || now < cache.lease_start)
+        return 0;
+    int64_t renew_at = cache.lease_start + cache.lease_time / 2;
+    return renew_at > now ? renew_at - now : 0;
+#else
+    return 0;
+#endif
+}
+
+static void lease_release()
+{
+    if (!lease_applied)
+        return;
+    lease_applied = false;
+    if (renew_timer)
+        esp_timer_stop(renew_timer);
+    esp_netif_dhcpc_start(sta_netif());
+}
+
+static void renew_timer_cb(void *arg)
+{
+    ESP_LOGI(TAG, "Cached lease due for renewal, starting DHCP");
+    lease_release();
+}
+
+static bool lease_apply()
+{
+    int64_t reusable = lease_reusable_for();
+    esp_netif_t *netif = sta_netif();
+    if (!reusable || !netif)
+    {
+        lease_release();
+        return false;
+    }
+    esp_netif_ip_info_t ip_info = {
+        .ip.addr = cache.ip,
+        .netmask.addr = cache.netmask,
+        .gw.addr = cache.gw,
+    };
+    esp_netif_dhcpc_stop(netif);
+    if (esp_netif_set_ip_info(netif, &ip_info) != ESP_OK)
+    {
+        esp_netif_dhcpc_start(netif);
+        return false;
+    }
+    esp_netif_dns_info_t dns = {.ip.u_addr.ip4.addr = cache.dns};
+    esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+    lease_applied = true;
+    if (renew_timer)
+    {
+        esp_timer_stop(renew_timer);
+        esp_timer_start_once(renew_timer, reusable * 1000000LL);
+    }
+    return true;
+}
+
+/* Point the station at, in order of preference: a roam or failover target,
+ * the cached AP, the strongest AP of any known network found by a scan, or a
+ * scan of all channels for the configured network.
+ */
+static void prepare_connect(wifi_config_t *conf)
+{
+    known_ap_t target = {};
+    bool direct = false;
+    fast_path = false;
+
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    if (roam_pending)
+    {
+        target = roam_target;
+        roam_pending = false;
+        fast_path = direct = network_apply_locked(target.network, conf);
+    }
+#if CONFIG_WIFI_RECONNECT_FAST_CONNECT
+    else if (!fast_failed && cache.magic == CACHE_MAGIC && cache.channel)
+    {
+        int network = network_find_locked(cache.ssid);
+        if (network >= 0)
+        {
+            memcpy(target.bssid, cache.bssid, sizeof(target.bssid));
+            target.channel = cache.channel;
+            fast_path = direct = network_apply_locked(network, conf);
+        }
+    }
+#endif
+    bool choose = !direct && network_count > 1;
+    xSemaphoreGive(networks_lock);
+
+    if (choose)
+    {
+        // Several networks, only a scan tells which one is in range
+        scan_generation++;
+        scan(0);
+        xSemaphoreTake(networks_lock, portMAX_DELAY);
+        int best = best_ap_locked(NULL, true);
+        if (best >= 0)
+        {
+            target = aps[best];
+            direct = network_apply_locked(target.network, conf);
+        }
+        xSemaphoreGive(networks_lock);
+    }
+
+    if (direct)
+    {
+        conf->sta.bssid_set = true;
+        memcpy(conf->sta.bssid, target.bssid, sizeof(conf->sta.bssid));
+        conf->sta.channel = target.channel;
+        conf->sta.scan_method = WIFI_FAST_SCAN;
+    }
+    else
+    {
+        conf->sta.bssid_set = false;
+        conf->sta.channel = 0;
+        conf->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        conf->sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    // Only provisioning writes credentials to flash, attempts are configured in RAM
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_wifi_set_config(WIFI_IF_STA, conf);
+    esp_wifi_set_storage(WIFI_STORAGE_FLASH);
+
+    // The lease belongs to the network of the cached AP
+    bool cached_network = memcmp(conf->sta.ssid, cache.ssid, sizeof(cache.ssid)) == 0;
+    if (fast_path && cached_network && lease_apply())
+        stats.leases_reused++;
+    else
+        lease_release();
+}
+
+static void record_connect_time()
+{
+    if (!connect_start_us)
+        return;
+    uint32_t elapsed_ms = (esp_timer_get_time() - connect_start_us) / 1000;
+    connect_start_us = 0;
+    wifi_reconnect_path_stats_t *path = fast_path ? &stats.fast : &stats.full;
+    path->count++;
+    path->last_ms = elapsed_ms;
+    path->total_ms += elapsed_ms;
+    if (elapsed_ms > path->max_ms)
+        path->max_ms = elapsed_ms;
+    ESP_LOGI(TAG, "Connected in %u ms (%s), fast path avg %u ms over %u, full scan avg %u ms over %u",
+             elapsed_ms, fast_path ? (lease_applied ? "cached AP and lease" : "cached AP") : "full scan",
+             stats.fast.count ? (uint32_t)(stats.fast.total_ms / stats.fast.count) : 0, stats.fast.count,
+             stats.full.count ? (uint32_t)(stats.full.total_ms / stats.full.count) : 0, stats.full.count);
+}
+
+static void update_cache(const ip_event_got_ip_t *event)
+{
+    wifi_ap_record_t ap;
+    wifi_config_t conf;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_wifi_get_config(WIFI_IF_STA, &conf) != ESP_OK)
+        return;
+
+    wifi_reconnect_cache_t previous = cache;
+    memcpy(cache.ssid, conf.sta.ssid, sizeof(cache.ssid));
+    memcpy(cache.bssid, ap.bssid, sizeof(cache.bssid));
+    cache.channel = ap.primary;
+    cache.ip = event->ip_info.ip.addr;
+    cache.netmask = event->ip_info.netmask.addr;
+    cache.gw = event->ip_info.gw.addr;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(event->esp_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK)
+        cache.dns = dns.ip.u_addr.ip4.addr;
+    if (!lease_applied)
+    {
+        // A lease just handed out by DHCP
+        struct dhcp *dhcp = netif_dhcp_data((struct netif *)esp_netif_get_netif_impl(event->esp_netif));
+        cache.lease_time = dhcp ? dhcp->offered_t0_lease : 0;
+        cache.lease_start = time(NULL);
+        cache.lease_synced = clock_is_set();
+    }
+    // Flash is only written when something other than the time changed
+    bool changed = previous.magic != CACHE_MAGIC || memcmp(previous.bssid, cache.bssid, sizeof(cache.bssid)) ||
+                   previous.channel != cache.channel || previous.ip != cache.ip || previous.lease_time != cache.lease_time ||
+                   previous.lease_synced != cache.lease_synced ||
+                   memcmp(previous.ssid, cache.ssid, sizeof(cache.ssid));
+    cache_store(changed);
+}
+
+static wifi_reconnect_reason_t classify_reason(uint8_t reason)
+{
+    switch (reason)
+    {
+    case WIFI_REASON_BEACON_TIMEOUT:
+        return WIFI_RECONNECT_REASON_BEACON_TIMEOUT;
+    case WIFI_REASON_NO_AP_FOUND:
+        return WIFI_RECONNECT_REASON_NO_AP;
+    case WIFI_REASON_AUTH_EXPIRE:
+    case WIFI_REASON_AUTH_FAIL:
+    case WIFI_REASON_MIC_FAILURE:
+    case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+    case WIFI_REASON_HANDSHAKE_TIMEOUT:
+        return WIFI_RECONNECT_REASON_AUTH;
+    default:
+        return WIFI_RECONNECT_REASON_OTHER;
+    }
+}
+
+static void record_recovery()
+{
+    if (!lost_at_us)
+        return;
+    uint32_t elapsed_ms = (esp_timer_get_time() - lost_at_us) / 1000;
+    lost_at_us = 0;
+    wifi_reconnect_reason_stats_t *reason = &stats.reasons[lost_reason];
+    reason->recoveries++;
+    reason->last_recover_ms = elapsed_ms;
+    reason->total_recover_ms += elapsed_ms;
+    if (elapsed_ms > reason->max_recover_ms)
+        reason->max_recover_ms = elapsed_ms;
+    ESP_LOGI(TAG, "Recovered from %s in %u ms", REASON_NAMES[lost_reason], elapsed_ms);
 }
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
-        ESP_LOGI(TAG, "WiFi disconnected");
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        wifi_reconnect_reason_t reason = classify_reason(event->reason);
+        ESP_LOGI(TAG, "WiFi disconnected, reason %d (%s)", event->reason, REASON_NAMES[reason]);
+        stats.reasons[reason].disconnects++;
+        last_reason = reason;
+        if ((xEventGroupGetBits(wifi_event_group) & CONNECTED_BIT) && !lost_at_us && !roaming)
+        {
+            lost_at_us = esp_timer_get_time();
+            lost_reason = reason;
+        }
         xEventGroupClearBits(wifi_event_group, CONNECTED_BIT);
-        xEventGroupSetBits(wifi_event_group, NOT_CONNECTED_BIT);
+        xEventGroupSetBits(wifi_event_group, NOT_CONNECTED_BIT | ATTEMPT_FAILED_BIT | WAKE_BIT);
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
     {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        record_connect_time();
+        record_recovery();
+        update_cache(event);
 
         // Mark as connected, also enable reconnect automatically
         xEventGroupClearBits(wifi_event_group, NOT_CONNECTED_BIT);
-        xEventGroupSetBits(wifi_event_group, CONNECTED_BIT | RECONNECT_BIT);
+        xEventGroupSetBits(wifi_event_group, CONNECTED_BIT | RECONNECT_BIT | WAKE_BIT);
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_BSS_RSSI_LOW)
+    {
+        xEventGroupSetBits(wifi_event_group, ROAM_BIT | WAKE_BIT);
+    }
+}
+
+static uint32_t random_between(uint32_t low, uint32_t high)
+{
+    return high > low ? low + esp_random() % (high - low + 1) : low;
+}
+
+/* Decorrelated jitter: each delay is drawn between the base and three times
+ * the previous one, so nodes that lost the same AP at the same moment drift
+ * apart instead of retrying in lockstep.
+ */
+static uint32_t next_backoff(wifi_reconnect_reason_t reason)
+{
+    if (reason == WIFI_RECONNECT_REASON_AUTH && auth_failures >= CONFIG_WIFI_RECONNECT_AUTH_RETRIES)
+    {
+        // Most likely wrong credentials, retrying sooner only gets the station blocked by the AP
+        backoff_ms = BACKOFF_MAX_MS;
+        return random_between(BACKOFF_MAX_MS / 2, BACKOFF_MAX_MS);
+    }
+    if (!backoff_ms)
+    {
+        // First retry after losing the connection, spread within the base delay
+        backoff_ms = BACKOFF_BASE_MS;
+        return random_between(0, BACKOFF_BASE_MS);
+    }
+    backoff_ms = MIN(BACKOFF_MAX_MS, random_between(BACKOFF_BASE_MS, backoff_ms * 3));
+    return backoff_ms;
+}
+
+// Returns the delay before the next attempt
+static uint32_t attempt_failed(bool timed_out)
+{
+    wifi_reconnect_reason_t reason = timed_out ? WIFI_RECONNECT_REASON_OTHER : last_reason;
+    connect_start_us = 0;
+    (fast_path ? &stats.fast : &stats.full)->failures++;
+    auth_failures = reason == WIFI_RECONNECT_REASON_AUTH ? auth_failures + 1 : 0;
+    ESP_LOGI(TAG, "Connect %s (%s)", timed_out ? "timeout" : "failed", REASON_NAMES[reason]);
+    if (roaming)
+    {
+        // The roam target did not take us, from here on this is a lost connection
+        roaming = false;
+        lost_at_us = roam_started_us;
+        lost_reason = reason;
+    }
+
+    if (fast_path)
+    {
+        lease_release();
+        if (reason != WIFI_RECONNECT_REASON_AUTH)
+        {
+            // The AP may have moved to another channel, scan right away
+            fast_failed = true;
+            return 0;
+        }
+    }
+    else if (reason == WIFI_RECONNECT_REASON_NO_AP)
+    {
+        // Keep scanning all channels until something answers
+        fast_failed = true;
+    }
+    return next_backoff(reason);
+}
+
+// Look for a clearly stronger AP of a known network and move over to it
+static void roam_check()
+{
+#if CONFIG_WIFI_RECONNECT_ROAMING
+    int64_t now = esp_timer_get_time();
+    if (last_roam_scan_us && now - last_roam_scan_us < CONFIG_WIFI_RECONNECT_ROAM_INTERVAL_MS * 1000LL)
+        return;
+    wifi_ap_record_t current;
+    if (esp_wifi_sta_get_ap_info(&current) != ESP_OK)
+        return;
+    last_roam_scan_us = now;
+    stats.roam_scans++;
+
+    // Only the channels known APs were seen on, all of them while there is no other AP known yet
+    uint16_t channels = 0;
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    for (uint8_t i = 0; i < ap_count; i++)
+    {
+        if (memcmp(aps[i].bssid, current.bssid, sizeof(current.bssid)) != 0 && aps[i].channel < 16)
+            channels |= 1 << aps[i].channel;
+    }
+    xSemaphoreGive(networks_lock);
+    scan_generation++;
+    if (!channels)
+        scan(0);
+    for (uint8_t channel = 1; channel < 16; channel++)
+    {
+        if (channels & (1 << channel))
+            scan(channel);
+    }
+
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    int best = best_ap_locked(current.bssid, true);
+    bool roam = best >= 0 && aps[best].rssi >= current.rssi + CONFIG_WIFI_RECONNECT_ROAM_HYSTERESIS;
+    if (roam)
+    {
+        roam_target = aps[best];
+        roam_pending = true;
+    }
+    xSemaphoreGive(networks_lock);
+
+    if (!roam)
+    {
+        // Event fires once, arm it again
+        esp_wifi_set_rssi_threshold(CONFIG_WIFI_RECONNECT_ROAM_RSSI);
+        return;
+    }
+    ESP_LOGI(TAG, "Roaming from " MACSTR " (%d dBm) to " MACSTR " (%d dBm) on channel %d",
+             MAC2STR(current.bssid), current.rssi, MAC2STR(roam_target.bssid), roam_target.rssi, roam_target.channel);
+    memcpy(roam_event.from_bssid, current.bssid, sizeof(roam_event.from_bssid));
+    memcpy(roam_event.to_bssid, roam_target.bssid, sizeof(roam_event.to_bssid));
+    roam_event.from_rssi = current.rssi;
+    roam_event.to_rssi = roam_target.rssi;
+    roam_event.channel = roam_target.channel;
+    roam_started_us = now;
+    roaming = true;
+    esp_wifi_disconnect();
+#endif
+}
+
+// Periodic link sample while connected, feeds the RSSI history and triggers roaming
+static void monitor_sample()
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return;
+    rssi_history[rssi_samples % WIFI_RECONNECT_RSSI_HISTORY] = ap.rssi;
+    rssi_samples++;
+
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    int network = network_find_locked(ap.ssid);
+    if (network >= 0)
+        ap_learn_locked(ap.bssid, ap.primary, network, ap.rssi);
+    xSemaphoreGive(networks_lock);
+
+    wifi_reconnect_quality_t quality = {
+        .sample = rssi_samples,
+        .channel = ap.primary,
+        .rssi = ap.rssi,
+        .rssi_min = INT8_MAX,
+        .rssi_max = INT8_MIN,
+    };
+    memcpy(quality.bssid, ap.bssid, sizeof(quality.bssid));
+    uint32_t count = MIN(rssi_samples, WIFI_RECONNECT_RSSI_HISTORY);
+    int32_t sum = 0, recent = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int8_t rssi = rssi_history[(rssi_samples - 1 - i) % WIFI_RECONNECT_RSSI_HISTORY];
+        sum += rssi;
+        if (i < ROAM_SAMPLES)
+            recent += rssi;
+        if (rssi < quality.rssi_min)
+            quality.rssi_min = rssi;
+        if (rssi > quality.rssi_max)
+            quality.rssi_max = rssi;
+    }
+    quality.rssi_avg = sum / (int32_t)count;
+    esp_event_post(WIFI_RECONNECT_EVENT, WIFI_RECONNECT_EVENT_QUALITY, &quality, sizeof(quality), 0);
+
+    // Weak over several samples, not a single dip
+    if (count >= ROAM_SAMPLES && recent / ROAM_SAMPLES < CONFIG_WIFI_RECONNECT_ROAM_RSSI)
+        roam_check();
+}
+
+static void connected()
+{
+    ESP_LOGI(TAG, "Connected successfully");
+    backoff_ms = 0;
+    auth_failures = 0;
+    fast_failed = false;
+
+    wifi_config_t conf;
+    if (esp_wifi_get_config(WIFI_IF_STA, &conf) == ESP_OK)
+        network_learn(&conf);
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+    {
+        xSemaphoreTake(networks_lock, portMAX_DELAY);
+        int network = network_find_locked(ap.ssid);
+        if (network >= 0)
+            ap_learn_locked(ap.bssid, ap.primary, network, ap.rssi);
+        xSemaphoreGive(networks_lock);
+    }
+
+    if (roaming)
+    {
+        roaming = false;
+        stats.roams++;
+        roam_event.duration_ms = (esp_timer_get_time() - roam_started_us) / 1000;
+        ESP_LOGI(TAG, "Roamed in %u ms", roam_event.duration_ms);
+        esp_event_post(WIFI_RECONNECT_EVENT, WIFI_RECONNECT_EVENT_ROAMED, &roam_event, sizeof(roam_event), 0);
     }
+#if CONFIG_WIFI_RECONNECT_ROAMING
+    esp_wifi_set_rssi_threshold(CONFIG_WIFI_RECONNECT_ROAM_RSSI);
+#endif
 }
 
+// After a beacon timeout the AP is most likely gone, fail over to the strongest other one
+static void failover_select()
+{
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    int best = best_ap_locked(cache.bssid, false);
+    if (best >= 0)
+    {
+        roam_target = aps[best];
+        roam_pending = true;
+        ESP_LOGI(TAG, "Failing over to " MACSTR " on channel %d", MAC2STR(roam_target.bssid), roam_target.channel);
+    }
+    xSemaphoreGive(networks_lock);
+}
+
+static reconnect_state_t start_attempt(TickType_t *deadline)
+{
+    wifi_config_t conf = {};
+    if (!is_ssid_stored(&conf))
+    {
+        // Provisioning connects on its own, the resulting events wake the task again
+        ESP_LOGI(TAG, "No SSID stored");
+        return STATE_IDLE;
+    }
+
+    // Start reconnect
+    prepare_connect(&conf);
+    ESP_LOGI(TAG, "Connecting to '%s'%s, timeout %d ms", conf.sta.ssid,
+             fast_path ? " on its last channel" : "", connect_timeout);
+    xEventGroupClearBits(wifi_event_group, ATTEMPT_FAILED_BIT);
+    connect_start_us = esp_timer_get_time();
+	esp_err_t err;
+    err = esp_wifi_connect();
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "esp_wifi_connect() returned error 0x%x.", err);
+        esp_wifi_stop();
+        esp_wifi_start();
+	}
+    *deadline = xTaskGetTickCount() + connect_timeout / portTICK_PERIOD_MS;
+    return STATE_CONNECTING;
+}
+
+static reconnect_state_t start_backoff(uint32_t delay_ms, TickType_t *deadline)
+{
+    if (delay_ms > 0)
+        ESP_LOGD(TAG, "Waiting for %u ms", delay_ms);
+    *deadline = xTaskGetTickCount() + delay_ms / portTICK_PERIOD_MS;
+    return STATE_BACKOFF;
+}
+
+/* Event driven: the task sleeps on WAKE_BIT, bounded only by the deadline of
+ * the current backoff or attempt, and never polls.
+ */
 _Noreturn static void wifi_reconnect_task(void *unused)
 {
     ESP_LOGI(TAG, "WiFi reconnect started");
-    uint8_t failures = 0;
+    reconnect_state_t state = STATE_IDLE;
+    TickType_t deadline = 0;
 
     // Infinite task loop
     for (;;)
     {
         esp_task_wdt_reset();
 
-        wifi_config_t conf = {};
-        if (wait_for_reconnect() && is_ssid_stored(&conf))
+        TickType_t wait = portMAX_DELAY;
+        if (state == STATE_CONNECTED && CONFIG_WIFI_RECONNECT_MONITOR_PERIOD_MS > 0)
+            wait = CONFIG_WIFI_RECONNECT_MONITOR_PERIOD_MS / portTICK_PERIOD_MS;
+        else if (state == STATE_BACKOFF || state == STATE_CONNECTING)
         {
-            // Simple back-off algorithm
-            TickType_t waitFor = DELAYS[failures] * 1000;
-            failures = MIN(sizeof(DELAYS) / sizeof(uint8_t) - 1, failures + 1);
+            TickType_t remaining = deadline - xTaskGetTickCount();
+            wait = (int32_t)remaining > 0 ? remaining : 0;
+        }
+        EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WAKE_BIT, pdTRUE, pdFALSE, wait);
+        bool timed_out = (bits & WAKE_BIT) == 0;
 
-            // Delay
-            if (waitFor > 0)
+        if (bits & CONNECTED_BIT)
+        {
+            if (state != STATE_CONNECTED)
+                connected();
+            state = STATE_CONNECTED;
+            if (bits & ROAM_BIT)
             {
-                ESP_LOGI(TAG, "Waiting for %d ms", waitFor);
-                vTaskDelay(waitFor / portTICK_PERIOD_MS);
+                xEventGroupClearBits(wifi_event_group, ROAM_BIT);
+                roam_check();
             }
+            else if (timed_out)
+                monitor_sample();
+            continue;
+        }
+        if (!(bits & RECONNECT_BIT))
+        {
+            state = STATE_IDLE;
+            continue;
+        }
 
-            // Start reconnect
-            ESP_LOGI(TAG, "Connecting to '%s', timeout %d ms", conf.sta.ssid, connect_timeout);
-			esp_err_t err;
-            err = esp_wifi_connect();
-			if (err != ESP_OK) {
-				ESP_LOGE(TAG, "esp_wifi_connect() returned error 0x%x.", err);
-                esp_wifi_stop(); 
-                esp_wifi_start();
-			}
-
-            // Wait for connection
-            bool connected = (xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, pdFALSE, pdTRUE, connect_timeout / portTICK_PERIOD_MS) & CONNECTED_BIT) != 0;
-
-            // Reset failures, if connected successfully
-            if (connected)
-            {
-                failures = 0;
-                ESP_LOGI(TAG, "Connected successfully");
-            }
-            else
+        switch (state)
+        {
+        case STATE_IDLE:
+            // Enabled while disconnected
+            state = start_attempt(&deadline);
+            break;
+        case STATE_CONNECTED:
+            if (roaming)
             {
-                ESP_LOGI(TAG, "Connect timeout");
+                // Left the AP on purpose, go straight to the new one
+                state = start_attempt(&deadline);
+                break;
             }
-        }
-        else
-        {
-            // Simply wait for a moment
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            // Connection lost
+            if (last_reason == WIFI_RECONNECT_REASON_BEACON_TIMEOUT)
+                failover_select();
+            state = start_backoff(next_backoff(last_reason), &deadline);
+            break;
+        case STATE_BACKOFF:
+            if (timed_out)
+                state = start_attempt(&deadline);
+            break;
+        case STATE_CONNECTING:
+            if (timed_out || (bits & ATTEMPT_FAILED_BIT))
+                state = start_backoff(attempt_failed(timed_out), &deadline);
+            break;
         }
     }
 }
@@ -123,6 +939,18 @@ esp_err_t wifi_reconnect_start()
     configASSERT(wifi_event_group);
     xEventGroupSetBits(wifi_event_group, NOT_CONNECTED_BIT); // Negative bit must be set immediately
 
+    networks_lock = xSemaphoreCreateMutex();
+    configASSERT(networks_lock);
+    cache_load();
+    networks_load();
+    const esp_timer_create_args_t renew_timer_args = {
+        .callback = renew_timer_cb,
+        .name = "wifi_lease_renew",
+    };
+    err = esp_timer_create(&renew_timer_args, &renew_timer);
+    if (err != ESP_OK)
+        return err;
+
     // Register event handlers
     err = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &wifi_event_handler, NULL);
     if (err != ESP_OK)
@@ -132,21 +960,33 @@ esp_err_t wifi_reconnect_start()
     if (err != ESP_OK)
         return err;
 
+    err = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_BSS_RSSI_LOW, &wifi_event_handler, NULL);
+    if (err != ESP_OK)
+        return err;
+
     // Create background task
-    BaseType_t ret = xTaskCreate(wifi_reconnect_task, "wifi_reconnect", 4096, NULL, tskIDLE_PRIORITY + 1, NULL);
+    BaseType_t ret = xTaskCreatePinnedToCore(wifi_reconnect_task, "wifi_reconnect", task_stack, NULL, task_priority, NULL, task_core);
     return ret == pdPASS ? ESP_OK : ESP_FAIL;
 }
 
+void wifi_reconnect_set_task(int core, uint32_t priority, uint32_t stack)
+{
+    task_core = core < 0 ? tskNO_AFFINITY : core;
+    task_priority = priority;
+    task_stack = stack;
+}
+
 void wifi_reconnect_enable(bool enable)
 {
     if (enable)
     {
-        xEventGroupSetBits(wifi_event_group, RECONNECT_BIT);
+        xEventGroupSetBits(wifi_event_group, RECONNECT_BIT | WAKE_BIT);
         ESP_LOGI(TAG, "WiFi reconnect enabled");
     }
     else
     {
         xEventGroupClearBits(wifi_event_group, RECONNECT_BIT);
+        xEventGroupSetBits(wifi_event_group, WAKE_BIT);
         ESP_LOGI(TAG, "WiFi reconnect disabled");
     }
 }
@@ -179,4 +1019,106 @@ bool wifi_reconnect_wait_for_connection(uint32_t timeout_ms)
 {
     EventBits_t bits = xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, pdFALSE, pdTRUE, timeout_ms / portTICK_PERIOD_MS);
     return (bits & CONNECTED_BIT) != 0;
+}
+
+void wifi_reconnect_get_stats(wifi_reconnect_stats_t *out)
+{
+    *out = stats;
+}
+
+esp_err_t wifi_reconnect_add_network(const char *ssid, const char *password)
+{
+    size_t ssid_len = ssid ? strlen(ssid) : 0;
+    size_t password_len = password ? strlen(password) : 0;
+    network_t network = {};
+    if (!ssid_len || ssid_len > sizeof(network.ssid) || password_len > sizeof(network.password))
+        return ESP_ERR_INVALID_ARG;
+    memcpy(network.ssid, ssid, ssid_len);
+    memcpy(network.password, password, password_len);
+
+    esp_err_t err;
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    int index = network_find_locked(network.ssid);
+    if (index < 0 && network_count >= MAX_NETWORKS)
+        err = ESP_ERR_NO_MEM;
+    else
+    {
+        if (index < 0)
+            index = network_count++;
+        networks[index] = network;
+        err = networks_save_locked();
+    }
+    xSemaphoreGive(networks_lock);
+    return err;
+}
+
+esp_err_t wifi_reconnect_remove_network(const char *ssid)
+{
+    uint8_t key[32] = {};
+    strncpy((char *)key, ssid, sizeof(key));
+
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    int index = network_find_locked(key);
+    if (index >= 0)
+    {
+        network_count--;
+        memmove(&networks[index], &networks[index + 1], (network_count - index) * sizeof(network_t));
+        // Forget its APs, the others follow the new indexes
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < ap_count; i++)
+        {
+            if (aps[i].network == index)
+                continue;
+            aps[kept] = aps[i];
+            if (aps[kept].network > index)
+                aps[kept].network--;
+            kept++;
+        }
+        ap_count = kept;
+        roam_pending = false;
+        err = networks_save_locked();
+    }
+    xSemaphoreGive(networks_lock);
+    return err;
+}
+
+esp_err_t wifi_reconnect_forget_all()
+{
+    // RTC memory outlives the reboot that follows a reset
+    memset(&rtc_cache, 0, sizeof(rtc_cache));
+    memset(&cache, 0, sizeof(cache));
+    if (!networks_lock)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(networks_lock, portMAX_DELAY);
+    memset(networks, 0, sizeof(networks));
+    network_count = 0;
+    ap_count = 0;
+    roam_pending = false;
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_erase_all(handle);
+        if (err == ESP_OK)
+            err = nvs_commit(handle);
+        nvs_close(handle);
+    }
+    xSemaphoreGive(networks_lock);
+    // A factory reset erases NVS before it is reported
+    if (err == ESP_ERR_NVS_NOT_INITIALIZED)
+        err = ESP_OK;
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Could not erase networks: %s", esp_err_to_name(err));
+    return err;
+}
+
+size_t wifi_reconnect_get_rssi_history(int8_t *rssi, size_t max)
+{
+    uint32_t samples = rssi_samples;
+    size_t count = MIN(MIN(samples, WIFI_RECONNECT_RSSI_HISTORY), max);
+    for (size_t i = 0; i < count; i++)
+        rssi[i] = rssi_history[(samples - count + i) % WIFI_RECONNECT_RSSI_HISTORY];
+    return count;
 }
\ No newline at end of file
@@ -0,0 +1,384 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_log.h>
+#include <esp_rmaker_core.h>
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include <app_actuator.h>
+#include <app_log.h>
+#include <app_pm.h>
+#include <app_priv.h>
+#include <app_report.h>
+#include <app_tasks.h>
+#include <app_trace.h>
+#include <rgbpixel.h>
+
+#define APP_ACTUATOR_QUEUE_SIZE 32 // Power of two
+#define APP_ACTUATOR_TARGET_INDEXES RGBPIXEL_SEGMENTS
+// At least one tick, a shorter wait would not wait at all
+#define APP_ACTUATOR_SETTLE_TICKS (pdMS_TO_TICKS(CONFIG_APP_ACTUATOR_SETTLE_MS) ? pdMS_TO_TICKS(CONFIG_APP_ACTUATOR_SETTLE_MS) : 1)
+// A steady stream of writes is still applied at least this often
+#define APP_ACTUATOR_SETTLE_MAX_US (5LL * CONFIG_APP_ACTUATOR_SETTLE_MS * 1000)
+
+typedef struct
+{
+    app_actuator_target_t target;
+    uint8_t index;
+    app_actuator_value_t value;
+    int64_t submit_us;
+    uint16_t trace;
+    bool batch; // Part of a request that may carry more params
+} app_actuator_cmd_t;
+
+/* Bounded multi-producer, single-consumer queue. Each slot carries a sequence
+ * number: a producer owns the slot when it equals the claimed position, the
+ * consumer when it equals position + 1. Producers never block or take a lock.
+ */
+typedef struct
+{
+    atomic_uint sequence;
+    app_actuator_cmd_t cmd;
+} app_actuator_slot_t;
+
+static app_actuator_slot_t g_app_actuator_queue[APP_ACTUATOR_QUEUE_SIZE];
+static atomic_uint g_app_actuator_tail;
+static atomic_uint g_app_actuator_head; // Only advanced by the actuator task
+
+// Latest command per target and index, filled while draining the queue
+static app_actuator_cmd_t g_app_actuator_pending[APP_ACTUATOR_TARGET_MAX][APP_ACTUATOR_TARGET_INDEXES];
+static bool g_app_actuator_has_pending[APP_ACTUATOR_TARGET_MAX][APP_ACTUATOR_TARGET_INDEXES];
+
+// Trace ids of the updates made in the current transaction, reported once they are published
+static uint16_t g_app_actuator_traces[RGBPIXEL_SEGMENTS + 2];
+static uint8_t g_app_actuator_trace_count;
+
+static TaskHandle_t g_app_actuator_task;
+static atomic_bool g_app_actuator_batch; // Set by write_cb while it submits a param of a cloud, scene or schedule request
+static atomic_uint g_app_actuator_submitted;
+static atomic_uint g_app_actuator_dropped;
+static atomic_uint g_app_actuator_depth_max;
+static app_actuator_stats_t g_app_actuator_stats;
+
+static bool app_actuator_pop(app_actuator_cmd_t *cmd)
+{
+    unsigned int head = atomic_load_explicit(&g_app_actuator_head, memory_order_relaxed);
+    app_actuator_slot_t *slot = &g_app_actuator_queue[head & (APP_ACTUATOR_QUEUE_SIZE - 1)];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != head + 1)
+        return false;
+    *cmd = slot->cmd;
+    // Hand the slot back to the producers for the next lap
+    atomic_store_explicit(&slot->sequence, head + APP_ACTUATOR_QUEUE_SIZE, memory_order_release);
+    atomic_store_explicit(&g_app_actuator_head, head + 1, memory_order_relaxed);
+    return true;
+}
+
+/* Move everything queued so far into the pending table, newest command per
+ * target wins. batch is set when one of the commands may be followed by
+ * more params of its request.
+ */
+static bool app_actuator_drain(bool *batch)
+{
+    bool drained = false;
+    app_actuator_cmd_t cmd;
+    while (app_actuator_pop(&cmd))
+    {
+        drained = true;
+        *batch |= cmd.batch;
+        app_actuator_cmd_t *pending = &g_app_actuator_pending[cmd.target][cmd.index];
+        if (g_app_actuator_has_pending[cmd.target][cmd.index])
+        {
+            // The latency counts from the oldest command the update answers, which also traces it
+            cmd.submit_us = pending->submit_us;
+            cmd.trace = pending->trace;
+            g_app_actuator_stats.coalesced++;
+        }
+        *pending = cmd;
+        g_app_actuator_has_pending[cmd.target][cmd.index] = true;
+    }
+    return drained;
+}
+
+/* A device update answers every command taken for it. It is traced by the
+ * oldest of them, the others only get their dispatch recorded.
+ */
+static bool app_actuator_take(app_actuator_target_t target, uint8_t index, app_actuator_value_t *value, int64_t *submit_us,
+                              uint16_t *trace)
+{
+    if (!g_app_actuator_has_pending[target][index])
+        return false;
+    g_app_actuator_has_pending[target][index] = false;
+    const app_actuator_cmd_t *pending = &g_app_actuator_pending[target][index];
+    *value = pending->value;
+    if (pending->submit_us < *submit_us)
+    {
+        *submit_us = pending->submit_us;
+        *trace = pending->trace;
+    }
+    app_trace_point(pending->trace, APP_TRACE_DISPATCHED);
+    return true;
+}
+
+static void app_actuator_updated(int64_t submit_us, uint16_t trace)
+{
+    if (trace != APP_TRACE_NONE && g_app_actuator_trace_count < sizeof(g_app_actuator_traces) / sizeof(g_app_actuator_traces[0]))
+        g_app_actuator_traces[g_app_actuator_trace_count++] = trace;
+    uint32_t latency_us = esp_timer_get_time() - submit_us;
+    g_app_actuator_stats.updates++;
+    g_app_actuator_stats.latency_us = latency_us;
+    g_app_actuator_stats.latency_total_us += latency_us;
+    if (latency_us > g_app_actuator_stats.latency_max_us)
+        g_app_actuator_stats.latency_max_us = latency_us;
+}
+
+static void app_actuator_apply_rgb(uint8_t index)
+{
+    rgbpixel_update_t update = {0};
+    app_actuator_value_t value;
+    int64_t submit_us = INT64_MAX;
+    uint16_t trace = APP_TRACE_NONE;
+    if (app_actuator_take(APP_ACTUATOR_RGB_HUE, index, &value, &submit_us, &trace))
+    {
+        update.fields |= RGBPIXEL_UPDATE_HUE;
+        update.hue = value.i;
+    }
+    if (app_actuator_take(APP_ACTUATOR_RGB_SATURATION, index, &value, &submit_us, &trace))
+    {
+        update.fields |= RGBPIXEL_UPDATE_SATURATION;
+        update.saturation = value.i;
+    }
+    if (app_actuator_take(APP_ACTUATOR_RGB_BRIGHTNESS, index, &value, &submit_us, &trace))
+    {
+        update.fields |= RGBPIXEL_UPDATE_BRIGHTNESS;
+        update.brightness = value.i;
+    }
+    if (app_actuator_take(APP_ACTUATOR_RGB_EFFECT, index, &value, &submit_us, &trace))
+    {
+        update.fields |= RGBPIXEL_UPDATE_EFFECT;
+        update.effect = value.s;
+    }
+    if (app_actuator_take(APP_ACTUATOR_RGB_POWER, index, &value, &submit_us, &trace))
+    {
+        update.fields |= RGBPIXEL_UPDATE_POWER;
+        update.power = value.b;
+    }
+    if (!update.fields)
+        return;
+    // The render task records the output once the new colour is on the strip
+    update.trace = trace;
+    rgbpixel_update(index, &update);
+    if (update.fields & RGBPIXEL_UPDATE_POWER)
+        rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_BLUE, true);
+    app_actuator_updated(submit_us, trace);
+}
+
+static void app_actuator_apply_light0(void)
+{
+    app_actuator_value_t power;
+    app_actuator_value_t brightness;
+    int64_t submit_us = INT64_MAX;
+    uint16_t trace = APP_TRACE_NONE;
+    bool has_power = app_actuator_take(APP_ACTUATOR_LIGHT0_POWER, 0, &power, &submit_us, &trace);
+    bool has_brightness = app_actuator_take(APP_ACTUATOR_LIGHT0_BRIGHTNESS, 0, &brightness, &submit_us, &trace);
+    if (has_power)
+    {
+        app_driver_set_light0_state(power.b, has_brightness ? brightness.i : app_driver_get_light0_brightness());
+        app_trace_point(trace, APP_TRACE_OUTPUT);
+        rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_BLUE, true);
+    }
+    else if (has_brightness)
+    {
+        // Turns the light on and stages its power report
+        app_driver_set_light0_brightness(brightness.i);
+        app_trace_point(trace, APP_TRACE_OUTPUT);
+    }
+    else
+    {
+        return;
+    }
+    app_actuator_updated(submit_us, trace);
+}
+
+static void app_actuator_apply_light3(void)
+{
+    app_actuator_value_t power;
+    int64_t submit_us = INT64_MAX;
+    uint16_t trace = APP_TRACE_NONE;
+    if (!app_actuator_take(APP_ACTUATOR_LIGHT3_POWER, 0, &power, &submit_us, &trace))
+        return;
+    app_driver_set_light3_power_state(power.b);
+    app_trace_point(trace, APP_TRACE_OUTPUT);
+    rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_BLUE, true);
+    app_actuator_updated(submit_us, trace);
+}
+
+_Noreturn static void app_actuator_task(void *priv)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // Commands are applied at full speed, light sleep waits until they are reported
+        app_pm_acquire(APP_PM_LOCK_COMMAND);
+
+        /* RainMaker calls write_cb once per param of a request, a scene sets
+         * several in a row. When one of the commands came from such a request
+         * the task collects until the writes pause for the settle window, so
+         * the request is applied with one update per device. Commands from
+         * local control and the device itself are applied at once. A wake-up
+         * without commands only publishes the staged reports.
+         */
+        bool batch = false;
+        if (app_actuator_drain(&batch))
+        {
+            if (batch)
+            {
+                g_app_actuator_stats.settled++;
+                int64_t deadline_us = esp_timer_get_time() + APP_ACTUATOR_SETTLE_MAX_US;
+                while (esp_timer_get_time() < deadline_us && ulTaskNotifyTake(pdTRUE, APP_ACTUATOR_SETTLE_TICKS) > 0)
+                {
+                    app_actuator_drain(&batch);
+                }
+            }
+            g_app_actuator_stats.transactions++;
+            for (uint8_t i = 0; i < RGBPIXEL_SEGMENTS; i++)
+            {
+                app_actuator_apply_rgb(i);
+            }
+            app_actuator_apply_light0();
+            app_actuator_apply_light3();
+        }
+        // Echoes of the writes and the reports of their side effects leave together
+        app_report_flush();
+        for (uint8_t i = 0; i < g_app_actuator_trace_count; i++)
+        {
+            app_trace_point(g_app_actuator_traces[i], APP_TRACE_REPORTED);
+        }
+        g_app_actuator_trace_count = 0;
+        app_pm_release(APP_PM_LOCK_COMMAND);
+        APP_LOGD(APP_LOG_ACTUATOR, "%u params, %u updates in %u transactions (%u settled), latency %u us (max %u us)",
+                 atomic_load_explicit(&g_app_actuator_submitted, memory_order_relaxed), g_app_actuator_stats.updates,
+                 g_app_actuator_stats.transactions, g_app_actuator_stats.settled, g_app_actuator_stats.latency_us,
+                 g_app_actuator_stats.latency_max_us);
+    }
+}
+
+esp_err_t app_actuator_submit(app_actuator_target_t target, uint8_t index, app_actuator_value_t value, uint16_t trace)
+{
+    if (target >= APP_ACTUATOR_TARGET_MAX || index >= APP_ACTUATOR_TARGET_INDEXES)
+        return ESP_ERR_INVALID_ARG;
+
+    unsigned int position = atomic_load_explicit(&g_app_actuator_tail, memory_order_relaxed);
+    app_actuator_slot_t *slot;
+    for (;;)
+    {
+        slot = &g_app_actuator_queue[position & (APP_ACTUATOR_QUEUE_SIZE - 1)];
+        int diff = (int)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+        if (diff == 0)
+        {
+            // Slot is free for this lap, claim the position
+            if (atomic_compare_exchange_weak_explicit(&g_app_actuator_tail, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // The consumer has not freed this slot yet, the queue is full
+            atomic_fetch_add_explicit(&g_app_actuator_dropped, 1, memory_order_relaxed);
+            APP_LOGW(APP_LOG_ACTUATOR, "Queue full, dropping command for target %d", target);
+            return ESP_ERR_NO_MEM;
+        }
+        else
+        {
+            position = atomic_load_explicit(&g_app_actuator_tail, memory_order_relaxed);
+        }
+    }
+    slot->cmd.target = target;
+    slot->cmd.index = index;
+    slot->cmd.value = value;
+    slot->cmd.submit_us = esp_timer_get_time();
+    slot->cmd.trace = trace;
+    slot->cmd.batch = atomic_load_explicit(&g_app_actuator_batch, memory_order_relaxed);
+    app_trace_point(trace, APP_TRACE_QUEUED);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    atomic_fetch_add_explicit(&g_app_actuator_submitted, 1, memory_order_relaxed);
+    unsigned int depth = position + 1 - atomic_load_explicit(&g_app_actuator_head, memory_order_relaxed);
+    unsigned int depth_max = atomic_load_explicit(&g_app_actuator_depth_max, memory_order_relaxed);
+    while (depth > depth_max &&
+           !atomic_compare_exchange_weak_explicit(&g_app_actuator_depth_max, &depth_max, depth,
+                                                  memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    xTaskNotifyGive(g_app_actuator_task);
+    return ESP_OK;
+}
+
+void app_actuator_batch_begin(void)
+{
+    atomic_store_explicit(&g_app_actuator_batch, true, memory_order_relaxed);
+}
+
+void app_actuator_batch_end(void)
+{
+    atomic_store_explicit(&g_app_actuator_batch, false, memory_order_relaxed);
+}
+
+esp_err_t app_actuator_request_flush(void)
+{
+    if (!g_app_actuator_task)
+        return ESP_ERR_INVALID_STATE;
+    xTaskNotifyGive(g_app_actuator_task);
+    return ESP_OK;
+}
+
+void app_actuator_get_stats(app_actuator_stats_t *stats)
+{
+    *stats = g_app_actuator_stats;
+    stats->submitted = atomic_load_explicit(&g_app_actuator_submitted, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&g_app_actuator_dropped, memory_order_relaxed);
+    stats->depth = atomic_load_explicit(&g_app_actuator_tail, memory_order_relaxed) -
+                   atomic_load_explicit(&g_app_actuator_head, memory_order_relaxed);
+    stats->depth_max = atomic_load_explicit(&g_app_actuator_depth_max, memory_order_relaxed);
+}
+
+esp_err_t app_actuator_init(void)
+{
+    for (unsigned int i = 0; i < APP_ACTUATOR_QUEUE_SIZE; i++)
+    {
+        atomic_init(&g_app_actuator_queue[i].sequence, i);
+    }
+    atomic_init(&g_app_actuator_tail, 0);
+    atomic_init(&g_app_actuator_head, 0);
+    atomic_init(&g_app_actuator_batch, false);
+
+    return app_task_create(APP_TASK_ACTUATOR, app_actuator_task, NULL, &g_app_actuator_task);
+}
\ No newline at end of file
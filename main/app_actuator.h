@@ -0,0 +1,83 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <esp_err.h>
+
+/* Hardware changes requested from RainMaker callbacks are queued and applied
+ * by the actuator task. Changes that arrive together are applied as one
+ * update per device; an explicit power change wins over the implicit power
+ * on of a colour or dimmer change. The params of a cloud, scene or schedule
+ * request are collected until the writes pause for CONFIG_APP_ACTUATOR_SETTLE_MS.
+ */
+typedef enum
+{
+    APP_ACTUATOR_RGB_HUE,
+    APP_ACTUATOR_RGB_SATURATION,
+    APP_ACTUATOR_RGB_BRIGHTNESS,
+    APP_ACTUATOR_RGB_EFFECT,
+    APP_ACTUATOR_RGB_POWER,
+    APP_ACTUATOR_LIGHT0_BRIGHTNESS,
+    APP_ACTUATOR_LIGHT0_POWER,
+    APP_ACTUATOR_LIGHT3_POWER,
+    APP_ACTUATOR_TARGET_MAX,
+} app_actuator_target_t;
+
+typedef union
+{
+    bool b;
+    int i;
+    const char *s; // Must point to static storage
+} app_actuator_value_t;
+
+typedef struct
+{
+    uint32_t submitted;         // Params accepted into the queue
+    uint32_t dropped;           // Params rejected because the queue was full
+    uint32_t coalesced;         // Params replaced by a newer one for the same target
+    uint32_t transactions;      // Batches of params applied together
+    uint32_t settled;           // Transactions that waited for the rest of a request
+    uint32_t updates;           // Hardware updates made, at most one per device and transaction
+    uint32_t depth;             // Commands waiting in the queue
+    uint32_t depth_max;
+    uint32_t latency_us;        // Submit to apply time of the last update
+    uint32_t latency_max_us;
+    uint64_t latency_total_us;  // Divide by updates for the mean
+} app_actuator_stats_t;
+
+esp_err_t app_actuator_init(void);
+// trace is the app_trace id of the write, APP_TRACE_NONE when untraced
+esp_err_t app_actuator_submit(app_actuator_target_t target, uint8_t index, app_actuator_value_t value, uint16_t trace);
+// Commands submitted in between belong to a request that may carry more params, they wait for the rest
+void app_actuator_batch_begin(void);
+void app_actuator_batch_end(void);
+// Publish the staged param reports from the actuator task
+esp_err_t app_actuator_request_flush(void);
+void app_actuator_get_stats(app_actuator_stats_t *stats);
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+#include <stdio.h>
+
+#include <app_boot.h>
+
+#ifdef CONFIG_ESP_INSIGHTS_ENABLED
+#include <esp_diagnostics.h>
+#endif
+
+#define APP_BOOT_STACK 4096
+
+typedef struct
+{
+    const char *name;
+    int64_t start_us;
+    int64_t end_us;
+    esp_err_t err;
+    int8_t core;
+} app_boot_record_t;
+
+typedef struct
+{
+    const app_boot_stage_t *stage;
+    uint8_t index;
+} app_boot_job_t;
+
+static app_boot_record_t g_app_boot_records[APP_BOOT_MAX_STAGES];
+static uint8_t g_app_boot_count;
+static int64_t g_app_boot_milestones[APP_BOOT_MILESTONE_MAX];
+static EventGroupHandle_t g_app_boot_done;
+
+static const char *const g_app_boot_milestone_names[APP_BOOT_MILESTONE_MAX] = {
+    [APP_BOOT_ACTUATION_READY] = "actuation ready",
+    [APP_BOOT_WIFI_CONNECTED] = "wifi connected",
+    [APP_BOOT_CLOUD_ONLINE] = "cloud online",
+};
+
+static const char *TAG = "app_boot";
+
+static void app_boot_stage_run(const app_boot_stage_t *stage, uint8_t index)
+{
+    app_boot_record_t *record = &g_app_boot_records[index];
+    record->name = stage->name;
+    record->core = xPortGetCoreID();
+    record->start_us = esp_timer_get_time();
+    record->err = stage->init();
+    record->end_us = esp_timer_get_time();
+    if (record->err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Stage %s failed: %s", stage->name, esp_err_to_name(record->err));
+        if (stage->required)
+            ESP_ERROR_CHECK(record->err);
+    }
+}
+
+static void app_boot_stage_task(void *arg)
+{
+    const app_boot_job_t *job = arg;
+    if (job->stage->after)
+        xEventGroupWaitBits(g_app_boot_done, job->stage->after, pdFALSE, pdTRUE, portMAX_DELAY);
+    app_boot_stage_run(job->stage, job->index);
+    xEventGroupSetBits(g_app_boot_done, APP_BOOT_AFTER(job->index));
+    vTaskDelete(NULL);
+}
+
+esp_err_t app_boot_run(const app_boot_stage_t *stages, uint8_t count)
+{
+    if (count > APP_BOOT_MAX_STAGES)
+        return ESP_ERR_INVALID_ARG;
+    g_app_boot_count = count;
+
+#if CONFIG_APP_BOOT_PARALLEL
+    app_boot_job_t jobs[APP_BOOT_MAX_STAGES];
+    g_app_boot_done = xEventGroupCreate();
+    if (!g_app_boot_done)
+        return ESP_ERR_NO_MEM;
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        jobs[i].stage = &stages[i];
+        jobs[i].index = i;
+        BaseType_t ret = xTaskCreatePinnedToCore(app_boot_stage_task, stages[i].name,
+                                                 stages[i].stack ? stages[i].stack : APP_BOOT_STACK, &jobs[i],
+                                                 priority, NULL, stages[i].core);
+        if (ret != pdPASS)
+        {
+            // Run it here instead, the stages after it still wait for its bit
+            ESP_LOGW(TAG, "Could not create a task for stage %s", stages[i].name);
+            if (stages[i].after)
+                xEventGroupWaitBits(g_app_boot_done, stages[i].after, pdFALSE, pdTRUE, portMAX_DELAY);
+            app_boot_stage_run(&stages[i], i);
+            xEventGroupSetBits(g_app_boot_done, APP_BOOT_AFTER(i));
+        }
+    }
+    xEventGroupWaitBits(g_app_boot_done, APP_BOOT_AFTER(count) - 1, pdFALSE, pdTRUE, portMAX_DELAY);
+    vEventGroupDelete(g_app_boot_done);
+    g_app_boot_done = NULL;
+#else
+    // Table order, which must respect the dependencies
+    for (uint8_t i = 0; i < count; i++)
+        app_boot_stage_run(&stages[i], i);
+#endif
+    return ESP_OK;
+}
+
+void app_boot_mark(app_boot_milestone_t milestone)
+{
+    if (milestone < APP_BOOT_MILESTONE_MAX && !g_app_boot_milestones[milestone])
+        g_app_boot_milestones[milestone] = esp_timer_get_time();
+}
+
+void app_boot_log_timeline(void)
+{
+    const esp_app_desc_t *app = esp_ota_get_app_description();
+    ESP_LOGI(TAG, "Boot timeline of %s %s, ms since startup:", app->project_name, app->version);
+    for (uint8_t i = 0; i < g_app_boot_count; i++)
+    {
+        const app_boot_record_t *record = &g_app_boot_records[i];
+        ESP_LOGI(TAG, "  %-10s %6u - %6u core %d%s", record->name, (uint32_t)(record->start_us / 1000),
+                 (uint32_t)(record->end_us / 1000), record->core, record->err == ESP_OK ? "" : " failed");
+    }
+    for (uint8_t i = 0; i < APP_BOOT_MILESTONE_MAX; i++)
+    {
+        if (g_app_boot_milestones[i])
+            ESP_LOGI(TAG, "  %-16s %6u", g_app_boot_milestone_names[i], (uint32_t)(g_app_boot_milestones[i] / 1000));
+    }
+#ifdef CONFIG_ESP_INSIGHTS_ENABLED
+    // One line per boot, for tracking per firmware version across the fleet
+    char stages[16 * APP_BOOT_MAX_STAGES] = "";
+    size_t used = 0;
+    for (uint8_t i = 0; i < g_app_boot_count && used < sizeof(stages); i++)
+    {
+        const app_boot_record_t *record = &g_app_boot_records[i];
+        used += snprintf(stages + used, sizeof(stages) - used, " %s=%u", record->name,
+                         (uint32_t)((record->end_us - record->start_us) / 1000));
+    }
+    ESP_DIAG_EVENT(TAG, "boot %s actuation=%u wifi=%u cloud=%u%s", app->version,
+                   (uint32_t)(g_app_boot_milestones[APP_BOOT_ACTUATION_READY] / 1000),
+                   (uint32_t)(g_app_boot_milestones[APP_BOOT_WIFI_CONNECTED] / 1000),
+                   (uint32_t)(g_app_boot_milestones[APP_BOOT_CLOUD_ONLINE] / 1000), stages);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+
+/* Boot as a dependency graph. Each stage runs in its own task on the given
+ * core as soon as the stages it depends on are done, so independent drivers
+ * come up side by side. Start and end of every stage, and the milestones
+ * reached afterwards, are kept as microseconds since startup.
+ */
+#define APP_BOOT_MAX_STAGES 16
+#define APP_BOOT_AFTER(stage) (1u << (stage))
+
+typedef struct
+{
+    const char *name;
+    esp_err_t (*init)(void);
+    uint32_t after;      // APP_BOOT_AFTER() of every stage this one needs
+    BaseType_t core;     // Or tskNO_AFFINITY; interrupts installed by the stage land on this core
+    uint32_t stack;      // 0 for the default
+    bool required;       // A failure aborts, otherwise it is logged and dependents still run
+} app_boot_stage_t;
+
+typedef enum
+{
+    APP_BOOT_ACTUATION_READY, // Relays, LEDs and the actuator can take commands
+    APP_BOOT_WIFI_CONNECTED,  // First IP address
+    APP_BOOT_CLOUD_ONLINE,    // First MQTT connection
+    APP_BOOT_MILESTONE_MAX,
+} app_boot_milestone_t;
+
+esp_err_t app_boot_run(const app_boot_stage_t *stages, uint8_t count);
+void app_boot_mark(app_boot_milestone_t milestone);
+void app_boot_log_timeline(void);
\ No newline at end of file
@@ -0,0 +1,558 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <driver/gpio.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_rmaker_core.h>
+#include <esp_rmaker_utils.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <ioc_standard_types.h>
+#include <sdkconfig.h>
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+#include <driver/touch_pad.h>
+#endif
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <app_button.h>
+#include <app_powersave.h>
+#include <app_priv.h>
+#include <app_report.h>
+#include <app_tasks.h>
+#include <rgbpixel.h>
+
+#define APP_BUTTON_QUEUE_SIZE 8
+#define APP_BUTTON_DEBOUNCE_US (CONFIG_APP_BUTTON_DEBOUNCE_MS * 1000LL)
+#define APP_BUTTON_CLICK_GAP_US (CONFIG_APP_BUTTON_CLICK_GAP_MS * 1000LL)
+
+#define APP_BUTTON_BOOT_GPIO CONFIG_BOARD_BUTTON_GPIO
+#define APP_BUTTON_BOOT_ACTIVE_LEVEL 0
+#define APP_BUTTON_TOUCH_GPIO CONFIG_TOUCH_BUTTON_GPIO
+#define APP_BUTTON_TOUCH_ACTIVE_LEVEL 1
+
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+#define APP_BUTTON_TOUCH_CHANNEL_OF(gpio) TOUCH_PAD_GPIO##gpio##_CHANNEL
+#define APP_BUTTON_TOUCH_CHANNEL(gpio) APP_BUTTON_TOUCH_CHANNEL_OF(gpio)
+#define APP_BUTTON_TOUCH_PAD_NUM APP_BUTTON_TOUCH_CHANNEL(APP_BUTTON_TOUCH_GPIO)
+#define APP_BUTTON_TOUCH_FILTER_MS 10
+#define APP_BUTTON_TOUCH_POLL_US 20000
+#endif
+
+// Same delays as the app_reset component
+#define APP_BUTTON_RESET_DELAY 2
+#define APP_BUTTON_REBOOT_DELAY 2
+
+typedef enum
+{
+    APP_BUTTON_BOOT,
+    APP_BUTTON_TOUCH,
+    APP_BUTTON_MAX,
+} app_button_id_t;
+
+typedef enum
+{
+    APP_BUTTON_TOGGLE,
+    APP_BUTTON_WIFI_RESET,
+    APP_BUTTON_FACTORY_RESET,
+} app_button_action_t;
+
+typedef enum
+{
+    APP_BUTTON_CHANNEL_LIGHT0, // Bedroom Light
+    APP_BUTTON_CHANNEL_LIGHT3, // Wall Light
+    APP_BUTTON_CHANNEL_RGB,    // RGB segment given by index
+} app_button_channel_t;
+
+/* A binding with clicks runs after that many short presses, one with hold_ms
+ * when the button is released after being held at least that long; of the
+ * long presses the longest hold reached wins.
+ */
+typedef struct
+{
+    app_button_id_t button;
+    uint8_t clicks;
+    uint16_t hold_ms;
+    app_button_action_t action;
+    app_button_channel_t channel;
+    uint8_t index;
+} app_button_binding_t;
+
+static const app_button_binding_t g_app_button_bindings[] = {
+    {.button = APP_BUTTON_BOOT, .clicks = 1, .action = APP_BUTTON_TOGGLE, .channel = APP_BUTTON_CHANNEL_LIGHT0},
+    {.button = APP_BUTTON_BOOT, .hold_ms = 3000, .action = APP_BUTTON_WIFI_RESET},
+    {.button = APP_BUTTON_BOOT, .hold_ms = 10000, .action = APP_BUTTON_FACTORY_RESET},
+    {.button = APP_BUTTON_TOUCH, .clicks = 1, .action = APP_BUTTON_TOGGLE, .channel = APP_BUTTON_CHANNEL_LIGHT0},
+};
+
+#define APP_BUTTON_BINDINGS (sizeof(g_app_button_bindings) / sizeof(g_app_button_bindings[0]))
+
+typedef struct
+{
+    app_button_id_t id;
+    int gpio;
+    int active_level;
+    bool touch;
+    // Debouncer state, shared with the ISR
+    bool isr_pressed;
+    int64_t isr_edge_us;
+    // Gesture state, only used by the button task
+    bool pressed;
+    int64_t press_us;
+    int64_t verify_us;        // Level is checked again once the debounce window is over
+    int64_t poll_us;          // Next filtered read of a touched pad
+    int64_t click_deadline_us;
+    uint8_t clicks;
+    uint16_t hold_indicated_ms;
+    // Derived from the binding table
+    uint8_t max_clicks;
+    uint16_t min_hold_ms;
+    bool acts_on_press;       // A single click is all it does, it runs on the press edge
+} app_button_t;
+
+typedef struct
+{
+    uint8_t button;
+    bool pressed;
+    int64_t time_us;
+} app_button_event_t;
+
+static app_button_t g_app_buttons[APP_BUTTON_MAX] = {
+    [APP_BUTTON_BOOT] = {.id = APP_BUTTON_BOOT, .gpio = APP_BUTTON_BOOT_GPIO, .active_level = APP_BUTTON_BOOT_ACTIVE_LEVEL},
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+    [APP_BUTTON_TOUCH] = {.id = APP_BUTTON_TOUCH, .gpio = APP_BUTTON_TOUCH_GPIO, .touch = true},
+#else
+    [APP_BUTTON_TOUCH] = {.id = APP_BUTTON_TOUCH, .gpio = APP_BUTTON_TOUCH_GPIO, .active_level = APP_BUTTON_TOUCH_ACTIVE_LEVEL},
+#endif
+};
+
+static QueueHandle_t g_app_button_queue;
+static portMUX_TYPE g_app_button_lock = portMUX_INITIALIZER_UNLOCKED;
+static app_button_stats_t g_app_button_stats;
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+static uint16_t g_app_button_touch_release; // Filtered reading above which the pad counts as released
+#endif
+
+static const char *TAG = "app_button";
+
+/* Leading edge debouncing: the first edge that changes the state is taken at
+ * once, edges within the debounce window after it are bounces.
+ */
+static bool IRAM_ATTR app_button_accept(app_button_t *button, bool pressed, int64_t now)
+{
+    bool accepted = false;
+    portENTER_CRITICAL_SAFE(&g_app_button_lock);
+    if (pressed != button->isr_pressed && now - button->isr_edge_us >= APP_BUTTON_DEBOUNCE_US)
+    {
+        button->isr_pressed = pressed;
+        button->isr_edge_us = now;
+        accepted = true;
+    }
+    else if (pressed != button->isr_pressed)
+    {
+        g_app_button_stats.bounces++;
+    }
+    portEXIT_CRITICAL_SAFE(&g_app_button_lock);
+    return accepted;
+}
+
+static void IRAM_ATTR app_button_edge_from_isr(app_button_t *button, bool pressed)
+{
+    int64_t now = esp_timer_get_time();
+    if (!app_button_accept(button, pressed, now))
+        return;
+    app_button_event_t event = {
+        .button = button->id,
+        .pressed = pressed,
+        .time_us = now,
+    };
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(g_app_button_queue, &event, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
+
+#if CONFIG_APP_PM_LIGHT_SLEEP
+/* Only level interrupts wake the chip from light sleep. Each one re-arms for
+ * the opposite level, so together they still see both edges. The GPIO ISR
+ * service is not in IRAM, so this may run from flash.
+ */
+static void app_button_gpio_arm(app_button_t *button, int level)
+{
+    gpio_wakeup_enable(button->gpio, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+}
+#endif
+
+static void IRAM_ATTR app_button_gpio_isr(void *arg)
+{
+    app_button_t *button = arg;
+    int level = gpio_get_level(button->gpio);
+#if CONFIG_APP_PM_LIGHT_SLEEP
+    app_button_gpio_arm(button, level);
+#endif
+    app_button_edge_from_isr(button, level == button->active_level);
+}
+
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+// Only presses come from the interrupt, the release is seen in the filtered readings
+static void IRAM_ATTR app_button_touch_isr(void *arg)
+{
+    uint32_t status = touch_pad_get_status();
+    touch_pad_clear_status();
+    if (status & (1 << APP_BUTTON_TOUCH_PAD_NUM))
+        app_button_edge_from_isr(&g_app_buttons[APP_BUTTON_TOUCH], true);
+}
+#endif
+
+static esp_rmaker_param_t *app_button_power_param(const app_button_binding_t *binding)
+{
+    const esp_rmaker_device_t *device = NULL;
+    switch (binding->channel)
+    {
+    case APP_BUTTON_CHANNEL_LIGHT0:
+        device = bedroom_light;
+        break;
+    case APP_BUTTON_CHANNEL_LIGHT3:
+        device = wall_light;
+        break;
+    case APP_BUTTON_CHANNEL_RGB:
+        device = binding->index < RGBPIXEL_SEGMENTS ? rgb_ring_lights[binding->index] : NULL;
+        break;
+    }
+    return device ? esp_rmaker_device_get_param_by_type(device, IOC_PARAM_POWER) : NULL;
+}
+
+static void app_button_toggle(const app_button_binding_t *binding, int64_t edge_us)
+{
+    bool power;
+    switch (binding->channel)
+    {
+    case APP_BUTTON_CHANNEL_LIGHT0:
+        // Read and switched under the driver lock, the actuator may be switching the same light
+        power = app_driver_toggle_light0_power_state();
+        break;
+    case APP_BUTTON_CHANNEL_LIGHT3:
+        power = app_driver_toggle_light3_power_state();
+        break;
+    case APP_BUTTON_CHANNEL_RGB:
+        power = !rgbpixel_get_power_state(binding->index);
+        rgbpixel_set_power_state(binding->index, power);
+        break;
+    default:
+        return;
+    }
+    uint32_t latency_us = esp_timer_get_time() - edge_us;
+    g_app_button_stats.actions++;
+    g_app_button_stats.latency_us = latency_us;
+    g_app_button_stats.latency_total_us += latency_us;
+    if (latency_us > g_app_button_stats.latency_max_us)
+        g_app_button_stats.latency_max_us = latency_us;
+    ESP_LOGI(TAG, "Channel %d switched %s, %u us after the button edge", binding->channel, power ? "on" : "off", latency_us);
+
+    // The light is already switched, the cloud hears about it with whatever else changes meanwhile
+    app_report_param(app_button_power_param(binding), esp_rmaker_bool(power));
+    app_report_flush_later(CONFIG_APP_BUTTON_REPORT_DELAY_MS);
+}
+
+static void app_button_run(const app_button_t *button, uint8_t clicks, uint32_t held_ms, int64_t edge_us)
+{
+    const app_button_binding_t *found = NULL;
+    for (uint8_t i = 0; i < APP_BUTTON_BINDINGS; i++)
+    {
+        const app_button_binding_t *binding = &g_app_button_bindings[i];
+        if (binding->button != button->id)
+            continue;
+        if (clicks && binding->clicks == clicks)
+        {
+            found = binding;
+            break;
+        }
+        if (!clicks && binding->hold_ms && binding->hold_ms <= held_ms && (!found || binding->hold_ms > found->hold_ms))
+            found = binding;
+    }
+    if (!found)
+    {
+        ESP_LOGD(TAG, "Nothing bound to button %d, %d clicks, held %u ms", button->id, clicks, held_ms);
+        return;
+    }
+    switch (found->action)
+    {
+    case APP_BUTTON_TOGGLE:
+        app_button_toggle(found, edge_us);
+        break;
+    case APP_BUTTON_WIFI_RESET:
+        esp_rmaker_wifi_reset(APP_BUTTON_RESET_DELAY, APP_BUTTON_REBOOT_DELAY);
+        break;
+    case APP_BUTTON_FACTORY_RESET:
+        esp_rmaker_factory_reset(APP_BUTTON_RESET_DELAY, APP_BUTTON_REBOOT_DELAY);
+        break;
+    }
+}
+
+static void app_button_edge(app_button_t *button, bool pressed, int64_t time_us)
+{
+    if (pressed == button->pressed)
+        return;
+    button->pressed = pressed;
+    if (!button->touch)
+        button->verify_us = time_us + APP_BUTTON_DEBOUNCE_US;
+    if (pressed)
+    {
+        g_app_button_stats.presses++;
+        button->press_us = time_us;
+        app_powersave_activity(APP_POWERSAVE_BUTTON);
+        button->hold_indicated_ms = 0;
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+        if (button->touch)
+            button->poll_us = time_us + APP_BUTTON_TOUCH_POLL_US;
+#endif
+        if (button->acts_on_press)
+            app_button_run(button, 1, 0, time_us);
+        return;
+    }
+
+    uint32_t held_ms = (time_us - button->press_us) / 1000;
+    if (button->min_hold_ms && held_ms >= button->min_hold_ms)
+    {
+        button->clicks = 0;
+        app_button_run(button, 0, held_ms, time_us);
+        return;
+    }
+    if (button->acts_on_press)
+        return;
+    // Wait for more clicks only when a multi-click is bound
+    if (++button->clicks >= button->max_clicks)
+    {
+        app_button_run(button, button->clicks, 0, time_us);
+        button->clicks = 0;
+    }
+    else
+    {
+        button->click_deadline_us = time_us + APP_BUTTON_CLICK_GAP_US;
+    }
+}
+
+// Level changes the ISR could not see: a release inside the debounce window or a lifted finger
+static void app_button_sample(app_button_t *button, int64_t now)
+{
+    bool pressed = button->pressed;
+    if (button->verify_us && now >= button->verify_us)
+    {
+        button->verify_us = 0;
+        pressed = gpio_get_level(button->gpio) == button->active_level;
+    }
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+    if (button->touch && button->pressed && now >= button->poll_us)
+    {
+        uint16_t value = 0;
+        touch_pad_read_filtered(APP_BUTTON_TOUCH_PAD_NUM, &value);
+        pressed = value <= g_app_button_touch_release;
+        button->poll_us = now + APP_BUTTON_TOUCH_POLL_US;
+    }
+#endif
+    if (pressed != button->pressed && app_button_accept(button, pressed, now))
+        app_button_edge(button, pressed, now);
+}
+
+static void app_button_tick(app_button_t *button, int64_t now)
+{
+    app_button_sample(button, now);
+    if (button->pressed)
+    {
+        uint32_t held_ms = (now - button->press_us) / 1000;
+        for (uint8_t i = 0; i < APP_BUTTON_BINDINGS; i++)
+        {
+            const app_button_binding_t *binding = &g_app_button_bindings[i];
+            if (binding->button == button->id && binding->hold_ms > button->hold_indicated_ms && binding->hold_ms <= held_ms)
+            {
+                button->hold_indicated_ms = binding->hold_ms;
+                ESP_LOGI(TAG, "Release button %d now for action %d", button->id, binding->action);
+            }
+        }
+    }
+    else if (button->clicks && now >= button->click_deadline_us)
+    {
+        app_button_run(button, button->clicks, 0, button->click_deadline_us - APP_BUTTON_CLICK_GAP_US);
+        button->clicks = 0;
+    }
+}
+
+static int64_t app_button_next_deadline(const app_button_t *button, int64_t now)
+{
+    int64_t deadline = INT64_MAX;
+    if (button->verify_us)
+        deadline = button->verify_us;
+    if (button->touch && button->pressed && button->poll_us < deadline)
+        deadline = button->poll_us;
+    if (!button->pressed && button->clicks && button->click_deadline_us < deadline)
+        deadline = button->click_deadline_us;
+    if (button->pressed)
+    {
+        // Next long press to announce
+        for (uint8_t i = 0; i < APP_BUTTON_BINDINGS; i++)
+        {
+            const app_button_binding_t *binding = &g_app_button_bindings[i];
+            int64_t hold_us = button->press_us + binding->hold_ms * 1000LL;
+            if (binding->button == button->id && binding->hold_ms > button->hold_indicated_ms && hold_us < deadline)
+                deadline = hold_us;
+        }
+    }
+    return deadline;
+}
+
+_Noreturn static void app_button_task(void *priv)
+{
+    for (;;)
+    {
+        int64_t now = esp_timer_get_time();
+        int64_t deadline = INT64_MAX;
+        for (uint8_t i = 0; i < APP_BUTTON_MAX; i++)
+        {
+            int64_t button_deadline = app_button_next_deadline(&g_app_buttons[i], now);
+            if (button_deadline < deadline)
+                deadline = button_deadline;
+        }
+        TickType_t wait = portMAX_DELAY;
+        if (deadline != INT64_MAX)
+            wait = deadline > now ? (deadline - now + 999) / 1000 / portTICK_PERIOD_MS + 1 : 0;
+
+        app_button_event_t event;
+        if (xQueueReceive(g_app_button_queue, &event, wait) == pdTRUE)
+            app_button_edge(&g_app_buttons[event.button], event.pressed, event.time_us);
+        now = esp_timer_get_time();
+        for (uint8_t i = 0; i < APP_BUTTON_MAX; i++)
+        {
+            app_button_tick(&g_app_buttons[i], now);
+        }
+    }
+}
+
+static void app_button_prepare(app_button_t *button)
+{
+    for (uint8_t i = 0; i < APP_BUTTON_BINDINGS; i++)
+    {
+        const app_button_binding_t *binding = &g_app_button_bindings[i];
+        if (binding->button != button->id)
+            continue;
+        if (binding->clicks > button->max_clicks)
+            button->max_clicks = binding->clicks;
+        if (binding->hold_ms && (!button->min_hold_ms || binding->hold_ms < button->min_hold_ms))
+            button->min_hold_ms = binding->hold_ms;
+    }
+    button->acts_on_press = button->max_clicks == 1 && !button->min_hold_ms;
+    // Start from the debounce window already over
+    button->isr_edge_us = -APP_BUTTON_DEBOUNCE_US;
+}
+
+static esp_err_t app_button_gpio_init(app_button_t *button)
+{
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << button->gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = button->active_level == 0,
+        .pull_down_en = button->active_level == 1,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    esp_err_t err = gpio_config(&io_conf);
+    if (err != ESP_OK)
+        return err;
+    int level = gpio_get_level(button->gpio);
+    button->isr_pressed = button->pressed = level == button->active_level;
+#if CONFIG_APP_PM_LIGHT_SLEEP
+    app_button_gpio_arm(button, level);
+    esp_sleep_enable_gpio_wakeup();
+#endif
+    return gpio_isr_handler_add(button->gpio, app_button_gpio_isr, button);
+}
+
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+static esp_err_t app_button_touch_init(void)
+{
+    ESP_ERROR_CHECK(touch_pad_init());
+    touch_pad_set_fsm_mode(TOUCH_FSM_MODE_TIMER);
+    touch_pad_set_voltage(TOUCH_HVOLT_2V7, TOUCH_LVOLT_0V5, TOUCH_HVOLT_ATTEN_1V);
+    touch_pad_config(APP_BUTTON_TOUCH_PAD_NUM, 0);
+    touch_pad_filter_start(APP_BUTTON_TOUCH_FILTER_MS);
+    // Let the filter settle on the untouched pad before taking the baseline
+    vTaskDelay(pdMS_TO_TICKS(APP_BUTTON_TOUCH_FILTER_MS * 8));
+    uint16_t baseline = 0;
+    esp_err_t err = touch_pad_read_filtered(APP_BUTTON_TOUCH_PAD_NUM, &baseline);
+    if (err != ESP_OK || !baseline)
+    {
+        ESP_LOGE(TAG, "Could not read touch pad %d", APP_BUTTON_TOUCH_PAD_NUM);
+        return err != ESP_OK ? err : ESP_FAIL;
+    }
+    // A touch lowers the reading; release is halfway back to the baseline
+    uint16_t threshold = baseline * CONFIG_APP_BUTTON_TOUCH_THRESHOLD / 100;
+    g_app_button_touch_release = threshold + (baseline - threshold) / 2;
+    touch_pad_set_thresh(APP_BUTTON_TOUCH_PAD_NUM, threshold);
+    ESP_LOGI(TAG, "Touch pad %d baseline %u, threshold %u", APP_BUTTON_TOUCH_PAD_NUM, baseline, threshold);
+    touch_pad_isr_register(app_button_touch_isr, NULL);
+#if CONFIG_APP_PM_LIGHT_SLEEP
+    esp_sleep_enable_touchpad_wakeup();
+#endif
+    return touch_pad_intr_enable();
+}
+#endif
+
+void app_button_get_stats(app_button_stats_t *stats)
+{
+    portENTER_CRITICAL(&g_app_button_lock);
+    *stats = g_app_button_stats;
+    portEXIT_CRITICAL(&g_app_button_lock);
+}
+
+esp_err_t app_button_init(void)
+{
+    g_app_button_queue = xQueueCreate(APP_BUTTON_QUEUE_SIZE, sizeof(app_button_event_t));
+    if (!g_app_button_queue)
+        return ESP_ERR_NO_MEM;
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "Could not install GPIO ISR service");
+        return err;
+    }
+    for (uint8_t i = 0; i < APP_BUTTON_MAX; i++)
+    {
+        app_button_t *button = &g_app_buttons[i];
+        app_button_prepare(button);
+#if CONFIG_APP_BUTTON_TOUCH_PAD
+        err = button->touch ? app_button_touch_init() : app_button_gpio_init(button);
+#else
+        err = app_button_gpio_init(button);
+#endif
+        if (err != ESP_OK)
+            ESP_LOGE(TAG, "Could not set up button %d on GPIO %d", i, button->gpio);
+    }
+
+    return app_task_create(APP_TASK_BUTTON, app_button_task, NULL, NULL);
+}
\ No newline at end of file
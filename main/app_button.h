@@ -0,0 +1,51 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+/* Physical buttons: the BOOT button and the touch button. Edges are captured
+ * in an interrupt and debounced there, gestures (clicks, multi-clicks, long
+ * presses) are decoded by the button task and mapped to actions through the
+ * binding table in app_button.c. Lights are switched from the button task
+ * straight away; their new state is reported to the cloud later, coalesced
+ * with anything else changed in the meantime.
+ */
+typedef struct
+{
+    uint32_t presses;          // Debounced presses of all buttons
+    uint32_t bounces;          // Edges rejected by the debouncer
+    uint32_t actions;          // Gestures that ran an action
+    uint32_t latency_us;       // Edge that completed the gesture to the light switching, last action
+    uint32_t latency_max_us;
+    uint64_t latency_total_us; // Divide by actions for the mean
+} app_button_stats_t;
+
+esp_err_t app_button_init(void);
+void app_button_get_stats(app_button_stats_t *stats);
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_log.h>
+
+#include <app_device.h>
+
+static const char *TAG = "app_device";
+
+esp_err_t app_device_bind_param(app_device_ctx_t *ctx, const esp_rmaker_param_t *param, app_param_handler_t handler)
+{
+    if (!param || !handler)
+    {
+        ESP_LOGE(TAG, "Could not bind param handler, no param or handler");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ctx->count >= APP_DEVICE_MAX_PARAMS)
+    {
+        ESP_LOGE(TAG, "Could not bind param handler, the device has %d already", APP_DEVICE_MAX_PARAMS);
+        return ESP_ERR_NO_MEM;
+    }
+    ctx->params[ctx->count].param = param;
+    ctx->params[ctx->count].handler = handler;
+    ctx->count++;
+    return ESP_OK;
+}
+
+esp_err_t app_device_add_param(app_device_ctx_t *ctx, esp_rmaker_device_t *device, esp_rmaker_param_t *param,
+                               app_param_handler_t handler)
+{
+    esp_err_t err = esp_rmaker_device_add_param(device, param);
+    if (err != ESP_OK)
+        return err;
+    return app_device_bind_param(ctx, param, handler);
+}
\ No newline at end of file
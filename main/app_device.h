@@ -0,0 +1,73 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_rmaker_core.h>
+
+/* Every param that accepts writes is bound to its handler when it is
+ * registered. The device context is the private data of the device callback,
+ * so a write is resolved by comparing param pointers, without string work.
+ */
+typedef struct app_device_ctx app_device_ctx_t;
+typedef esp_err_t (*app_param_handler_t)(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace);
+
+typedef struct
+{
+    const esp_rmaker_param_t *param;
+    app_param_handler_t handler;
+} app_param_binding_t;
+
+#define APP_DEVICE_MAX_PARAMS 6
+
+struct app_device_ctx
+{
+    uint8_t index; // Segment of the RGB strip
+    bool actuated; // Writes are applied, and their reports flushed, by the actuator task
+    uint8_t count;
+    app_param_binding_t params[APP_DEVICE_MAX_PARAMS];
+};
+
+// Writes of the param go to the handler, fails once the device has APP_DEVICE_MAX_PARAMS bindings
+esp_err_t app_device_bind_param(app_device_ctx_t *ctx, const esp_rmaker_param_t *param, app_param_handler_t handler);
+// Add the param to the RainMaker device and bind it
+esp_err_t app_device_add_param(app_device_ctx_t *ctx, esp_rmaker_device_t *device, esp_rmaker_param_t *param,
+                               app_param_handler_t handler);
+
+// Handler bound to the param, NULL when the device takes no writes for it
+static inline app_param_handler_t app_device_find_handler(const app_device_ctx_t *ctx, const esp_rmaker_param_t *param)
+{
+    for (uint8_t i = 0; ctx && i < ctx->count; i++)
+    {
+        if (ctx->params[i].param == param)
+            return ctx->params[i].handler;
+    }
+    return NULL;
+}
\ No newline at end of file
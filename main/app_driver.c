@@ -30,14 +30,17 @@
 #include <ioc_standard_types.h>
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <freertos/timers.h>
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <app_button.h>
+#include <app_pm.h>
 #include <app_priv.h>
-#include <app_reset.h>
-#include <iot_button.h>
+#include <app_report.h>
+#include <app_tasks.h>
 
 #include <bh1750.h>
 #include <sht3x.h>
@@ -49,14 +52,9 @@
 #define ADDR_SHT31 SHT3X_I2C_ADDR_GND
 #define DEFAULT_REPORTING_PERIOD_BH1750 60 // Reporting period in seconds for BH1750 luminosity sensor
 #define DEFAULT_REPORTING_PERIOD_SHT31 305 // Reporting period in seconds for SHT31 temperature and humidity sensor
-
-/* This is the button that is used for toggling the power */
-#define BUTTON_GPIO CONFIG_BOARD_BUTTON_GPIO
-#define BUTTON_ACTIVE_LEVEL 0
-#define TOUCH_BUTTON_GPIO CONFIG_TOUCH_BUTTON_GPIO
-#define TOUCH_BUTTON_ACTIVE_LEVEL 1
-#define WIFI_RESET_BUTTON_TIMEOUT 3
-#define FACTORY_RESET_BUTTON_TIMEOUT 10
+// Sensor task notification bits, also the IDs of the timers that set them
+#define SENSOR_UPDATE_BH1750 (1 << 0)
+#define SENSOR_UPDATE_SHT31 (1 << 1)
 
 #define RELAY_O_GPIO CONFIG_RELAY_0_OUTPUT_GPIO
 #define RELAY_1_GPIO CONFIG_RELAY_1_OUTPUT_GPIO
@@ -69,11 +67,14 @@
 static bool g_light0_power_state = DEFAULT_LIGHT0_POWER_STATE;
 static bool g_light3_power_state = DEFAULT_LIGHT3_POWER_STATE;
 static uint16_t g_light0_value = DEFAULT_LIGHT0_BRIGHTNESS;
+// The button and actuator tasks both switch the lights, a state and its relays change together under this lock
+static portMUX_TYPE g_light_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static i2c_dev_t dev17;
 static sht3x_t dev31;
 static TimerHandle_t bh1750_sensor_timer;
 static TimerHandle_t sht31_sensor_timer;
+static TaskHandle_t sensor_task;
 static uint16_t g_sensor_luminosity = 0;
 static float g_sensor_temperature = 0;
 static float g_sensor_humidity = 0;
@@ -89,7 +90,10 @@ float roundfp(float value, uint8_t precision)
 static void app_driver_sensor_get_bh1750_data()
 {
     uint16_t lux;
-    if (bh1750_read(&dev17, &lux) != ESP_OK)
+    app_pm_acquire(APP_PM_LOCK_SENSORS);
+    esp_err_t err = bh1750_read(&dev17, &lux);
+    app_pm_release(APP_PM_LOCK_SENSORS);
+    if (err != ESP_OK)
         ESP_LOGE(TAG, "BH1750 error, could not read sensor data");
     g_sensor_luminosity = lux;
 }
@@ -98,29 +102,58 @@ static void app_driver_sensor_get_sht31_data()
 {
     float temp;
     float humid;
-    if (sht3x_measure(&dev31, &temp, &humid) != ESP_OK)
+    // Single shot, the chip may sleep while the sensor converts
+    app_pm_acquire(APP_PM_LOCK_SENSORS);
+    esp_err_t err = sht3x_start_measurement(&dev31, SHT3X_SINGLE_SHOT, SHT3X_HIGH);
+    app_pm_release(APP_PM_LOCK_SENSORS);
+    if (err == ESP_OK)
+    {
+        vTaskDelay(sht3x_get_measurement_duration(SHT3X_HIGH));
+        app_pm_acquire(APP_PM_LOCK_SENSORS);
+        err = sht3x_get_results(&dev31, &temp, &humid);
+        app_pm_release(APP_PM_LOCK_SENSORS);
+    }
+    if (err != ESP_OK)
         ESP_LOGE(TAG, "SHT3x error, could not read sensor data");
     g_sensor_temperature = roundfp(temp, 1);
     g_sensor_humidity = roundfp(humid, 1);
 }
 
-static void app_driver_sensor_bh1750_update(void *pvParameters)
+static void app_driver_sensor_bh1750_update(void)
 {
     app_driver_sensor_get_bh1750_data();
-    esp_rmaker_param_update_and_report(
-        esp_rmaker_device_get_param_by_type(luminosity_sensor, IOC_PARAM_LUMINOSITY),
-        esp_rmaker_int(g_sensor_luminosity));
+    app_report_param(esp_rmaker_device_get_param_by_type(luminosity_sensor, IOC_PARAM_LUMINOSITY),
+                     esp_rmaker_int(g_sensor_luminosity));
+    app_report_flush();
 }
 
-static void app_driver_sensor_sht31_update(void *pvParameters)
-{  
+static void app_driver_sensor_sht31_update(void)
+{
     app_driver_sensor_get_sht31_data();
-    esp_rmaker_param_update_and_report(
-        esp_rmaker_device_get_param_by_type(temperature_sensor, IOC_PARAM_TEMPERATURE),
-        esp_rmaker_float(g_sensor_temperature));
-    esp_rmaker_param_update_and_report(
-        esp_rmaker_device_get_param_by_type(humidity_sensor, IOC_PARAM_HUMIDITY),
-        esp_rmaker_float(g_sensor_humidity));
+    app_report_param(esp_rmaker_device_get_param_by_type(temperature_sensor, IOC_PARAM_TEMPERATURE),
+                     esp_rmaker_float(g_sensor_temperature));
+    app_report_param(esp_rmaker_device_get_param_by_type(humidity_sensor, IOC_PARAM_HUMIDITY),
+                     esp_rmaker_float(g_sensor_humidity));
+    app_report_flush();
+}
+
+// Runs in the timer daemon, the I2C transfers are left to the sensor task
+static void app_driver_sensor_timer_cb(TimerHandle_t timer)
+{
+    xTaskNotify(sensor_task, (uint32_t)(uintptr_t)pvTimerGetTimerID(timer), eSetBits);
+}
+
+_Noreturn static void app_driver_sensor_task(void *priv)
+{
+    while (true)
+    {
+        uint32_t updates = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &updates, portMAX_DELAY);
+        if (updates & SENSOR_UPDATE_BH1750)
+            app_driver_sensor_bh1750_update();
+        if (updates & SENSOR_UPDATE_SHT31)
+            app_driver_sensor_sht31_update();
+    }
 }
 
 uint16_t app_driver_sensor_get_current_luminosity()
@@ -145,12 +178,13 @@ esp_err_t app_driver_sensor_init(void)
     memset(&dev31, 0, sizeof(sht3x_t));
     ESP_ERROR_CHECK(bh1750_init_desc(&dev17, ADDR_BH1750, 0, I2C_SDA_GPIO, I2C_SCL_GPIO));
     ESP_ERROR_CHECK(sht3x_init_desc(&dev31, 0, ADDR_SHT31, I2C_SDA_GPIO, I2C_SCL_GPIO));
+    ESP_ERROR_CHECK(app_task_create(APP_TASK_SENSORS, app_driver_sensor_task, NULL, &sensor_task));
 	
     esp_err_t err = bh1750_setup(&dev17, BH1750_MODE_CONTINUOUS, BH1750_RES_HIGH);
 	if (err == ESP_OK)
 	{
 		bh1750_sensor_timer = xTimerCreate("app_driver_sensor_bh1750_update_tm", (DEFAULT_REPORTING_PERIOD_BH1750 * 1000) / portTICK_PERIOD_MS,
-                            pdTRUE, NULL, app_driver_sensor_bh1750_update);
+                            pdTRUE, (void *)SENSOR_UPDATE_BH1750, app_driver_sensor_timer_cb);
 		if (bh1750_sensor_timer) {
 			xTimerStart(bh1750_sensor_timer, 0);
 		}
@@ -165,7 +199,7 @@ esp_err_t app_driver_sensor_init(void)
 	if (err == ESP_OK)
 	{
 		sht31_sensor_timer = xTimerCreate("app_driver_sensor_sht31_update_tm", (DEFAULT_REPORTING_PERIOD_SHT31 * 1000) / portTICK_PERIOD_MS,
-                            pdTRUE, NULL, app_driver_sensor_sht31_update);
+                            pdTRUE, (void *)SENSOR_UPDATE_SHT31, app_driver_sensor_timer_cb);
 		if (sht31_sensor_timer) {
 			xTimerStart(sht31_sensor_timer, 0);
 		}
@@ -179,26 +213,6 @@ esp_err_t app_driver_sensor_init(void)
     return ESP_OK;
 }
 
-static void push_btn_cb(void *arg)
-{
-    ESP_LOGI(TAG, "Change state of Bedroom Light and sync it with cloud");
-    bool new_light0_state = !g_light0_power_state;
-    app_driver_set_light0_power_state(new_light0_state);
-    esp_rmaker_param_update_and_report(
-        esp_rmaker_device_get_param_by_type(bedroom_light, IOC_PARAM_POWER),
-        esp_rmaker_bool(new_light0_state));
-}
-
-static void push_btn_cb2(void *arg)
-{
-    ESP_LOGI(TAG, "Change state of Bedroom Light and sync it with cloud");
-    bool new_light0_state = !g_light0_power_state;
-    app_driver_set_light0_power_state(new_light0_state);
-    esp_rmaker_param_update_and_report(
-        esp_rmaker_device_get_param_by_type(bedroom_light, IOC_PARAM_POWER),
-        esp_rmaker_bool(new_light0_state));
-}
-
 static void set_light0_power_state(bool target)
 {
     gpio_set_level(RELAY_O_GPIO, target);
@@ -218,22 +232,6 @@ static void set_light3_power_state(bool target)
 
 void app_driver_init()
 {
-    button_handle_t btn_handle = iot_button_create(BUTTON_GPIO, BUTTON_ACTIVE_LEVEL);
-    if (btn_handle)
-    {
-        /* Register a callback for a button tap (short press) event */
-        iot_button_set_evt_cb(btn_handle, BUTTON_CB_TAP, push_btn_cb, NULL);
-        /* Register Wi-Fi reset and factory reset functionality on same button */
-        app_reset_button_register(btn_handle, WIFI_RESET_BUTTON_TIMEOUT, FACTORY_RESET_BUTTON_TIMEOUT);
-    }
-	
-	button_handle_t touch_btn_handle = iot_button_create(TOUCH_BUTTON_GPIO, TOUCH_BUTTON_ACTIVE_LEVEL);
-    if (touch_btn_handle)
-    {
-        /* Register a callback for a button tap (short press) event */
-        iot_button_set_evt_cb(touch_btn_handle, BUTTON_CB_TAP, push_btn_cb2, NULL);
-    }
-
     /* Configure the GPIO */
     gpio_config_t io_conf = {
         .mode = GPIO_MODE_OUTPUT,
@@ -242,10 +240,12 @@ void app_driver_init()
     uint64_t pin_mask = (((uint64_t)1 << RELAY_O_GPIO) | ((uint64_t)1 << RELAY_1_GPIO) | ((uint64_t)1 << RELAY_2_GPIO) | ((uint64_t)1 << RELAY_3_GPIO));
     io_conf.pin_bit_mask = pin_mask;
     gpio_config(&io_conf);
-    app_driver_sensor_init();
+    // Buttons switch the relays directly, see app_button.c for the gesture table
+    app_button_init();
 }
 
-int IRAM_ATTR app_driver_set_light0()
+// Drive the three dimmer relays from the light0 state, called with g_light_lock held
+static void IRAM_ATTR app_driver_set_light0_locked(void)
 {
     if (g_light0_power_state)
     {
@@ -286,34 +286,70 @@ int IRAM_ATTR app_driver_set_light0()
         set_light1_power_state(0);
         set_light2_power_state(0);
     }
-    return ESP_OK;
 }
 
 esp_err_t app_driver_set_light0_power_state(bool power)
 {
+    portENTER_CRITICAL(&g_light_lock);
     g_light0_power_state = power;
-    app_driver_set_light0();
+    app_driver_set_light0_locked();
+    portEXIT_CRITICAL(&g_light_lock);
     return ESP_OK;
 }
 
+bool app_driver_toggle_light0_power_state(void)
+{
+    portENTER_CRITICAL(&g_light_lock);
+    bool power = !g_light0_power_state;
+    g_light0_power_state = power;
+    app_driver_set_light0_locked();
+    portEXIT_CRITICAL(&g_light_lock);
+    return power;
+}
+
 int IRAM_ATTR app_driver_set_light3_power_state(bool state)
 {
+    portENTER_CRITICAL(&g_light_lock);
     if (g_light3_power_state != state)
     {
         g_light3_power_state = state;
         set_light3_power_state(g_light3_power_state);
     }
+    portEXIT_CRITICAL(&g_light_lock);
+    return ESP_OK;
+}
+
+bool app_driver_toggle_light3_power_state(void)
+{
+    portENTER_CRITICAL(&g_light_lock);
+    bool power = !g_light3_power_state;
+    g_light3_power_state = power;
+    set_light3_power_state(power);
+    portEXIT_CRITICAL(&g_light_lock);
+    return power;
+}
+
+// Power and brightness in one relay update
+esp_err_t app_driver_set_light0_state(bool power, uint16_t brightness)
+{
+    portENTER_CRITICAL(&g_light_lock);
+    g_light0_power_state = power;
+    g_light0_value = brightness;
+    app_driver_set_light0_locked();
+    portEXIT_CRITICAL(&g_light_lock);
     return ESP_OK;
 }
 
 esp_err_t app_driver_set_light0_brightness(uint16_t brightness)
 {
+    portENTER_CRITICAL(&g_light_lock);
     g_light0_value = brightness;
     g_light0_power_state = 1;
-    esp_rmaker_param_update_and_report(
-        esp_rmaker_device_get_param_by_type(bedroom_light, IOC_PARAM_POWER),
-        esp_rmaker_bool(g_light0_power_state));
-    return app_driver_set_light0();
+    app_driver_set_light0_locked();
+    portEXIT_CRITICAL(&g_light_lock);
+    // Staged only, the actuator flushes it with the brightness echo
+    app_report_param(esp_rmaker_device_get_param_by_type(bedroom_light, IOC_PARAM_POWER), esp_rmaker_bool(true));
+    return ESP_OK;
 }
 
 bool app_driver_get_light0_power_state(void)
@@ -0,0 +1,260 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_attr.h>
+#include <esp_log.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <app_log.h>
+#include <app_tasks.h>
+
+#define APP_LOG_RING_SIZE CONFIG_APP_LOG_RING_SIZE
+#define APP_LOG_LINE_MAX 160
+#define APP_LOG_WINDOW_MS 1000
+
+_Static_assert((APP_LOG_RING_SIZE & (APP_LOG_RING_SIZE - 1)) == 0, "Log ring size must be a power of two");
+
+/* Same scheme as the trace ring: a writer claims a position with one atomic
+ * add, clears the sequence while it fills the record and sets it to
+ * position + 1 when done. The task keeps a record only when the sequence is
+ * the one it expects before and after copying it. When the ring is full the
+ * oldest records are overwritten and counted as lost.
+ */
+typedef struct
+{
+    atomic_uint sequence;
+    uint32_t time_ms;
+    const app_log_site_t *site;
+    uint32_t suppressed;
+    uint8_t count;
+    uint32_t args[APP_LOG_MAX_ARGS];
+} app_log_record_t;
+
+static const char *const g_app_log_module_names[APP_LOG_MODULE_MAX] = {
+    [APP_LOG_MAIN] = "app_main",
+    [APP_LOG_EVENT] = "app_main_EVENT",
+    [APP_LOG_ACTUATOR] = "app_actuator",
+    [APP_LOG_RGBPIXEL] = "rgbpixel",
+};
+
+static uint8_t g_app_log_levels[APP_LOG_MODULE_MAX] = {
+    [APP_LOG_MAIN] = CONFIG_LOG_DEFAULT_LEVEL,
+    [APP_LOG_EVENT] = CONFIG_LOG_DEFAULT_LEVEL,
+    [APP_LOG_ACTUATOR] = CONFIG_LOG_DEFAULT_LEVEL,
+    [APP_LOG_RGBPIXEL] = CONFIG_LOG_DEFAULT_LEVEL,
+};
+
+#if CONFIG_APP_LOG_DEFERRED
+static app_log_record_t g_app_log_ring[APP_LOG_RING_SIZE];
+static atomic_uint g_app_log_head;
+static atomic_uint g_app_log_tail; // Next record the task prints
+static TaskHandle_t g_app_log_task;
+#endif
+static atomic_uint g_app_log_written;
+static atomic_uint g_app_log_lost;
+static atomic_uint g_app_log_suppressed;
+
+static const char *TAG = "app_log";
+
+const char *app_log_module_name(app_log_module_t module)
+{
+    return module < APP_LOG_MODULE_MAX ? g_app_log_module_names[module] : "?";
+}
+
+void app_log_set_level(app_log_module_t module, esp_log_level_t level)
+{
+    if (module < APP_LOG_MODULE_MAX)
+        g_app_log_levels[module] = level;
+}
+
+esp_err_t app_log_set_level_by_name(const char *module, esp_log_level_t level)
+{
+    for (uint8_t i = 0; i < APP_LOG_MODULE_MAX; i++)
+    {
+        if (strcmp(module, g_app_log_module_names[i]) == 0)
+        {
+            g_app_log_levels[i] = level;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* Level and rate limit of a call site. The window and counters are plain
+ * fields, a site hit from two tasks at once may be off by a record.
+ */
+bool app_log_admit(app_log_site_t *site)
+{
+    if (site->level > g_app_log_levels[site->module])
+        return false;
+    if (CONFIG_APP_LOG_RATE_LIMIT == 0)
+    {
+#if !CONFIG_APP_LOG_DEFERRED
+        atomic_fetch_add_explicit(&g_app_log_written, 1, memory_order_relaxed);
+#endif
+        return true;
+    }
+    uint32_t now_ms = esp_log_timestamp();
+    if (now_ms - site->window_ms >= APP_LOG_WINDOW_MS)
+    {
+        site->window_ms = now_ms;
+        site->count = 0;
+    }
+    if (site->count >= CONFIG_APP_LOG_RATE_LIMIT)
+    {
+        site->suppressed++;
+        atomic_fetch_add_explicit(&g_app_log_suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+    site->count++;
+#if !CONFIG_APP_LOG_DEFERRED
+    atomic_fetch_add_explicit(&g_app_log_written, 1, memory_order_relaxed);
+#endif
+    return true;
+}
+
+#if CONFIG_APP_LOG_DEFERRED
+void app_log_write(app_log_site_t *site, uint8_t count, const uint32_t *args)
+{
+    unsigned int position = atomic_fetch_add_explicit(&g_app_log_head, 1, memory_order_relaxed);
+    app_log_record_t *record = &g_app_log_ring[position & (APP_LOG_RING_SIZE - 1)];
+    atomic_store_explicit(&record->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record->time_ms = esp_log_timestamp();
+    record->site = site;
+    record->suppressed = site->suppressed;
+    site->suppressed = 0;
+    record->count = count < APP_LOG_MAX_ARGS ? count : APP_LOG_MAX_ARGS;
+    memcpy(record->args, args, record->count * sizeof(uint32_t));
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+    atomic_fetch_add_explicit(&g_app_log_written, 1, memory_order_relaxed);
+
+    // Only a write into an empty ring has to wake the task, it drains everything else
+    if (!g_app_log_task || position != atomic_load_explicit(&g_app_log_tail, memory_order_relaxed))
+        return;
+    if (xPortInIsrContext())
+        vTaskNotifyGiveFromISR(g_app_log_task, NULL);
+    else
+        xTaskNotifyGive(g_app_log_task);
+}
+
+static void app_log_print(const app_log_record_t *record)
+{
+    static const char letters[] = "NEWIDV";
+    static const char *const colors[] = {"", LOG_COLOR_E, LOG_COLOR_W, LOG_COLOR_I, LOG_COLOR_D, LOG_COLOR_V};
+    const app_log_site_t *site = record->site;
+    const uint32_t *a = record->args;
+    const char *tag = app_log_module_name(site->module);
+    uint8_t level = site->level <= ESP_LOG_VERBOSE ? site->level : ESP_LOG_VERBOSE;
+    const char *reset = level >= ESP_LOG_DEBUG ? "" : LOG_RESET_COLOR;
+    char message[APP_LOG_LINE_MAX];
+
+    // Words the format does not use are ignored
+    snprintf(message, sizeof(message), site->format, a[0], a[1], a[2], a[3], a[4], a[5]);
+    if (record->suppressed)
+    {
+        esp_log_write(level, tag, "%s%c (%u) %s: %s (%u more suppressed)%s\n", colors[level], letters[level],
+                      record->time_ms, tag, message, record->suppressed, reset);
+    }
+    else
+    {
+        esp_log_write(level, tag, "%s%c (%u) %s: %s%s\n", colors[level], letters[level], record->time_ms, tag,
+                      message, reset);
+    }
+}
+
+_Noreturn static void app_log_task(void *arg)
+{
+    unsigned int tail = 0;
+    for (;;)
+    {
+        unsigned int head = atomic_load_explicit(&g_app_log_head, memory_order_acquire);
+        if (tail == head)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        if (head - tail > APP_LOG_RING_SIZE)
+        {
+            atomic_fetch_add_explicit(&g_app_log_lost, head - APP_LOG_RING_SIZE - tail, memory_order_relaxed);
+            ESP_LOGW(TAG, "%u records lost", head - APP_LOG_RING_SIZE - tail);
+            tail = head - APP_LOG_RING_SIZE;
+        }
+
+        app_log_record_t *slot = &g_app_log_ring[tail & (APP_LOG_RING_SIZE - 1)];
+        app_log_record_t record = {0};
+        uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        record.time_ms = slot->time_ms;
+        record.site = slot->site;
+        record.suppressed = slot->suppressed;
+        record.count = slot->count;
+        memcpy(record.args, slot->args, sizeof(record.args));
+        atomic_thread_fence(memory_order_acquire);
+        bool stable = atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence;
+
+        if (stable && sequence == tail + 1)
+        {
+            app_log_print(&record);
+        }
+        else if (sequence != 0 && (int)(sequence - (tail + 1)) > 0)
+        {
+            // A writer a lap ahead took the slot
+            atomic_fetch_add_explicit(&g_app_log_lost, 1, memory_order_relaxed);
+        }
+        else
+        {
+            // Claimed but not written yet
+            vTaskDelay(1);
+            continue;
+        }
+        tail++;
+        atomic_store_explicit(&g_app_log_tail, tail, memory_order_relaxed);
+    }
+}
+#endif
+
+void app_log_get_stats(app_log_stats_t *stats)
+{
+    stats->written = atomic_load_explicit(&g_app_log_written, memory_order_relaxed);
+    stats->lost = atomic_load_explicit(&g_app_log_lost, memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&g_app_log_suppressed, memory_order_relaxed);
+}
+
+esp_err_t app_log_init(void)
+{
+#if CONFIG_APP_LOG_DEFERRED
+    return app_task_create(APP_TASK_LOG, app_log_task, NULL, &g_app_log_task);
+#else
+    return ESP_OK;
+#endif
+}
\ No newline at end of file
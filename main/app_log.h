@@ -0,0 +1,115 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <sdkconfig.h>
+
+/* Deferred logging for hot paths. A call site records a pointer to its
+ * static descriptor and up to APP_LOG_MAX_ARGS raw 32-bit arguments into a
+ * lock-free ring, and the app_log task formats and prints them later at low
+ * priority. Arguments are copied as words: integers, pointers and strings
+ * that outlive the call (literals, RainMaker device and param names) only,
+ * no floats or 64-bit values.
+ *
+ * Every call site is limited to CONFIG_APP_LOG_RATE_LIMIT records per
+ * second, the number left out is printed with the next record that gets
+ * through. Each module has a verbosity that can be changed at runtime.
+ */
+#define APP_LOG_MAX_ARGS 6
+
+typedef enum
+{
+    APP_LOG_MAIN,
+    APP_LOG_EVENT,
+    APP_LOG_ACTUATOR,
+    APP_LOG_RGBPIXEL,
+    APP_LOG_MODULE_MAX,
+} app_log_module_t;
+
+typedef struct
+{
+    const char *format;
+    uint8_t module;   // app_log_module_t
+    uint8_t level;    // esp_log_level_t
+    uint16_t count;   // Records in the current rate limit window
+    uint32_t window_ms;
+    uint32_t suppressed;
+} app_log_site_t;
+
+typedef struct
+{
+    uint32_t written;    // Records put in the ring, or printed at once without CONFIG_APP_LOG_DEFERRED
+    uint32_t lost;       // Overwritten before the task printed them
+    uint32_t suppressed; // Left out by the rate limit
+} app_log_stats_t;
+
+#define APP_LOG_CAT_(a, b) a##b
+#define APP_LOG_CAT(a, b) APP_LOG_CAT_(a, b)
+#define APP_LOG_COUNT_(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+#define APP_LOG_COUNT(...) APP_LOG_COUNT_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define APP_LOG_ARG(x) ((uint32_t)(uintptr_t)(x))
+#define APP_LOG_ARGS_0()
+#define APP_LOG_ARGS_1(a) APP_LOG_ARG(a)
+#define APP_LOG_ARGS_2(a, b) APP_LOG_ARG(a), APP_LOG_ARG(b)
+#define APP_LOG_ARGS_3(a, b, c) APP_LOG_ARGS_2(a, b), APP_LOG_ARG(c)
+#define APP_LOG_ARGS_4(a, b, c, d) APP_LOG_ARGS_3(a, b, c), APP_LOG_ARG(d)
+#define APP_LOG_ARGS_5(a, b, c, d, e) APP_LOG_ARGS_4(a, b, c, d), APP_LOG_ARG(e)
+#define APP_LOG_ARGS_6(a, b, c, d, e, f) APP_LOG_ARGS_5(a, b, c, d, e), APP_LOG_ARG(f)
+
+#if CONFIG_APP_LOG_DEFERRED
+#define APP_LOG_EMIT(site, tag, lvl, fmt, ...)                                                            \
+    app_log_write(&site, APP_LOG_COUNT(__VA_ARGS__),                                                      \
+                  (const uint32_t[]){0, APP_LOG_CAT(APP_LOG_ARGS_, APP_LOG_COUNT(__VA_ARGS__))(__VA_ARGS__)} + 1)
+#else
+#define APP_LOG_EMIT(site, tag, lvl, fmt, ...) ESP_LOG_LEVEL(lvl, tag, fmt, ##__VA_ARGS__)
+#endif
+
+#define APP_LOG_AT(lvl, module, fmt, ...)                                            \
+    do                                                                               \
+    {                                                                                \
+        static app_log_site_t app_log_site = {fmt, module, lvl, 0, 0, 0};            \
+        if (app_log_admit(&app_log_site))                                            \
+            APP_LOG_EMIT(app_log_site, app_log_module_name(module), lvl, fmt, ##__VA_ARGS__); \
+    } while (0)
+
+#define APP_LOGE(module, fmt, ...) APP_LOG_AT(ESP_LOG_ERROR, module, fmt, ##__VA_ARGS__)
+#define APP_LOGW(module, fmt, ...) APP_LOG_AT(ESP_LOG_WARN, module, fmt, ##__VA_ARGS__)
+#define APP_LOGI(module, fmt, ...) APP_LOG_AT(ESP_LOG_INFO, module, fmt, ##__VA_ARGS__)
+#define APP_LOGD(module, fmt, ...) APP_LOG_AT(ESP_LOG_DEBUG, module, fmt, ##__VA_ARGS__)
+
+esp_err_t app_log_init(void);
+bool app_log_admit(app_log_site_t *site);
+void app_log_write(app_log_site_t *site, uint8_t count, const uint32_t *args);
+const char *app_log_module_name(app_log_module_t module);
+void app_log_set_level(app_log_module_t module, esp_log_level_t level);
+esp_err_t app_log_set_level_by_name(const char *module, esp_log_level_t level);
+void app_log_get_stats(app_log_stats_t *stats);
\ No newline at end of file
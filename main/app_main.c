@@ -30,18 +30,32 @@
 #include <esp_rmaker_core.h>
 #include <esp_rmaker_common_events.h>
 #include <esp_rmaker_utils.h>
+#include <esp_system.h>
 #include <esp_wifi.h>
 #include <ioc_standard_devices.h>
 #include <ioc_standard_params.h>
 #include <ioc_standard_types.h>
 #include <wifi_provisioning/manager.h>
+#ifdef CONFIG_ESP_INSIGHTS_ENABLED
+#include <esp_diagnostics.h>
+#endif
 
 #include <nvs_flash.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <app_actuator.h>
+#include <app_boot.h>
+#include <app_device.h>
 #include <app_insights.h>
+#include <app_log.h>
+#include <app_pm.h>
+#include <app_powersave.h>
 #include <app_priv.h>
 #include <app_rainmaker.h>
+#include <app_report.h>
+#include <app_tasks.h>
+#include <app_trace.h>
 #include <app_wifi.h>
 #include <rgbpixel.h>
 #include <wifi_reconnect.h>
@@ -52,7 +66,7 @@ static const char TAG_EVENT[] = "app_main_EVENT";
 // Devices
 esp_rmaker_device_t *bedroom_light;
 esp_rmaker_device_t *wall_light;
-esp_rmaker_device_t *rgb_ring_light;
+esp_rmaker_device_t *rgb_ring_lights[RGBPIXEL_SEGMENTS];
 esp_rmaker_device_t *temperature_sensor;
 esp_rmaker_device_t *humidity_sensor;
 esp_rmaker_device_t *luminosity_sensor;
@@ -66,86 +80,142 @@ app_wifi_pop_type_t pop_type = POP_TYPE_MAC;
 // Program
 static void app_devices_init(esp_rmaker_node_t *node);
 
+static app_device_ctx_t g_bedroom_light_ctx = {.actuated = true};
+static app_device_ctx_t g_wall_light_ctx = {.actuated = true};
+static app_device_ctx_t g_rgb_light_ctx[RGBPIXEL_SEGMENTS];
+static app_device_ctx_t g_esp_device_ctx;
+
+// Hardware work is deferred to the actuator task, so the RainMaker callback returns straight away
+static esp_err_t bedroom_light_power_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_LIGHT0_POWER, 0, (app_actuator_value_t){.b = val.val.b}, trace);
+}
+
+static esp_err_t bedroom_light_brightness_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_LIGHT0_BRIGHTNESS, 0, (app_actuator_value_t){.i = val.val.i}, trace);
+}
+
+static esp_err_t wall_light_power_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_LIGHT3_POWER, 0, (app_actuator_value_t){.b = val.val.b}, trace);
+}
+
+static esp_err_t rgb_light_power_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_RGB_POWER, device->index, (app_actuator_value_t){.b = val.val.b}, trace);
+}
+
+static esp_err_t rgb_light_brightness_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_RGB_BRIGHTNESS, device->index, (app_actuator_value_t){.i = val.val.i}, trace);
+}
+
+static esp_err_t rgb_light_hue_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_RGB_HUE, device->index, (app_actuator_value_t){.i = val.val.i}, trace);
+}
+
+static esp_err_t rgb_light_saturation_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return app_actuator_submit(APP_ACTUATOR_RGB_SATURATION, device->index, (app_actuator_value_t){.i = val.val.i}, trace);
+}
+
+static esp_err_t rgb_light_effect_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    // Resolved here, so unknown effects are rejected and the queued name outlives the write
+    const char *name = RGBPIXEL_EFFECT_NONE_NAME;
+    if (strcmp(val.val.s, RGBPIXEL_EFFECT_NONE_NAME) != 0)
+    {
+        const rgbpixel_effect_t *effect = rgbpixel_effect_find(val.val.s);
+        if (!effect)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        name = effect->name;
+    }
+    return app_actuator_submit(APP_ACTUATOR_RGB_EFFECT, device->index, (app_actuator_value_t){.s = name}, trace);
+}
+
+static esp_err_t esp_device_name_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    // Nothing to drive, the new name is only reported back
+    return ESP_OK;
+}
+
+static esp_err_t esp_device_reboot_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return esp_rmaker_reboot(10);
+}
+
+static esp_err_t esp_device_wifi_reset_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return esp_rmaker_wifi_reset(5, 10);
+}
+
+static esp_err_t esp_device_factory_reset_cb(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace)
+{
+    return esp_rmaker_factory_reset(5, 10);
+}
+
 // Callback to handle commands received from the RainMaker cloud
 static esp_err_t write_cb(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param,
                           const esp_rmaker_param_val_t val, void *priv_data, esp_rmaker_write_ctx_t *ctx)
 {
-    const char *device_name = esp_rmaker_device_get_name(device);
-    const char *param_name = esp_rmaker_param_get_name(param);
-    if (ctx)
-    {
-        ESP_LOGI(TAG, "Received write request via : %s", esp_rmaker_device_cb_src_to_str(ctx->src));
-    }
-    if (strcmp(device_name, "Bedroom Light") == 0)
+    const app_device_ctx_t *device_ctx = priv_data;
+    app_param_handler_t handler = app_device_find_handler(device_ctx, param);
+    if (!handler)
     {
-        if (strcmp(param_name, IOC_DEF_POWER_NAME) == 0)
-        {
-            ESP_LOGI(TAG, "Received value = %s for %s - %s", val.val.b ? "true" : "false", device_name, param_name);
-            app_driver_set_light0_power_state(val.val.b);
-            rgbpixel_start_anim(0, true);
-        }
-        else if (strcmp(param_name, IOC_DEF_BRIGHTNESS_NAME) == 0)
-        {
-            ESP_LOGI(TAG, "Received value = %d for %s - %s", val.val.i, device_name, param_name);
-            app_driver_set_light0_brightness(val.val.i);
-        }
+        // Silently ignoring invalid params
+        return ESP_OK;
     }
-    else if (strcmp(device_name, "Wall Light") == 0)
+    uint16_t trace = app_trace_begin(ctx ? ctx->src : APP_TRACE_SOURCE_DEVICE);
+    if (ctx)
     {
-        ESP_LOGI(TAG, "Received value = %s for %s - %s", val.val.b ? "true" : "false", device_name, param_name);
-        if (strcmp(param_name, IOC_DEF_POWER_NAME) == 0)
-        {
-            app_driver_set_light3_power_state(val.val.b);
-            rgbpixel_start_anim(0, true);
-        }
+        APP_LOGI(APP_LOG_MAIN, "Received write request via : %s", esp_rmaker_device_cb_src_to_str(ctx->src));
+        // Someone is using the app, keep the radio responsive for what follows
+        if (ctx->src == ESP_RMAKER_REQ_SRC_LOCAL)
+            app_powersave_activity(APP_POWERSAVE_LOCAL);
+        else if (ctx->src != ESP_RMAKER_REQ_SRC_SCHEDULE && ctx->src != ESP_RMAKER_REQ_SRC_INIT)
+            app_powersave_activity(APP_POWERSAVE_COMMAND);
     }
-    else if (strcmp(device_name, "RGB Light") == 0)
+    const char *device_name = esp_rmaker_device_get_name(device);
+    const char *param_name = esp_rmaker_param_get_name(param);
+    switch (val.type)
     {
-        if (strcmp(param_name, IOC_DEF_POWER_NAME) == 0)
-        {
-            ESP_LOGI(TAG, "Received value = %s for %s - %s", val.val.b ? "true" : "false", device_name, param_name);
-            rgbpixel_set_power_state(val.val.b);
-            rgbpixel_start_anim(0, true);
-        }
-        else if (strcmp(param_name, IOC_DEF_BRIGHTNESS_NAME) == 0)
-        {
-            ESP_LOGI(TAG, "Received value = %d for %s - %s", val.val.i, device_name, param_name);
-            rgbpixel_set_brightness(val.val.i);
-        }
-        else if (strcmp(param_name, IOC_DEF_HUE_NAME) == 0)
-        {
-            ESP_LOGI(TAG, "Received value = %d for %s - %s", val.val.i, device_name, param_name);
-            rgbpixel_set_hue(val.val.i);
-        }
-        else if (strcmp(param_name, IOC_DEF_SATURATION_NAME) == 0)
-        {
-            ESP_LOGI(TAG, "Received value = %d for %s - %s", val.val.i, device_name, param_name);
-            rgbpixel_set_saturation(val.val.i);
-        }
+    case RMAKER_VAL_TYPE_BOOLEAN:
+        APP_LOGI(APP_LOG_MAIN, "Received value = %s for %s - %s", val.val.b ? "true" : "false", device_name, param_name);
+        break;
+    case RMAKER_VAL_TYPE_INTEGER:
+        APP_LOGI(APP_LOG_MAIN, "Received value = %d for %s - %s", val.val.i, device_name, param_name);
+        break;
+    case RMAKER_VAL_TYPE_STRING:
+        // The string is freed after the callback, it cannot wait in the log ring
+        ESP_LOGI(TAG, "Received value = %s for %s - %s", val.val.s, device_name, param_name);
+        break;
+    default:
+        break;
     }
-    else if (strcmp(device_name, "ESP Device") == 0)
+    // The other params of a cloud, scene or schedule request follow in their own calls, the actuator waits for them
+    bool batch = ctx && ctx->src != ESP_RMAKER_REQ_SRC_LOCAL && device_ctx->actuated;
+    // The echo is published together with the side effects of the write
+    app_report_begin();
+    if (batch)
+        app_actuator_batch_begin();
+    esp_err_t err = handler(device_ctx, val, trace);
+    if (batch)
+        app_actuator_batch_end();
+    if (err == ESP_OK)
     {
-        ESP_LOGI(TAG, "Received value = %s for %s - %s", val.val.b ? "true" : "false", device_name, param_name);
-        if (strcmp(param_name, IOC_DEF_REBOOT_NAME) == 0)
-        {
-            esp_rmaker_reboot(10);
-        }
-        else if (strcmp(param_name, IOC_DEF_WIFI_RESET_NAME) == 0)
+        app_report_param(param, val);
+        if (!device_ctx->actuated)
         {
-            esp_rmaker_wifi_reset(5, 10);
+            app_report_flush();
+            app_trace_point(trace, APP_TRACE_REPORTED);
         }
-        else if (strcmp(param_name, IOC_DEF_FACTORY_RESET_NAME) == 0)
-        {
-            esp_rmaker_factory_reset(5, 10);
-        }
-    }
-    else
-    {
-        // Silently ignoring invalid params
-        return ESP_OK;
     }
-    esp_rmaker_param_update_and_report(param, val);
-    return ESP_OK;
+    app_report_end();
+    return err;
 }
 
 // Event handler for catching Wi-Fi events
@@ -156,11 +226,11 @@ static void event_handler(void* arg, esp_event_base_t event_base,
         switch (event_id) {
             case WIFI_PROV_START:
                 ESP_LOGI(TAG_EVENT, "Provisioning started");
-                rgbpixel_start_anim(1, false);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_ORANGE, false);
                 break;
             case WIFI_PROV_CRED_SUCCESS:
                 ESP_LOGI(TAG_EVENT, "Provisioning successful");
-                rgbpixel_start_anim(4, true);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_PULSE_GREEN, true);
                 break;
             default:
                 break;
@@ -168,11 +238,33 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         ESP_LOGI(TAG_EVENT, "WiFi disconnected");
-        rgbpixel_start_anim(5, false);
+        rgbpixel_start_anim(RGBPIXEL_EFFECT_PULSE_PURPLE, false);
     }
     else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ESP_LOGI(TAG_EVENT, "WiFi connected");
-        rgbpixel_start_anim(2, true);
+        app_boot_mark(APP_BOOT_WIFI_CONNECTED);
+        rgbpixel_start_anim(RGBPIXEL_EFFECT_PULSE_BLUE, true);
+    }
+    else if (event_base == WIFI_RECONNECT_EVENT && event_id == WIFI_RECONNECT_EVENT_ROAMED) {
+        wifi_reconnect_roam_t *roam = (wifi_reconnect_roam_t *)event_data;
+        ESP_LOGI(TAG_EVENT, "WiFi roamed from " MACSTR " (%d dBm) to " MACSTR " (%d dBm) in %u ms",
+                 MAC2STR(roam->from_bssid), roam->from_rssi, MAC2STR(roam->to_bssid), roam->to_rssi, roam->duration_ms);
+#ifdef CONFIG_ESP_INSIGHTS_ENABLED
+        ESP_DIAG_EVENT(TAG_EVENT, "roam " MACSTR " %d " MACSTR " %d %u", MAC2STR(roam->from_bssid), roam->from_rssi,
+                       MAC2STR(roam->to_bssid), roam->to_rssi, roam->duration_ms);
+#endif
+    }
+    else if (event_base == WIFI_RECONNECT_EVENT && event_id == WIFI_RECONNECT_EVENT_QUALITY) {
+        wifi_reconnect_quality_t *quality = (wifi_reconnect_quality_t *)event_data;
+        ESP_LOGD(TAG_EVENT, "WiFi RSSI %d dBm, min %d avg %d max %d", quality->rssi, quality->rssi_min,
+                 quality->rssi_avg, quality->rssi_max);
+#ifdef CONFIG_ESP_INSIGHTS_ENABLED
+        // One summary per history window keeps the fleet upload small
+        if (quality->sample % WIFI_RECONNECT_RSSI_HISTORY == 0) {
+            ESP_DIAG_EVENT(TAG_EVENT, "rssi " MACSTR " ch %d min %d avg %d max %d", MAC2STR(quality->bssid),
+                           quality->channel, quality->rssi_min, quality->rssi_avg, quality->rssi_max);
+        }
+#endif
     }
 }
 
@@ -180,23 +272,24 @@ static void event_handler(void* arg, esp_event_base_t event_base,
 static void rmk_event_handler(void* arg, esp_event_base_t event_base,
                           int event_id, void* event_data)
 {
+    static bool boot_reported;
     if (event_base == RMAKER_EVENT) {
         switch (event_id) {
             case RMAKER_EVENT_INIT_DONE:
                 ESP_LOGI(TAG_EVENT, "RainMaker Initialised.");
-                rgbpixel_start_anim(1, false);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_ORANGE, false);
                 break;
             case RMAKER_EVENT_CLAIM_STARTED:
                 ESP_LOGI(TAG_EVENT, "RainMaker Claim Started.");
-                rgbpixel_start_anim(1, false);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_ORANGE, false);
                 break;
             case RMAKER_EVENT_CLAIM_SUCCESSFUL:
                 ESP_LOGI(TAG_EVENT, "RainMaker Claim Successful.");
-                rgbpixel_start_anim(2, true);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_PULSE_BLUE, true);
                 break;
             case RMAKER_EVENT_CLAIM_FAILED:
                 ESP_LOGI(TAG_EVENT, "RainMaker Claim Failed.");
-                rgbpixel_start_anim(3, true);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_PULSE_RED, true);
                 break;
             default:
                 ESP_LOGW(TAG_EVENT, "Unhandled RainMaker Event: %d", event_id);
@@ -205,24 +298,31 @@ static void rmk_event_handler(void* arg, esp_event_base_t event_base,
         switch (event_id) {
             case RMAKER_EVENT_REBOOT:
                 ESP_LOGI(TAG_EVENT, "Rebooting in %d seconds.", *((uint8_t *)event_data));
-                rgbpixel_start_anim(1, false);
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_ORANGE, false);
                 break;
             case RMAKER_EVENT_WIFI_RESET:
                 ESP_LOGI(TAG_EVENT, "Wi-Fi credentials reset.");
-                rgbpixel_start_anim(1, false);
+                wifi_reconnect_forget_all();
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_ORANGE, false);
                 break;
             case RMAKER_EVENT_FACTORY_RESET:
                 ESP_LOGI(TAG_EVENT, "Node reset to factory defaults.");
-                rgbpixel_start_anim(1, false);
+                wifi_reconnect_forget_all();
+                rgbpixel_start_anim(RGBPIXEL_EFFECT_SPIN_ORANGE, false);
                 break;
             case RMAKER_MQTT_EVENT_CONNECTED:
                 ESP_LOGI(TAG_EVENT, "MQTT Connected.");
+                if (!boot_reported) {
+                    boot_reported = true;
+                    app_boot_mark(APP_BOOT_CLOUD_ONLINE);
+                    app_boot_log_timeline();
+                }
                 break;
             case RMAKER_MQTT_EVENT_DISCONNECTED:
                 ESP_LOGI(TAG_EVENT, "MQTT Disconnected.");
                 break;
             case RMAKER_MQTT_EVENT_PUBLISHED:
-                ESP_LOGI(TAG_EVENT, "MQTT Published. Msg id: %d.", *((int *)event_data));
+                APP_LOGI(APP_LOG_EVENT, "MQTT Published. Msg id: %d.", *((int *)event_data));
                 break;
             default:
                 ESP_LOGW(TAG_EVENT, "Unhandled RainMaker Common Event: %d", event_id);
@@ -247,46 +347,85 @@ static void rmk_event_handler(void* arg, esp_event_base_t event_base,
     }
 }
 
-void setup()
+static esp_err_t app_stage_nvs(void)
 {
-    // Initialize NVS
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
         ESP_ERROR_CHECK(nvs_flash_erase());
         err = nvs_flash_init();
     }
-    ESP_ERROR_CHECK(err);
+    return err;
+}
+
+static esp_err_t app_stage_services(void)
+{
+    esp_err_t err = app_report_init();
+    if (err == ESP_OK)
+    {
+        err = app_trace_init();
+    }
+    if (err == ESP_OK)
+    {
+        err = app_tasks_init();
+    }
+    return err;
+}
 
-    // Setup
-    err = app_driver_rgbpixel_init();
+static esp_err_t app_stage_led(void)
+{
+    esp_err_t err = app_driver_rgbpixel_init();
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not setup rgbpixel!");
     }
+    return err;
+}
+
+static esp_err_t app_stage_driver(void)
+{
     app_driver_init();
+    return ESP_OK;
+}
 
-    // Wi-Fi
+static esp_err_t app_stage_actuator(void)
+{
+    esp_err_t err = app_actuator_init();
+    if (err == ESP_OK)
+    {
+        app_boot_mark(APP_BOOT_ACTUATION_READY);
+    }
+    return err;
+}
+
+static esp_err_t app_stage_wifi(void)
+{
     struct app_wifi_config wifi_cfg = {
         .wifi_connect = wifi_reconnect_resume,
     };
     ESP_ERROR_CHECK(app_wifi_init(&wifi_cfg));
-    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
+    ESP_ERROR_CHECK(app_powersave_init());
 
     // Register an event handler to catch Wi-Fi, IP and Provisioning events
-    err = esp_event_handler_register(WIFI_PROV_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL);
+    esp_err_t err = esp_event_handler_register(WIFI_PROV_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL);
     err = esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event_handler, NULL);
     err = esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL);
+    err = esp_event_handler_register(WIFI_RECONNECT_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL);
     if (err != ESP_OK)
     {
         ESP_LOGW(TAG, "Could not register Wi-Fi event handler");
     }
 
     // Start Wi-Fi reconnect
-    ESP_ERROR_CHECK(wifi_reconnect_start());
+    const app_task_placement_t *placement = app_task_placement(APP_TASK_WIFI_RECONNECT);
+    wifi_reconnect_set_task(placement->core == tskNO_AFFINITY ? -1 : placement->core, placement->priority, placement->stack);
+    return wifi_reconnect_start();
+}
 
+static esp_err_t app_stage_rmaker(void)
+{
     // Register an event handler to catch RainMaker events
-    err = esp_event_handler_register(RMAKER_EVENT, ESP_EVENT_ANY_ID, &rmk_event_handler, NULL);
+    esp_err_t err = esp_event_handler_register(RMAKER_EVENT, ESP_EVENT_ANY_ID, &rmk_event_handler, NULL);
     err = esp_event_handler_register(RMAKER_COMMON_EVENT, ESP_EVENT_ANY_ID, &rmk_event_handler, NULL);
     if (err != ESP_OK)
     {
@@ -304,13 +443,55 @@ void setup()
     app_insights_enable();
 
     // Start
-    ESP_ERROR_CHECK(esp_rmaker_start());
+    return esp_rmaker_start();
+}
+
+/* Boot stages. The LED strip and the relays and buttons are brought up on
+ * the core of their tasks, where their interrupts should live, while the
+ * Wi-Fi radio comes up on core 0 and the sensors wherever there is time. RainMaker needs all of
+ * them, its devices are created with the current state of each.
+ */
+typedef enum
+{
+    APP_STAGE_NVS,
+    APP_STAGE_SERVICES,
+    APP_STAGE_LED,
+    APP_STAGE_DRIVER,
+    APP_STAGE_SENSORS,
+    APP_STAGE_ACTUATOR,
+    APP_STAGE_WIFI,
+    APP_STAGE_RMAKER,
+    APP_STAGES,
+} app_stage_t;
+
+static const app_boot_stage_t g_app_boot_stages[APP_STAGES] = {
+    [APP_STAGE_NVS] = {"nvs", app_stage_nvs, 0, 0, 0, true},
+    [APP_STAGE_SERVICES] = {"services", app_stage_services, 0, tskNO_AFFINITY, 0, true},
+    [APP_STAGE_LED] = {"led", app_stage_led, 0, APP_TASK_CORE(CONFIG_APP_TASK_RENDER_CORE), 0, false},
+    [APP_STAGE_DRIVER] = {"driver", app_stage_driver, APP_BOOT_AFTER(APP_STAGE_SERVICES),
+                          APP_TASK_CORE(CONFIG_APP_TASK_BUTTON_CORE), 0, true},
+    [APP_STAGE_SENSORS] = {"sensors", app_driver_sensor_init, APP_BOOT_AFTER(APP_STAGE_SERVICES), tskNO_AFFINITY, 0, false},
+    [APP_STAGE_ACTUATOR] = {"actuator", app_stage_actuator,
+                            APP_BOOT_AFTER(APP_STAGE_SERVICES) | APP_BOOT_AFTER(APP_STAGE_LED) | APP_BOOT_AFTER(APP_STAGE_DRIVER),
+                            tskNO_AFFINITY, 0, true},
+    [APP_STAGE_WIFI] = {"wifi", app_stage_wifi, APP_BOOT_AFTER(APP_STAGE_NVS), 0, 0, true},
+    [APP_STAGE_RMAKER] = {"rmaker", app_stage_rmaker,
+                          APP_BOOT_AFTER(APP_STAGE_WIFI) | APP_BOOT_AFTER(APP_STAGE_SENSORS) | APP_BOOT_AFTER(APP_STAGE_ACTUATOR),
+                          0, 6144, true},
+};
+
+void setup()
+{
+    // Before any stage, the drivers take their locks from the start
+    ESP_ERROR_CHECK(app_pm_init());
+    ESP_ERROR_CHECK(app_log_init());
+    ESP_ERROR_CHECK(app_boot_run(g_app_boot_stages, APP_STAGES));
 
     // Start the Wi-Fi.
     // If the node is provisioned, it will start connection attempts,
     // else, it will start Wi-Fi provisioning. The function will return
     // after a connection has been successfully established
-    err = app_wifi_start(pop_type);
+    esp_err_t err = app_wifi_start(pop_type);
     if (err != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start WiFi!");
@@ -324,21 +505,40 @@ static void app_devices_init(esp_rmaker_node_t *node)
 {
     // Create devices
     bedroom_light = ioc_lightbulb_device_create("Bedroom Light", NULL, app_driver_get_light0_power_state());
-    esp_rmaker_device_add_cb(bedroom_light, write_cb, NULL);
-    esp_rmaker_device_add_param(bedroom_light, ioc_brightness_param_create(IOC_DEF_BRIGHTNESS_NAME, app_driver_get_light0_brightness()));
+    esp_rmaker_device_add_cb(bedroom_light, write_cb, &g_bedroom_light_ctx);
+    ESP_ERROR_CHECK(app_device_bind_param(&g_bedroom_light_ctx, esp_rmaker_device_get_param_by_name(bedroom_light, IOC_DEF_POWER_NAME), bedroom_light_power_cb));
+    ESP_ERROR_CHECK(app_device_add_param(&g_bedroom_light_ctx, bedroom_light, ioc_brightness_param_create(IOC_DEF_BRIGHTNESS_NAME, app_driver_get_light0_brightness()), bedroom_light_brightness_cb));
     esp_rmaker_node_add_device(node, bedroom_light);
 
     wall_light = ioc_lightbulb_device_create("Wall Light", NULL, app_driver_get_light3_power_state());
-    esp_rmaker_device_add_cb(wall_light, write_cb, NULL);
+    esp_rmaker_device_add_cb(wall_light, write_cb, &g_wall_light_ctx);
+    ESP_ERROR_CHECK(app_device_bind_param(&g_wall_light_ctx, esp_rmaker_device_get_param_by_name(wall_light, IOC_DEF_POWER_NAME), wall_light_power_cb));
     esp_rmaker_node_add_device(node, wall_light);
 
-    rgb_ring_light = ioc_lightbulb_rgb_device_create("RGB Light", NULL, rgbpixel_get_power_state());
-    esp_rmaker_device_add_cb(rgb_ring_light, write_cb, NULL);
-    // esp_rmaker_device_add_param(rgb_ring_light, ioc_hue_param_create(IOC_DEF_HUE_NAME, rgbpixel_get_hue()));
-    esp_rmaker_device_add_param(rgb_ring_light, ioc_hue_circle_param_create(IOC_DEF_HUE_NAME, rgbpixel_get_hue()));
-    esp_rmaker_device_add_param(rgb_ring_light, ioc_saturation_param_create(IOC_DEF_SATURATION_NAME, rgbpixel_get_saturation()));
-    esp_rmaker_device_add_param(rgb_ring_light, ioc_brightness_param_create(IOC_DEF_BRIGHTNESS_NAME, rgbpixel_get_brightness()));
-    esp_rmaker_node_add_device(node, rgb_ring_light);
+    // RainMaker keeps a reference to the list, it must outlive the param
+    static const char *effects[RGBPIXEL_EFFECT_MAX + 1];
+    uint8_t effects_count = rgbpixel_effect_names(effects, sizeof(effects) / sizeof(effects[0]));
+    for (uint8_t i = 0; i < RGBPIXEL_SEGMENTS; i++)
+    {
+        char name[16] = "RGB Light";
+        if (i > 0)
+        {
+            snprintf(name, sizeof(name), "RGB Light %d", i + 1);
+        }
+        app_device_ctx_t *ctx = &g_rgb_light_ctx[i];
+        ctx->index = i;
+        ctx->actuated = true;
+        esp_rmaker_device_t *light = ioc_lightbulb_rgb_device_create(name, NULL, rgbpixel_get_power_state(i));
+        esp_rmaker_device_add_cb(light, write_cb, ctx);
+        ESP_ERROR_CHECK(app_device_bind_param(ctx, esp_rmaker_device_get_param_by_name(light, IOC_DEF_POWER_NAME), rgb_light_power_cb));
+        // app_device_add_param(ctx, light, ioc_hue_param_create(IOC_DEF_HUE_NAME, rgbpixel_get_hue(i)), rgb_light_hue_cb);
+        ESP_ERROR_CHECK(app_device_add_param(ctx, light, ioc_hue_circle_param_create(IOC_DEF_HUE_NAME, rgbpixel_get_hue(i)), rgb_light_hue_cb));
+        ESP_ERROR_CHECK(app_device_add_param(ctx, light, ioc_saturation_param_create(IOC_DEF_SATURATION_NAME, rgbpixel_get_saturation(i)), rgb_light_saturation_cb));
+        ESP_ERROR_CHECK(app_device_add_param(ctx, light, ioc_brightness_param_create(IOC_DEF_BRIGHTNESS_NAME, rgbpixel_get_brightness(i)), rgb_light_brightness_cb));
+        ESP_ERROR_CHECK(app_device_add_param(ctx, light, ioc_effect_param_create(IOC_DEF_EFFECT_NAME, rgbpixel_get_effect(i), effects, effects_count), rgb_light_effect_cb));
+        esp_rmaker_node_add_device(node, light);
+        rgb_ring_lights[i] = light;
+    }
 
     temperature_sensor = ioc_temp_sensor_device_create("Temperature Sensor", NULL, app_driver_sensor_get_current_temperature());
     esp_rmaker_node_add_device(node, temperature_sensor);
@@ -350,8 +550,8 @@ static void app_devices_init(esp_rmaker_node_t *node)
     esp_rmaker_node_add_device(node, luminosity_sensor);
 
     esp_device = esp_rmaker_device_create("ESP Device", NULL, NULL);
-    esp_rmaker_device_add_cb(esp_device, write_cb, NULL);
-    esp_rmaker_device_add_param(esp_device, ioc_name_param_create(IOC_DEF_NAME_PARAM, "ESP Device"));
+    esp_rmaker_device_add_cb(esp_device, write_cb, &g_esp_device_ctx);
+    ESP_ERROR_CHECK(app_device_add_param(&g_esp_device_ctx, esp_device, ioc_name_param_create(IOC_DEF_NAME_PARAM, "ESP Device"), esp_device_name_cb));
     char mac[18];
     esp_err_t err = get_dev_mac(mac);
     if (err == ESP_OK && mac != NULL) {
@@ -363,9 +563,9 @@ static void app_devices_init(esp_rmaker_node_t *node)
     if (err == ESP_OK && pop != NULL) {
         esp_rmaker_device_add_attribute(esp_device, "PoP", pop);
     }
-    esp_rmaker_device_add_param(esp_device, ioc_reboot_param_create(IOC_DEF_REBOOT_NAME));
-    esp_rmaker_device_add_param(esp_device, ioc_wifi_reset_param_create(IOC_DEF_WIFI_RESET_NAME));
-    esp_rmaker_device_add_param(esp_device, ioc_factory_reset_param_create(IOC_DEF_FACTORY_RESET_NAME));
+    ESP_ERROR_CHECK(app_device_add_param(&g_esp_device_ctx, esp_device, ioc_reboot_param_create(IOC_DEF_REBOOT_NAME), esp_device_reboot_cb));
+    ESP_ERROR_CHECK(app_device_add_param(&g_esp_device_ctx, esp_device, ioc_wifi_reset_param_create(IOC_DEF_WIFI_RESET_NAME), esp_device_wifi_reset_cb));
+    ESP_ERROR_CHECK(app_device_add_param(&g_esp_device_ctx, esp_device, ioc_factory_reset_param_create(IOC_DEF_FACTORY_RESET_NAME), esp_device_factory_reset_cb));
     esp_rmaker_node_add_device(node, esp_device);
 }
 
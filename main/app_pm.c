@@ -0,0 +1,199 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#include <esp32/pm.h>
+#endif
+
+#include <freertos/FreeRTOS.h>
+
+#include <app_pm.h>
+
+static const char *const g_app_pm_lock_names[APP_PM_LOCK_MAX] = {
+    [APP_PM_LOCK_RENDER] = "render",
+    [APP_PM_LOCK_OUTPUT] = "output",
+    [APP_PM_LOCK_SENSORS] = "sensors",
+    [APP_PM_LOCK_COMMAND] = "command",
+    [APP_PM_LOCK_INTERACTIVE] = "interactive",
+};
+
+#if CONFIG_PM_ENABLE
+static const esp_pm_lock_type_t g_app_pm_lock_types[APP_PM_LOCK_MAX] = {
+    [APP_PM_LOCK_RENDER] = ESP_PM_CPU_FREQ_MAX,
+    [APP_PM_LOCK_OUTPUT] = ESP_PM_APB_FREQ_MAX,
+    [APP_PM_LOCK_SENSORS] = ESP_PM_APB_FREQ_MAX,
+    [APP_PM_LOCK_COMMAND] = ESP_PM_CPU_FREQ_MAX,
+    [APP_PM_LOCK_INTERACTIVE] = ESP_PM_NO_LIGHT_SLEEP,
+};
+
+static esp_pm_lock_handle_t g_app_pm_locks[APP_PM_LOCK_MAX];
+#endif
+static portMUX_TYPE g_app_pm_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t g_app_pm_depth[APP_PM_LOCK_MAX];
+static int64_t g_app_pm_since_us[APP_PM_LOCK_MAX]; // Taken, while held
+static app_pm_stats_t g_app_pm_stats;
+static int64_t g_app_pm_start_us;
+static bool g_app_pm_ready;
+static esp_timer_handle_t g_app_pm_report_timer;
+
+static const char *TAG = "app_pm";
+
+void IRAM_ATTR app_pm_acquire(app_pm_lock_t lock)
+{
+    if (!g_app_pm_ready || lock >= APP_PM_LOCK_MAX)
+        return;
+    portENTER_CRITICAL_SAFE(&g_app_pm_mux);
+    if (g_app_pm_depth[lock]++ == 0)
+    {
+        g_app_pm_since_us[lock] = esp_timer_get_time();
+        g_app_pm_stats.acquired[lock]++;
+    }
+    portEXIT_CRITICAL_SAFE(&g_app_pm_mux);
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(g_app_pm_locks[lock]);
+#endif
+}
+
+void IRAM_ATTR app_pm_release(app_pm_lock_t lock)
+{
+    if (!g_app_pm_ready || lock >= APP_PM_LOCK_MAX)
+        return;
+    portENTER_CRITICAL_SAFE(&g_app_pm_mux);
+    if (g_app_pm_depth[lock] == 0)
+    {
+        // Unbalanced, leave the esp_pm lock count alone too
+        portEXIT_CRITICAL_SAFE(&g_app_pm_mux);
+        return;
+    }
+    if (--g_app_pm_depth[lock] == 0)
+        g_app_pm_stats.held_us[lock] += esp_timer_get_time() - g_app_pm_since_us[lock];
+    portEXIT_CRITICAL_SAFE(&g_app_pm_mux);
+#if CONFIG_PM_ENABLE
+    esp_pm_lock_release(g_app_pm_locks[lock]);
+#endif
+}
+
+void app_pm_get_stats(app_pm_stats_t *stats)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&g_app_pm_mux);
+    *stats = g_app_pm_stats;
+    // Locks held right now count up to this moment
+    for (uint8_t i = 0; i < APP_PM_LOCK_MAX; i++)
+    {
+        if (g_app_pm_depth[i])
+            stats->held_us[i] += now - g_app_pm_since_us[i];
+    }
+    portEXIT_CRITICAL(&g_app_pm_mux);
+    stats->uptime_us = now - g_app_pm_start_us;
+}
+
+void app_pm_log_stats(void)
+{
+    app_pm_stats_t stats;
+    app_pm_get_stats(&stats);
+    if (!stats.uptime_us)
+        return;
+    for (uint8_t i = 0; i < APP_PM_LOCK_MAX; i++)
+    {
+        uint32_t permille = stats.held_us[i] * 1000 / stats.uptime_us;
+        ESP_LOGI(TAG, "%-11s held %3u.%u%% %u ms, taken %u times", g_app_pm_lock_names[i], permille / 10,
+                 permille % 10, (uint32_t)(stats.held_us[i] / 1000), stats.acquired[i]);
+    }
+#if CONFIG_PM_PROFILING
+    // Time spent asleep and at each frequency, with the locks of the drivers and the Wi-Fi stack
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+static void app_pm_report(void *arg)
+{
+    app_pm_log_stats();
+}
+
+#if CONFIG_PM_ENABLE
+static esp_err_t app_pm_configure(void)
+{
+    for (uint8_t i = 0; i < APP_PM_LOCK_MAX; i++)
+    {
+        esp_err_t err = esp_pm_lock_create(g_app_pm_lock_types[i], 0, g_app_pm_lock_names[i], &g_app_pm_locks[i]);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Could not create %s lock", g_app_pm_lock_names[i]);
+            return err;
+        }
+    }
+    esp_pm_config_esp32_t config = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_APP_PM_MIN_FREQ_MHZ,
+#if CONFIG_APP_PM_LIGHT_SLEEP
+        .light_sleep_enable = true,
+#endif
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not configure power management: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "CPU %d-%d MHz, light sleep %s", config.min_freq_mhz, config.max_freq_mhz,
+             config.light_sleep_enable ? "on" : "off");
+    return ESP_OK;
+}
+#endif
+
+esp_err_t app_pm_init(void)
+{
+    g_app_pm_start_us = esp_timer_get_time();
+#if CONFIG_PM_ENABLE
+    esp_err_t err = app_pm_configure();
+#else
+    esp_err_t err = ESP_OK;
+#endif
+    if (err != ESP_OK)
+        return err;
+    g_app_pm_ready = true;
+
+    if (CONFIG_APP_PM_REPORT_PERIOD == 0)
+        return ESP_OK;
+    const esp_timer_create_args_t timer_args = {
+        .callback = app_pm_report,
+        .name = "app_pm",
+    };
+    err = esp_timer_create(&timer_args, &g_app_pm_report_timer);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not create report timer");
+        return err;
+    }
+    return esp_timer_start_periodic(g_app_pm_report_timer, CONFIG_APP_PM_REPORT_PERIOD * 1000000ULL);
+}
\ No newline at end of file
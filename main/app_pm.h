@@ -0,0 +1,62 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+/* Dynamic frequency scaling and automatic light sleep. The CPU idles at the
+ * minimum frequency, or asleep between DTIM beacons, and the work that needs
+ * more holds one of these locks only while it runs: a frame on the LED strip
+ * wire, an I2C transaction, a command being applied. The Wi-Fi power save
+ * interactive window keeps light sleep off so follow-up commands are not
+ * delayed by the wake-up.
+ */
+typedef enum
+{
+    APP_PM_LOCK_RENDER,      // LED frame being built, CPU at full speed
+    APP_PM_LOCK_OUTPUT,      // LED frame on the wire, APB clock fixed
+    APP_PM_LOCK_SENSORS,     // I2C transaction, APB clock fixed
+    APP_PM_LOCK_COMMAND,     // Command being applied, CPU at full speed
+    APP_PM_LOCK_INTERACTIVE, // Power save interactive window, no light sleep
+    APP_PM_LOCK_MAX,
+} app_pm_lock_t;
+
+typedef struct
+{
+    uint32_t acquired[APP_PM_LOCK_MAX]; // Times each lock went from free to held
+    uint64_t held_us[APP_PM_LOCK_MAX];  // Time each lock was held
+    uint64_t uptime_us;
+} app_pm_stats_t;
+
+esp_err_t app_pm_init(void);
+// Both may be called from an ISR, acquisitions nest
+void app_pm_acquire(app_pm_lock_t lock);
+void app_pm_release(app_pm_lock_t lock);
+void app_pm_get_stats(app_pm_stats_t *stats);
+void app_pm_log_stats(void);
\ No newline at end of file
@@ -0,0 +1,193 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+
+#include <app_pm.h>
+#include <app_powersave.h>
+
+#define APP_POWERSAVE_IDLE_MODE WIFI_PS_MAX_MODEM
+#if CONFIG_APP_POWERSAVE_ACTIVE_NONE
+#define APP_POWERSAVE_ACTIVE_MODE WIFI_PS_NONE
+#else
+#define APP_POWERSAVE_ACTIVE_MODE WIFI_PS_MIN_MODEM
+#endif
+
+static const uint32_t g_app_powersave_windows_ms[APP_POWERSAVE_SOURCE_MAX] = {
+    [APP_POWERSAVE_COMMAND] = CONFIG_APP_POWERSAVE_COMMAND_WINDOW_MS,
+    [APP_POWERSAVE_LOCAL] = CONFIG_APP_POWERSAVE_LOCAL_WINDOW_MS,
+    [APP_POWERSAVE_BUTTON] = CONFIG_APP_POWERSAVE_BUTTON_WINDOW_MS,
+};
+
+static const char *const g_app_powersave_mode_names[APP_POWERSAVE_MODES] = {
+    [WIFI_PS_NONE] = "none",
+    [WIFI_PS_MIN_MODEM] = "min modem",
+    [WIFI_PS_MAX_MODEM] = "max modem",
+};
+
+static SemaphoreHandle_t g_app_powersave_lock;
+static TimerHandle_t g_app_powersave_timer;
+static esp_timer_handle_t g_app_powersave_report_timer;
+static wifi_ps_type_t g_app_powersave_mode = APP_POWERSAVE_IDLE_MODE;
+static int64_t g_app_powersave_since_us; // Entered the current mode
+static int64_t g_app_powersave_until_us; // End of the active window
+static app_powersave_stats_t g_app_powersave_stats;
+
+static const char *TAG = "app_powersave";
+
+// Caller holds the lock
+static void app_powersave_account(int64_t now)
+{
+    g_app_powersave_stats.residency_us[g_app_powersave_mode] += now - g_app_powersave_since_us;
+    g_app_powersave_since_us = now;
+}
+
+// Caller holds the lock
+static void app_powersave_set_locked(wifi_ps_type_t mode)
+{
+    esp_err_t err = esp_wifi_set_ps(mode);
+    if (err != ESP_OK && mode == WIFI_PS_NONE)
+    {
+        // Refused while Bluetooth is on, as during BLE provisioning
+        mode = WIFI_PS_MIN_MODEM;
+        err = esp_wifi_set_ps(mode);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Could not set power save to %s: %s", g_app_powersave_mode_names[mode], esp_err_to_name(err));
+        return;
+    }
+    if (mode == g_app_powersave_mode)
+        return;
+    // Light sleep would add its wake-up to every command of the interactive window
+    if (g_app_powersave_mode == APP_POWERSAVE_IDLE_MODE)
+        app_pm_acquire(APP_PM_LOCK_INTERACTIVE);
+    else if (mode == APP_POWERSAVE_IDLE_MODE)
+        app_pm_release(APP_PM_LOCK_INTERACTIVE);
+    app_powersave_account(esp_timer_get_time());
+    g_app_powersave_mode = mode;
+    g_app_powersave_stats.transitions[mode]++;
+    ESP_LOGD(TAG, "Power save %s", g_app_powersave_mode_names[mode]);
+}
+
+static void app_powersave_timer_cb(TimerHandle_t timer)
+{
+    xSemaphoreTake(g_app_powersave_lock, portMAX_DELAY);
+    int64_t remaining_us = g_app_powersave_until_us - esp_timer_get_time();
+    // Within a tick of the end counts as expired
+    if (remaining_us < portTICK_PERIOD_MS * 1000)
+        app_powersave_set_locked(APP_POWERSAVE_IDLE_MODE);
+    xSemaphoreGive(g_app_powersave_lock);
+    if (remaining_us >= portTICK_PERIOD_MS * 1000)
+        xTimerChangePeriod(timer, pdMS_TO_TICKS(remaining_us / 1000), 0);
+}
+
+void app_powersave_activity(app_powersave_source_t source)
+{
+    if (!g_app_powersave_lock || source >= APP_POWERSAVE_SOURCE_MAX)
+        return;
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(g_app_powersave_lock, portMAX_DELAY);
+    g_app_powersave_stats.activities[source]++;
+    int64_t until = now + g_app_powersave_windows_ms[source] * 1000LL;
+    if (until > g_app_powersave_until_us)
+        g_app_powersave_until_us = until;
+    if (g_app_powersave_mode == APP_POWERSAVE_IDLE_MODE)
+        app_powersave_set_locked(APP_POWERSAVE_ACTIVE_MODE);
+    TickType_t ticks = pdMS_TO_TICKS((g_app_powersave_until_us - now) / 1000);
+    xSemaphoreGive(g_app_powersave_lock);
+    xTimerChangePeriod(g_app_powersave_timer, ticks ? ticks : 1, 0);
+}
+
+void app_powersave_get_stats(app_powersave_stats_t *stats)
+{
+    xSemaphoreTake(g_app_powersave_lock, portMAX_DELAY);
+    app_powersave_account(esp_timer_get_time());
+    g_app_powersave_stats.mode = g_app_powersave_mode;
+    *stats = g_app_powersave_stats;
+    xSemaphoreGive(g_app_powersave_lock);
+}
+
+void app_powersave_log_stats(void)
+{
+    app_powersave_stats_t stats;
+    app_powersave_get_stats(&stats);
+    uint64_t total_us = 0;
+    for (uint8_t i = 0; i < APP_POWERSAVE_MODES; i++)
+        total_us += stats.residency_us[i];
+    if (!total_us)
+        return;
+    for (uint8_t i = 0; i < APP_POWERSAVE_MODES; i++)
+    {
+        ESP_LOGI(TAG, "%-9s %3u.%u%% %u s, entered %u times%s", g_app_powersave_mode_names[i],
+                 (uint32_t)(stats.residency_us[i] * 100 / total_us), (uint32_t)(stats.residency_us[i] * 1000 / total_us % 10),
+                 (uint32_t)(stats.residency_us[i] / 1000000), stats.transitions[i], i == stats.mode ? ", current" : "");
+    }
+    ESP_LOGI(TAG, "Activity: %u commands, %u local, %u buttons", stats.activities[APP_POWERSAVE_COMMAND],
+             stats.activities[APP_POWERSAVE_LOCAL], stats.activities[APP_POWERSAVE_BUTTON]);
+}
+
+static void app_powersave_report(void *arg)
+{
+    app_powersave_log_stats();
+}
+
+esp_err_t app_powersave_init(void)
+{
+    g_app_powersave_lock = xSemaphoreCreateMutex();
+    g_app_powersave_timer = xTimerCreate("app_powersave", 1, pdFALSE, NULL, app_powersave_timer_cb);
+    if (!g_app_powersave_lock || !g_app_powersave_timer)
+    {
+        ESP_LOGE(TAG, "Could not create power save governor");
+        return ESP_ERR_NO_MEM;
+    }
+    g_app_powersave_since_us = esp_timer_get_time();
+    esp_err_t err = esp_wifi_set_ps(APP_POWERSAVE_IDLE_MODE);
+    if (err != ESP_OK)
+        return err;
+    g_app_powersave_stats.transitions[APP_POWERSAVE_IDLE_MODE]++;
+
+    if (CONFIG_APP_POWERSAVE_REPORT_PERIOD == 0)
+        return ESP_OK;
+    const esp_timer_create_args_t timer_args = {
+        .callback = app_powersave_report,
+        .name = "app_powersave",
+    };
+    err = esp_timer_create(&timer_args, &g_app_powersave_report_timer);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not create report timer");
+        return err;
+    }
+    return esp_timer_start_periodic(g_app_powersave_report_timer, CONFIG_APP_POWERSAVE_REPORT_PERIOD * 1000000ULL);
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+
+/* Wi-Fi power save governor. The station idles in WIFI_PS_MAX_MODEM, which
+ * delays every incoming frame by up to a DTIM interval. Interactive use (a
+ * command, local control, a button press) switches it to a lighter mode for
+ * a window, extended by further activity, after which it drops back.
+ */
+typedef enum
+{
+    APP_POWERSAVE_COMMAND, // Cloud write or scene
+    APP_POWERSAVE_LOCAL,   // Local control write, the phone app tends to follow up
+    APP_POWERSAVE_BUTTON,
+    APP_POWERSAVE_SOURCE_MAX,
+} app_powersave_source_t;
+
+// Indexed by wifi_ps_type_t: WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM
+#define APP_POWERSAVE_MODES 3
+
+typedef struct
+{
+    uint32_t transitions[APP_POWERSAVE_MODES];       // Switches into each mode
+    uint64_t residency_us[APP_POWERSAVE_MODES];      // Time spent in each mode
+    uint32_t activities[APP_POWERSAVE_SOURCE_MAX];
+    uint8_t mode;                                    // Current wifi_ps_type_t
+} app_powersave_stats_t;
+
+esp_err_t app_powersave_init(void);
+void app_powersave_activity(app_powersave_source_t source);
+void app_powersave_get_stats(app_powersave_stats_t *stats);
+void app_powersave_log_stats(void);
\ No newline at end of file
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <esp_err.h>
+#include <esp_rmaker_core.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -38,10 +39,15 @@ extern esp_rmaker_device_t *humidity_sensor;
 extern esp_rmaker_device_t *luminosity_sensor;
 
 void app_driver_init(void);
+esp_err_t app_driver_sensor_init(void);
 
 esp_err_t app_driver_set_light0_power_state(bool power);
 esp_err_t app_driver_set_light0_brightness(uint16_t brightness);
+esp_err_t app_driver_set_light0_state(bool power, uint16_t brightness);
 int app_driver_set_light3_power_state(bool state);
+// Switch the light to the opposite of its current state, returns the new state
+bool app_driver_toggle_light0_power_state(void);
+bool app_driver_toggle_light3_power_state(void);
 
 bool app_driver_get_light0_power_state(void);
 bool app_driver_get_light3_power_state(void);
@@ -0,0 +1,232 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_log.h>
+#include <esp_rmaker_core.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <app_actuator.h>
+#include <app_report.h>
+
+#define APP_REPORT_SHADOW_SIZE 48
+#define APP_REPORT_STRING_MAX 32 // Longer strings are always reported
+
+typedef struct
+{
+    const esp_rmaker_param_t *param;
+    esp_rmaker_val_type_t type;
+    esp_rmaker_val_t val;
+    char str[APP_REPORT_STRING_MAX];
+} app_report_shadow_t;
+
+static app_report_shadow_t g_app_report_shadow[APP_REPORT_SHADOW_SIZE];
+static uint8_t g_app_report_shadow_count;
+static SemaphoreHandle_t g_app_report_lock;
+static TimerHandle_t g_app_report_timer;
+static uint8_t g_app_report_hold;
+static bool g_app_report_pending;     // Values staged since the last publish
+static bool g_app_report_flush_held;  // A flush was asked for while held
+static app_report_stats_t g_app_report_stats;
+
+static const char *TAG = "app_report";
+
+static app_report_shadow_t *app_report_shadow_find(const esp_rmaker_param_t *param)
+{
+    for (uint8_t i = 0; i < g_app_report_shadow_count; i++)
+    {
+        if (g_app_report_shadow[i].param == param)
+            return &g_app_report_shadow[i];
+    }
+    if (g_app_report_shadow_count >= APP_REPORT_SHADOW_SIZE)
+        return NULL;
+    app_report_shadow_t *shadow = &g_app_report_shadow[g_app_report_shadow_count++];
+    shadow->param = param;
+    shadow->type = RMAKER_VAL_TYPE_INVALID;
+    return shadow;
+}
+
+static bool app_report_shadow_equal(const app_report_shadow_t *shadow, const esp_rmaker_param_val_t *val)
+{
+    if (shadow->type != val->type)
+        return false;
+    switch (val->type)
+    {
+    case RMAKER_VAL_TYPE_BOOLEAN:
+        return shadow->val.b == val->val.b;
+    case RMAKER_VAL_TYPE_INTEGER:
+        return shadow->val.i == val->val.i;
+    case RMAKER_VAL_TYPE_FLOAT:
+        return shadow->val.f == val->val.f;
+    case RMAKER_VAL_TYPE_STRING:
+        return val->val.s && strcmp(shadow->str, val->val.s) == 0;
+    default:
+        return false;
+    }
+}
+
+static void app_report_shadow_store(app_report_shadow_t *shadow, const esp_rmaker_param_val_t *val)
+{
+    shadow->type = val->type;
+    shadow->val = val->val;
+    if (val->type == RMAKER_VAL_TYPE_STRING)
+    {
+        if (val->val.s && strlen(val->val.s) < sizeof(shadow->str))
+        {
+            strcpy(shadow->str, val->val.s);
+        }
+        else
+        {
+            // Nothing to compare against next time
+            shadow->type = RMAKER_VAL_TYPE_INVALID;
+        }
+    }
+}
+
+esp_err_t app_report_param(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val)
+{
+    if (!param)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(g_app_report_lock, portMAX_DELAY);
+    g_app_report_stats.requested++;
+    app_report_shadow_t *shadow = app_report_shadow_find(param);
+    if (shadow && app_report_shadow_equal(shadow, &val))
+    {
+        g_app_report_stats.suppressed++;
+        xSemaphoreGive(g_app_report_lock);
+        return ESP_OK;
+    }
+    esp_err_t err = esp_rmaker_param_update(param, val);
+    if (err == ESP_OK)
+    {
+        if (shadow)
+            app_report_shadow_store(shadow, &val);
+        g_app_report_stats.staged++;
+        g_app_report_pending = true;
+    }
+    xSemaphoreGive(g_app_report_lock);
+    return err;
+}
+
+// Called with the lock held, the lock is released on return
+static esp_err_t app_report_publish_unlock(void)
+{
+    bool pending = g_app_report_pending;
+    g_app_report_pending = false;
+    g_app_report_flush_held = false;
+    if (pending)
+        g_app_report_stats.publishes++;
+    app_report_stats_t stats = g_app_report_stats;
+    xSemaphoreGive(g_app_report_lock);
+
+    if (!pending)
+        return ESP_OK;
+    ESP_LOGD(TAG, "%u reports, %u suppressed, %u publishes", stats.requested, stats.suppressed, stats.publishes);
+    esp_err_t err = esp_rmaker_report_updated_params();
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Could not report params: %s", esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t app_report_flush(void)
+{
+    xSemaphoreTake(g_app_report_lock, portMAX_DELAY);
+    if (g_app_report_hold)
+    {
+        g_app_report_flush_held = true;
+        xSemaphoreGive(g_app_report_lock);
+        return ESP_OK;
+    }
+    return app_report_publish_unlock();
+}
+
+static void app_report_timer_cb(TimerHandle_t timer)
+{
+    // The MQTT publish needs more stack than the timer task has, the actuator task does it
+    if (app_actuator_request_flush() != ESP_OK)
+        app_report_flush();
+}
+
+esp_err_t app_report_flush_later(uint32_t delay_ms)
+{
+    // A running timer is left alone, so a burst is published at most delay_ms after it started
+    if (xTimerIsTimerActive(g_app_report_timer))
+        return ESP_OK;
+    TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+    if (xTimerChangePeriod(g_app_report_timer, ticks ? ticks : 1, 0) != pdPASS)
+        return app_report_flush();
+    return ESP_OK;
+}
+
+void app_report_begin(void)
+{
+    xSemaphoreTake(g_app_report_lock, portMAX_DELAY);
+    g_app_report_hold++;
+    xSemaphoreGive(g_app_report_lock);
+}
+
+void app_report_end(void)
+{
+    xSemaphoreTake(g_app_report_lock, portMAX_DELAY);
+    if (g_app_report_hold)
+        g_app_report_hold--;
+    if (!g_app_report_hold && g_app_report_flush_held)
+    {
+        app_report_publish_unlock();
+        return;
+    }
+    xSemaphoreGive(g_app_report_lock);
+}
+
+void app_report_get_stats(app_report_stats_t *stats)
+{
+    xSemaphoreTake(g_app_report_lock, portMAX_DELAY);
+    *stats = g_app_report_stats;
+    xSemaphoreGive(g_app_report_lock);
+}
+
+esp_err_t app_report_init(void)
+{
+    g_app_report_lock = xSemaphoreCreateMutex();
+    if (!g_app_report_lock)
+    {
+        ESP_LOGE(TAG, "Could not create report lock");
+        return ESP_ERR_NO_MEM;
+    }
+    g_app_report_timer = xTimerCreate("app_report_tm", 1, pdFALSE, NULL, app_report_timer_cb);
+    if (!g_app_report_timer)
+    {
+        ESP_LOGE(TAG, "Could not create report timer");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_rmaker_core.h>
+
+/* Outbound param reports go through a shadow of the last reported value per
+ * param. A report that repeats the shadow is dropped; a new value is staged
+ * with esp_rmaker_param_update() and published with every other staged value
+ * on the next flush, so a cloud write echo and its side effects leave as one
+ * MQTT message.
+ *
+ * Between app_report_begin() and app_report_end() flushes are held back and
+ * done once at the end, so a write callback can stage its echo after the
+ * actuator has already picked up the command.
+ */
+typedef struct
+{
+    uint32_t requested;  // Reports asked for
+    uint32_t suppressed; // Reports dropped because the value was already reported
+    uint32_t staged;     // Values passed on to RainMaker
+    uint32_t publishes;  // Calls to esp_rmaker_report_updated_params()
+} app_report_stats_t;
+
+esp_err_t app_report_init(void);
+esp_err_t app_report_param(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val);
+esp_err_t app_report_flush(void);
+// Flush from the actuator task once delay_ms after the first call, later calls in between are coalesced into it
+esp_err_t app_report_flush_later(uint32_t delay_ms);
+void app_report_begin(void);
+void app_report_end(void);
+void app_report_get_stats(app_report_stats_t *stats);
\ No newline at end of file
@@ -0,0 +1,167 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <app_tasks.h>
+
+#define APP_TASKS_STATS_MAX 48
+
+static const app_task_placement_t g_app_tasks[APP_TASK_MAX] = {
+    [APP_TASK_RENDER] = {"rgbpixel_render", APP_TASK_CORE(CONFIG_APP_TASK_RENDER_CORE),
+                         CONFIG_APP_TASK_RENDER_PRIORITY, CONFIG_APP_TASK_RENDER_STACK},
+    [APP_TASK_ACTUATOR] = {"app_actuator", APP_TASK_CORE(CONFIG_APP_TASK_ACTUATOR_CORE),
+                           CONFIG_APP_TASK_ACTUATOR_PRIORITY, CONFIG_APP_TASK_ACTUATOR_STACK},
+    [APP_TASK_BUTTON] = {"app_button", APP_TASK_CORE(CONFIG_APP_TASK_BUTTON_CORE),
+                         CONFIG_APP_TASK_BUTTON_PRIORITY, CONFIG_APP_TASK_BUTTON_STACK},
+    [APP_TASK_SENSORS] = {"app_sensors", APP_TASK_CORE(CONFIG_APP_TASK_SENSORS_CORE),
+                          CONFIG_APP_TASK_SENSORS_PRIORITY, CONFIG_APP_TASK_SENSORS_STACK},
+    [APP_TASK_WIFI_RECONNECT] = {"wifi_reconnect", APP_TASK_CORE(CONFIG_APP_TASK_WIFI_RECONNECT_CORE),
+                                 CONFIG_APP_TASK_WIFI_RECONNECT_PRIORITY, CONFIG_APP_TASK_WIFI_RECONNECT_STACK},
+    [APP_TASK_LOG] = {"app_log", APP_TASK_CORE(CONFIG_APP_TASK_LOG_CORE), CONFIG_APP_TASK_LOG_PRIORITY,
+                      CONFIG_APP_TASK_LOG_STACK},
+};
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// Run time of each task at the previous report, to print the share since then
+typedef struct
+{
+    TaskHandle_t handle;
+    uint32_t run_time;
+} app_tasks_sample_t;
+
+static app_tasks_sample_t g_app_tasks_samples[APP_TASKS_STATS_MAX];
+static UBaseType_t g_app_tasks_sample_count;
+static uint32_t g_app_tasks_total_time;
+#endif
+static esp_timer_handle_t g_app_tasks_report_timer;
+
+static const char *TAG = "app_tasks";
+
+const app_task_placement_t *app_task_placement(app_task_t task)
+{
+    return task < APP_TASK_MAX ? &g_app_tasks[task] : NULL;
+}
+
+esp_err_t app_task_create(app_task_t task, TaskFunction_t function, void *arg, TaskHandle_t *handle)
+{
+    const app_task_placement_t *placement = app_task_placement(task);
+    if (!placement)
+        return ESP_ERR_INVALID_ARG;
+
+    BaseType_t ret = xTaskCreatePinnedToCore(function, placement->name, placement->stack, arg,
+                                             placement->priority, handle, placement->core);
+    if (ret != pdPASS)
+    {
+        ESP_LOGE(TAG, "Could not create task %s", placement->name);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGD(TAG, "%s: core %d, priority %u, stack %u", placement->name, (int)placement->core,
+             (unsigned int)placement->priority, (unsigned int)placement->stack);
+    return ESP_OK;
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+static uint32_t app_tasks_previous_run_time(TaskHandle_t handle)
+{
+    for (UBaseType_t i = 0; i < g_app_tasks_sample_count; i++)
+    {
+        if (g_app_tasks_samples[i].handle == handle)
+            return g_app_tasks_samples[i].run_time;
+    }
+    return 0;
+}
+
+void app_tasks_log_stats(void)
+{
+    UBaseType_t count = uxTaskGetNumberOfTasks() + 2; // Room for tasks created meanwhile
+    TaskStatus_t *tasks = calloc(count, sizeof(TaskStatus_t));
+    if (!tasks)
+    {
+        ESP_LOGW(TAG, "No memory for task stats");
+        return;
+    }
+    uint32_t total_time;
+    count = uxTaskGetSystemState(tasks, count, &total_time);
+
+    // The run time counter advances on every core at once
+    uint64_t elapsed = (uint64_t)(total_time - g_app_tasks_total_time) * portNUM_PROCESSORS;
+    ESP_LOGI(TAG, "CPU share of %u tasks since the last report:", (unsigned int)count);
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t *task = &tasks[i];
+        uint32_t run_time = task->ulRunTimeCounter - app_tasks_previous_run_time(task->xHandle);
+        uint32_t permille = elapsed ? (uint32_t)(run_time * 1000ULL / elapsed) : 0;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        int core = task->xCoreID == tskNO_AFFINITY ? -1 : (int)task->xCoreID;
+#else
+        int core = -1;
+#endif
+        ESP_LOGI(TAG, "%-16s core %2d prio %2u %3u.%u%%, stack free %u", task->pcTaskName, core,
+                 (unsigned int)task->uxCurrentPriority, permille / 10, permille % 10,
+                 (unsigned int)task->usStackHighWaterMark);
+    }
+
+    g_app_tasks_sample_count = count < APP_TASKS_STATS_MAX ? count : APP_TASKS_STATS_MAX;
+    for (UBaseType_t i = 0; i < g_app_tasks_sample_count; i++)
+    {
+        g_app_tasks_samples[i].handle = tasks[i].xHandle;
+        g_app_tasks_samples[i].run_time = tasks[i].ulRunTimeCounter;
+    }
+    g_app_tasks_total_time = total_time;
+    free(tasks);
+}
+#else
+void app_tasks_log_stats(void)
+{
+    ESP_LOGW(TAG, "Task stats need FREERTOS_USE_TRACE_FACILITY and FREERTOS_GENERATE_RUN_TIME_STATS");
+}
+#endif
+
+static void app_tasks_report(void *arg)
+{
+    app_tasks_log_stats();
+}
+
+esp_err_t app_tasks_init(void)
+{
+    if (CONFIG_APP_TASKS_REPORT_PERIOD == 0)
+        return ESP_OK;
+    const esp_timer_create_args_t timer_args = {
+        .callback = app_tasks_report,
+        .name = "app_tasks",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &g_app_tasks_report_timer);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not create report timer");
+        return err;
+    }
+    return esp_timer_start_periodic(g_app_tasks_report_timer, CONFIG_APP_TASKS_REPORT_PERIOD * 1000000ULL);
+}
\ No newline at end of file
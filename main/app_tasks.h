@@ -0,0 +1,72 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/* Placement of every long-lived application task. The Wi-Fi driver and
+ * LwIP run on APP_TASKS_NET_CORE; the LED render, actuator and button tasks
+ * default to the other core so that network bursts do not show up as
+ * animation jitter or command latency. Each entry can be overridden from
+ * menuconfig.
+ */
+#if CONFIG_ESP32_WIFI_TASK_PINNED_TO_CORE_1
+#define APP_TASKS_NET_CORE 1
+#else
+#define APP_TASKS_NET_CORE 0
+#endif
+
+// Core from a Kconfig value, -1 or a core this chip does not have meaning either
+#define APP_TASK_CORE(core) ((core) < 0 || (core) >= portNUM_PROCESSORS ? tskNO_AFFINITY : (BaseType_t)(core))
+
+typedef enum
+{
+    APP_TASK_RENDER,
+    APP_TASK_ACTUATOR,
+    APP_TASK_BUTTON,
+    APP_TASK_SENSORS,
+    APP_TASK_WIFI_RECONNECT,
+    APP_TASK_LOG,
+    APP_TASK_MAX,
+} app_task_t;
+
+typedef struct
+{
+    const char *name;
+    BaseType_t core; // Or tskNO_AFFINITY
+    UBaseType_t priority;
+    uint32_t stack;
+} app_task_placement_t;
+
+const app_task_placement_t *app_task_placement(app_task_t task);
+esp_err_t app_task_create(app_task_t task, TaskFunction_t function, void *arg, TaskHandle_t *handle);
+esp_err_t app_tasks_init(void);
+void app_tasks_log_stats(void);
\ No newline at end of file
@@ -0,0 +1,255 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sdkconfig.h>
+
+#if CONFIG_APP_TRACE
+
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include <app_trace.h>
+
+#define APP_TRACE_RING_SIZE CONFIG_APP_TRACE_RING_SIZE
+#define APP_TRACE_INFLIGHT 64     // Writes followed from receipt to output at the same time, power of two
+#define APP_TRACE_DUMP_RECORDS 8  // Records per dump line
+#define APP_TRACE_RECORD_BYTES 12
+
+_Static_assert((APP_TRACE_RING_SIZE & (APP_TRACE_RING_SIZE - 1)) == 0, "Trace ring size must be a power of two");
+
+/* A writer claims a position with one atomic add, so trace points may be hit
+ * from any task or ISR. The sequence is cleared while the record is written
+ * and set to position + 1 once it is complete; a dump copies the record and
+ * keeps it only when the sequence is the same before and after.
+ */
+typedef struct
+{
+    atomic_uint sequence;
+    uint32_t time_us;
+    uint16_t id;
+    uint8_t point;
+    uint8_t source;
+} app_trace_record_t;
+
+typedef struct
+{
+    atomic_uint id; // APP_TRACE_NONE when free
+    uint8_t source;
+    int64_t start_us;
+} app_trace_inflight_t;
+
+static app_trace_record_t g_app_trace_ring[APP_TRACE_RING_SIZE];
+static atomic_uint g_app_trace_head;
+static atomic_uint g_app_trace_next_id;
+static app_trace_inflight_t g_app_trace_inflight[APP_TRACE_INFLIGHT];
+static atomic_uint g_app_trace_histogram[APP_TRACE_SOURCES][APP_TRACE_HISTOGRAM_BUCKETS];
+static esp_timer_handle_t g_app_trace_timer;
+
+static const char *TAG = "app_trace";
+
+static const char *const g_app_trace_source_names[APP_TRACE_SOURCES] = {
+    [ESP_RMAKER_REQ_SRC_INIT] = "init",
+    [ESP_RMAKER_REQ_SRC_CLOUD] = "cloud",
+    [ESP_RMAKER_REQ_SRC_SCHEDULE] = "schedule",
+    [ESP_RMAKER_REQ_SRC_SCENE_ACTIVATE] = "scene on",
+    [ESP_RMAKER_REQ_SRC_SCENE_DEACTIVATE] = "scene off",
+    [ESP_RMAKER_REQ_SRC_LOCAL] = "local",
+    [APP_TRACE_SOURCE_DEVICE] = "device",
+};
+
+static void IRAM_ATTR app_trace_record(uint16_t id, app_trace_point_t point, uint8_t source, int64_t now)
+{
+    unsigned int position = atomic_fetch_add_explicit(&g_app_trace_head, 1, memory_order_relaxed);
+    app_trace_record_t *record = &g_app_trace_ring[position & (APP_TRACE_RING_SIZE - 1)];
+    atomic_store_explicit(&record->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record->time_us = (uint32_t)now;
+    record->id = id;
+    record->point = point;
+    record->source = source;
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+static uint8_t IRAM_ATTR app_trace_bucket(uint32_t latency_us)
+{
+    uint32_t ms = latency_us / 1000;
+    uint8_t bucket = ms ? 32 - __builtin_clz(ms) : 0;
+    return bucket < APP_TRACE_HISTOGRAM_BUCKETS ? bucket : APP_TRACE_HISTOGRAM_BUCKETS - 1;
+}
+
+uint16_t app_trace_begin(uint8_t source)
+{
+    if (source >= APP_TRACE_SOURCES)
+        source = APP_TRACE_SOURCE_DEVICE;
+    uint16_t id;
+    do
+    {
+        id = (uint16_t)atomic_fetch_add_explicit(&g_app_trace_next_id, 1, memory_order_relaxed);
+    } while (id == APP_TRACE_NONE);
+
+    int64_t now = esp_timer_get_time();
+    app_trace_inflight_t *inflight = &g_app_trace_inflight[id & (APP_TRACE_INFLIGHT - 1)];
+    // An entry still in use belongs to a write that never reached the hardware, it is replaced
+    atomic_store_explicit(&inflight->id, APP_TRACE_NONE, memory_order_relaxed);
+    inflight->source = source;
+    inflight->start_us = now;
+    atomic_store_explicit(&inflight->id, id, memory_order_release);
+    app_trace_record(id, APP_TRACE_RECEIVED, source, now);
+    return id;
+}
+
+void IRAM_ATTR app_trace_point(uint16_t id, app_trace_point_t point)
+{
+    if (id == APP_TRACE_NONE)
+        return;
+    int64_t now = esp_timer_get_time();
+    app_trace_inflight_t *inflight = &g_app_trace_inflight[id & (APP_TRACE_INFLIGHT - 1)];
+    bool tracked = atomic_load_explicit(&inflight->id, memory_order_acquire) == id;
+    uint8_t source = tracked ? inflight->source : APP_TRACE_SOURCES;
+    app_trace_record(id, point, source, now);
+
+    // Only the first output of a write counts towards the latency
+    unsigned int expected = id;
+    if (point == APP_TRACE_OUTPUT && tracked &&
+        atomic_compare_exchange_strong_explicit(&inflight->id, &expected, APP_TRACE_NONE,
+                                                memory_order_relaxed, memory_order_relaxed))
+    {
+        uint8_t bucket = app_trace_bucket(now - inflight->start_us);
+        atomic_fetch_add_explicit(&g_app_trace_histogram[source][bucket], 1, memory_order_relaxed);
+    }
+}
+
+void app_trace_get_histogram(uint8_t source, uint32_t counts[APP_TRACE_HISTOGRAM_BUCKETS])
+{
+    for (uint8_t i = 0; i < APP_TRACE_HISTOGRAM_BUCKETS; i++)
+    {
+        counts[i] = source < APP_TRACE_SOURCES ? atomic_load_explicit(&g_app_trace_histogram[source][i], memory_order_relaxed) : 0;
+    }
+}
+
+void app_trace_log_histograms(void)
+{
+    for (uint8_t source = 0; source < APP_TRACE_SOURCES; source++)
+    {
+        uint32_t counts[APP_TRACE_HISTOGRAM_BUCKETS];
+        app_trace_get_histogram(source, counts);
+        uint32_t total = 0;
+        char line[APP_TRACE_HISTOGRAM_BUCKETS * 11 + 1];
+        int length = 0;
+        for (uint8_t i = 0; i < APP_TRACE_HISTOGRAM_BUCKETS; i++)
+        {
+            total += counts[i];
+            length += snprintf(line + length, sizeof(line) - length, " %u", counts[i]);
+        }
+        if (total)
+        {
+            // Columns are <1, <2, <4 ... <1024 ms and slower
+            ESP_LOGI(TAG, "%-9s %u commands:%s", g_app_trace_source_names[source], total, line);
+        }
+    }
+}
+
+static void app_trace_put_le32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+/* Log the ring oldest record first as "R <hex>" lines, records that were
+ * being overwritten during the dump are left out.
+ */
+void app_trace_dump(void)
+{
+    unsigned int head = atomic_load_explicit(&g_app_trace_head, memory_order_acquire);
+    unsigned int start = head > APP_TRACE_RING_SIZE ? head - APP_TRACE_RING_SIZE : 0;
+    char line[APP_TRACE_DUMP_RECORDS * APP_TRACE_RECORD_BYTES * 2 + 1];
+    uint8_t count = 0;
+    ESP_LOGI(TAG, "Dump of %u records", head - start);
+    for (unsigned int position = start; position != head; position++)
+    {
+        app_trace_record_t *slot = &g_app_trace_ring[position & (APP_TRACE_RING_SIZE - 1)];
+        uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        uint32_t time_us = slot->time_us;
+        uint16_t id = slot->id;
+        uint8_t point = slot->point;
+        uint8_t source = slot->source;
+        atomic_thread_fence(memory_order_acquire);
+        if (sequence != position + 1 || atomic_load_explicit(&slot->sequence, memory_order_relaxed) != sequence)
+            continue;
+
+        uint8_t bytes[APP_TRACE_RECORD_BYTES];
+        app_trace_put_le32(&bytes[0], position);
+        app_trace_put_le32(&bytes[4], time_us);
+        bytes[8] = id;
+        bytes[9] = id >> 8;
+        bytes[10] = point;
+        bytes[11] = source;
+        for (uint8_t i = 0; i < APP_TRACE_RECORD_BYTES; i++)
+        {
+            sprintf(&line[(count * APP_TRACE_RECORD_BYTES + i) * 2], "%02x", bytes[i]);
+        }
+        if (++count == APP_TRACE_DUMP_RECORDS)
+        {
+            ESP_LOGI(TAG, "R %s", line);
+            count = 0;
+        }
+    }
+    if (count)
+        ESP_LOGI(TAG, "R %s", line);
+}
+
+static void app_trace_report(void *arg)
+{
+    app_trace_log_histograms();
+    app_trace_dump();
+}
+
+esp_err_t app_trace_init(void)
+{
+    atomic_init(&g_app_trace_next_id, 1);
+    if (CONFIG_APP_TRACE_REPORT_PERIOD == 0)
+        return ESP_OK;
+    const esp_timer_create_args_t timer_args = {
+        .callback = app_trace_report,
+        .name = "app_trace",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &g_app_trace_timer);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not create report timer");
+        return err;
+    }
+    return esp_timer_start_periodic(g_app_trace_timer, CONFIG_APP_TRACE_REPORT_PERIOD * 1000000ULL);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,77 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_rmaker_core.h>
+#include <sdkconfig.h>
+
+/* Command latency tracing. A write gets a correlation id when it is received
+ * and each stage it passes appends a 12 byte record to a lock-free ring:
+ *
+ *     uint32_t sequence, uint32_t time_us, uint16_t id, uint8_t point, uint8_t source
+ *
+ * little endian, as dumped in hex by app_trace_dump() and read back by
+ * tools/trace_decode.py. Receive to output latency also goes into one log2
+ * histogram per request source.
+ */
+#define APP_TRACE_NONE 0
+
+typedef enum
+{
+    APP_TRACE_RECEIVED,   // write_cb entry
+    APP_TRACE_QUEUED,     // Accepted by the actuator queue
+    APP_TRACE_DISPATCHED, // Taken by the actuator task for a hardware update
+    APP_TRACE_OUTPUT,     // Relay GPIO written or first RGB frame transmitted
+    APP_TRACE_REPORTED,   // Echo published
+    APP_TRACE_POINT_MAX,
+} app_trace_point_t;
+
+// RainMaker request sources, followed by changes made on the device itself
+#define APP_TRACE_SOURCE_DEVICE ESP_RMAKER_REQ_SRC_MAX
+#define APP_TRACE_SOURCES (APP_TRACE_SOURCE_DEVICE + 1)
+
+// Bucket n counts latencies from 2^(n-1) up to 2^n ms, the last one everything slower
+#define APP_TRACE_HISTOGRAM_BUCKETS 12
+
+#if CONFIG_APP_TRACE
+esp_err_t app_trace_init(void);
+uint16_t app_trace_begin(uint8_t source);
+void app_trace_point(uint16_t id, app_trace_point_t point);
+void app_trace_get_histogram(uint8_t source, uint32_t counts[APP_TRACE_HISTOGRAM_BUCKETS]);
+void app_trace_log_histograms(void);
+void app_trace_dump(void);
+#else
+static inline esp_err_t app_trace_init(void) { return ESP_OK; }
+static inline uint16_t app_trace_begin(uint8_t source) { return APP_TRACE_NONE; }
+static inline void app_trace_point(uint16_t id, app_trace_point_t point) {}
+static inline void app_trace_get_histogram(uint8_t source, uint32_t counts[APP_TRACE_HISTOGRAM_BUCKETS]) {}
+static inline void app_trace_log_histograms(void) {}
+static inline void app_trace_dump(void) {}
+#endif
\ No newline at end of file
@@ -25,347 +25,678 @@
  * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <esp_crc.h>
 #include <esp_log.h>
 #include <esp_rmaker_standard_params.h>
 #include <esp_rmaker_standard_types.h>
+#include <esp_timer.h>
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/timers.h>
-#include <driver/rmt.h>
-#include <led_strip.h>
+#include <freertos/task.h>
+#include <stdlib.h>
 #include <string.h>
+#include <app_log.h>
+#include <app_report.h>
+#include <app_trace.h>
+#include <app_pm.h>
+#include <app_tasks.h>
 #include <rgbpixel.h>
+#include <rgbpixel_color.h>
+#include <rgbpixel_effects.h>
+#include <rgbpixel_output.h>
 
-#define RMT_TX_CHANNEL RMT_CHANNEL_0
-#define RGBPIXEL_STRIP_GPIO CONFIG_RGBPIXEL_STRIP_OUTPUT_GPIO
-
-#define DEFAULT_RGBPIXEL_STRIP_PIXELS 24
 #define DEFAULT_RGBPIXEL_POWER_STATE false
 #define DEFAULT_RGBPIXEL_HUE 180
 #define DEFAULT_RGBPIXEL_SATURATION 100
 #define DEFAULT_RGBPIXEL_BRIGHTNESS 15
-#define DEFAULT_REFRESH_ANIM_PERIOD_RGBPIXEL 40 // Miliseconds
 #define DEFAULT_ANIM_DURATION_RGBPIXEL 3 // Seconds
 
-static led_strip_t *g_rgbpixel_strip;
-
-static TimerHandle_t rgbpixel_anim_timer;
-static TimerHandle_t rgbpixel_anim_duration_timer;
-static bool g_rgbpixel_power_state = DEFAULT_RGBPIXEL_POWER_STATE;
-static uint16_t g_rgbpixel_hue = DEFAULT_RGBPIXEL_HUE;
-static uint16_t g_rgbpixel_saturation = DEFAULT_RGBPIXEL_SATURATION;
-static uint16_t g_rgbpixel_value = DEFAULT_RGBPIXEL_BRIGHTNESS;
-static uint8_t g_rgbpixel_strip_pixels = DEFAULT_RGBPIXEL_STRIP_PIXELS;
-
-bool rgbpixel_anim_up = true;
-uint8_t rgbpixel_anim_counter = 0;
-uint8_t rgbpixel_anim_style = 0;
-uint32_t rgbpixel_pulse_blue_min;
-uint32_t rgbpixel_pulse_blue_max;
-uint32_t rgbpixel_pulse_red_min;
-uint32_t rgbpixel_pulse_red_max;
-uint32_t rgbpixel_pulse_green_min;
-uint32_t rgbpixel_pulse_green_max;
-uint32_t rgbpixel_pulse_purple_min;
-uint32_t rgbpixel_pulse_purple_max;
-uint32_t rgbpixel_spin_blue_bg;
-uint32_t rgbpixel_spin_blue_fg;
-uint32_t rgbpixel_spin_orange_bg;
-uint32_t rgbpixel_spin_orange_fg;
-
-static const char *TAG = "rgbpixel";
+#define RGBPIXEL_TX_TIMEOUT_MS 100
+#define RGBPIXEL_FRAME_PERIOD_US (1000000LL / CONFIG_RGBPIXEL_FRAME_RATE)
+// Changes arriving within one frame of a transition start join that transition
+#define RGBPIXEL_TRANSITION_MERGE_US RGBPIXEL_FRAME_PERIOD_US
+#define RGBPIXEL_DUMP_MAX_PIXELS 120
 
-static void rgbpixel_color_hsv2rgb(uint32_t hue, uint32_t saturation, uint32_t brightness, uint32_t *red, uint32_t *green, uint32_t *blue)
+typedef struct
 {
-    hue %= 360; // hue -> [0,360]
-    uint32_t rgb_max = brightness * 2.55f;
-    uint32_t rgb_min = rgb_max * (100 - saturation) / 100.0f;
-
-    uint32_t quadrant = hue / 60;
-    uint32_t diff = hue % 60;
-
-    // RGB adjustment amount by hue
-    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+    uint16_t hue;
+    uint16_t saturation;
+    uint16_t value;
+} rgbpixel_hsv_t;
 
-    switch (quadrant)
-    {
-    case 0:
-        *red = rgb_max;
-        *green = rgb_min + rgb_adj;
-        *blue = rgb_min;
-        break;
-    case 1:
-        *red = rgb_max - rgb_adj;
-        *green = rgb_max;
-        *blue = rgb_min;
-        break;
-    case 2:
-        *red = rgb_min;
-        *green = rgb_max;
-        *blue = rgb_min + rgb_adj;
-        break;
-    case 3:
-        *red = rgb_min;
-        *green = rgb_max - rgb_adj;
-        *blue = rgb_max;
-        break;
-    case 4:
-        *red = rgb_min + rgb_adj;
-        *green = rgb_min;
-        *blue = rgb_max;
-        break;
-    default:
-        *red = rgb_max;
-        *green = rgb_min;
-        *blue = rgb_max - rgb_adj;
-        break;
-    }
-}
-
-uint32_t rgbpixel_color_rgb(uint8_t red, uint8_t green, uint8_t blue)
+typedef struct
 {
-    return ((uint32_t)red << 16) | ((uint32_t)green << 8) | blue;
-}
+    int gpio;
+    uint16_t pixels;
+} rgbpixel_segment_config_t;
+
+static const rgbpixel_segment_config_t g_rgbpixel_segment_config[RGBPIXEL_SEGMENTS] = {
+    {CONFIG_RGBPIXEL_STRIP_OUTPUT_GPIO, CONFIG_RGBPIXEL_STRIP_PIXELS},
+#if RGBPIXEL_SEGMENTS > 1
+    {CONFIG_RGBPIXEL_SEGMENT_1_OUTPUT_GPIO, CONFIG_RGBPIXEL_SEGMENT_1_PIXELS},
+#endif
+#if RGBPIXEL_SEGMENTS > 2
+    {CONFIG_RGBPIXEL_SEGMENT_2_OUTPUT_GPIO, CONFIG_RGBPIXEL_SEGMENT_2_PIXELS},
+#endif
+#if RGBPIXEL_SEGMENTS > 3
+    {CONFIG_RGBPIXEL_SEGMENT_3_OUTPUT_GPIO, CONFIG_RGBPIXEL_SEGMENT_3_PIXELS},
+#endif
+};
+
+typedef struct
+{
+    uint8_t index;
+    uint16_t pixels;
+    bool power_state;
+    uint16_t hue;
+    uint16_t saturation;
+    uint16_t value;
+    // Colour on the strip, it follows hue/saturation/value through a transition
+    rgbpixel_hsv_t shown;
+    rgbpixel_hsv_t transition_from;
+    int64_t transition_start_us;
+    uint32_t transition_us;
+    bool transitioning;
+    // Light effect selected from the phone app, NULL for a static colour
+    const rgbpixel_effect_t *effect;
+    uint32_t effect_frame;
+    bool dirty;         // Static colour or power changed since the last static frame
+    // Frame N+1 is built into one buffer while the output is still sending frame N from the other
+    uint8_t *frames[2];
+    uint8_t *frame;
+    bool frame_sent;    // Other buffer holds what is currently shown on the strip
+    uint16_t trace;     // Traced update waiting for its first frame
+    volatile uint16_t trace_tx; // Traced update in the frame being transmitted
+} rgbpixel_segment_t;
+
+static rgbpixel_segment_t g_rgbpixel_segments[RGBPIXEL_SEGMENTS];
+static uint32_t *g_rgbpixel_pixels; // Effect output, shared by all segments
+static TaskHandle_t g_rgbpixel_render_task;
+static portMUX_TYPE g_rgbpixel_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile int64_t g_rgbpixel_tx_start_us;
+static rgbpixel_stats_t g_rgbpixel_stats;
+
+// Status animation started by the application, played on every segment over the light effect
+static const rgbpixel_effect_t *g_rgbpixel_anim;
+static bool g_rgbpixel_anim_run_once;
+static int64_t g_rgbpixel_anim_end_us;
+static uint32_t g_rgbpixel_anim_frame;
+
+static const char *TAG = "rgbpixel";
 
-esp_err_t rgbpixel_set_pixel(uint16_t pixel, uint32_t rgb_color)
+static inline void rgbpixel_write_pixel(uint8_t *frame, uint16_t pixel, uint32_t rgb_color)
 {
-    uint8_t red = (uint8_t)(rgb_color >> 16);
-    uint8_t green = (uint8_t)(rgb_color >> 8);
-    uint8_t blue = (uint8_t)rgb_color;
-    red = red * g_rgbpixel_value * 0.01f;
-    green = green * g_rgbpixel_value * 0.01f;
-    blue = blue * g_rgbpixel_value * 0.01f;
-    g_rgbpixel_strip->set_pixel(g_rgbpixel_strip, pixel, red, green, blue);
-    return ESP_OK;
+    // WS2812 expects green, red, blue
+    uint8_t *p = &frame[pixel * 3];
+    p[0] = (uint8_t)(rgb_color >> 8);
+    p[1] = (uint8_t)(rgb_color >> 16);
+    p[2] = (uint8_t)rgb_color;
 }
 
-static esp_err_t rgbpixel_set_pixels(uint32_t hue, uint32_t saturation, uint32_t brightness)
+static void rgbpixel_fill_static(rgbpixel_segment_t *segment)
 {
     uint32_t red = 0;
     uint32_t green = 0;
     uint32_t blue = 0;
-    g_rgbpixel_hue = hue;
-    g_rgbpixel_saturation = saturation;
-    g_rgbpixel_value = brightness;
+    if (segment->power_state)
+    {
+        rgbpixel_color_hsv2rgb(segment->shown.hue, segment->shown.saturation, segment->shown.value, &red, &green, &blue);
+    }
+    uint32_t color = rgbpixel_color_rgb(red, green, blue);
+    for (int i = 0; i < segment->pixels; i++)
+    {
+        rgbpixel_write_pixel(segment->frame, i, color);
+    }
+}
 
-    rgbpixel_color_hsv2rgb(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value, &red, &green, &blue);
-    for (int i = 0; i < g_rgbpixel_strip_pixels; i++)
+static void rgbpixel_render_effect(rgbpixel_segment_t *segment, const rgbpixel_effect_t *effect, uint32_t frame)
+{
+    rgbpixel_effect_params_t params = effect->params;
+    if (effect->use_light_color)
     {
-        g_rgbpixel_strip->set_pixel(g_rgbpixel_strip, i, red, green, blue);
+        uint32_t red, green, blue;
+        rgbpixel_color_hsv2rgb(segment->shown.hue, segment->shown.saturation, 100, &red, &green, &blue);
+        params.color_b = rgbpixel_color_rgb(red, green, blue);
     }
-    g_rgbpixel_strip->refresh(g_rgbpixel_strip, 100);
+    effect->render(g_rgbpixel_pixels, segment->pixels, frame, &params);
 
-    return ESP_OK;
+    uint16_t scale = rgbpixel_color_percent_to_q8(segment->shown.value);
+    for (int i = 0; i < segment->pixels; i++)
+    {
+        rgbpixel_write_pixel(segment->frame, i, rgbpixel_color_scale(g_rgbpixel_pixels[i], scale));
+    }
 }
 
-uint32_t rgbpixel_interpolate(uint32_t color_start, uint32_t color_end, double t)
+// Effect to run on the next frame, NULL when the segment shows a static colour
+static const rgbpixel_effect_t *rgbpixel_active_effect(const rgbpixel_segment_t *segment)
 {
-    uint8_t red = (color_start >> 16 & 0xFF) * (1 - t) + (color_end >> 16 & 0xFF) * t;
-    uint8_t green = (color_start >> 8 & 0xFF) * (1 - t) + (color_end >> 8 & 0xFF) * t;
-    uint8_t blue = (color_start & 0xFF) * (1 - t) + (color_end & 0xFF) * t;
-    return ((uint32_t)red << 16) | ((uint32_t)green << 8) | blue;
+    if (g_rgbpixel_anim)
+        return g_rgbpixel_anim;
+    return segment->power_state ? segment->effect : NULL;
 }
 
-esp_err_t rgbpixel_anim_fill(uint32_t color)
+static bool rgbpixel_is_animating(void)
 {
-    for (int i = 0; i < g_rgbpixel_strip_pixels; i++)
+    for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
     {
-        rgbpixel_set_pixel(i, color);
+        if (rgbpixel_active_effect(&g_rgbpixel_segments[i]) || g_rgbpixel_segments[i].transitioning)
+            return true;
     }
-    return ESP_OK;
+    return false;
 }
 
-esp_err_t rgbpixel_anim_pulse(uint32_t color_start, uint32_t color_end, double ratio, bool up)
+static inline uint16_t rgbpixel_lerp_q8(uint16_t from, uint16_t to, uint16_t t)
 {
-    double t = (up) ? ratio : 1 - ratio;
-    uint32_t c = rgbpixel_interpolate(color_start, color_end, t);
-    rgbpixel_anim_fill(c);
-    return ESP_OK;
+    return from + ((int32_t)(to - from) * t) / RGBPIXEL_Q8_ONE;
 }
 
-esp_err_t rgbpixel_anim_spinner(uint32_t color_bg, uint32_t color_fg, uint8_t position, uint8_t pixel_cnt)
+// Move the shown colour along the running transition, called with the lock held
+static void rgbpixel_transition_step(rgbpixel_segment_t *segment, int64_t now)
 {
-    rgbpixel_anim_fill(color_bg);
-    for (int i = position; i < position + pixel_cnt; i++)
+    int64_t elapsed_us = now - segment->transition_start_us;
+    if (elapsed_us >= segment->transition_us)
     {
-        rgbpixel_set_pixel(i % g_rgbpixel_strip_pixels, color_fg);
+        segment->shown.hue = segment->hue;
+        segment->shown.saturation = segment->saturation;
+        segment->shown.value = segment->value;
+        segment->transitioning = false;
+        // The final colour still has to be drawn
+        segment->dirty = true;
+        return;
     }
-    return ESP_OK;
+    uint16_t t = elapsed_us > 0 ? elapsed_us * RGBPIXEL_Q8_ONE / segment->transition_us : 0;
+    const rgbpixel_hsv_t *from = &segment->transition_from;
+    // Hue goes the short way round the colour wheel
+    int32_t hue_delta = (int32_t)segment->hue - from->hue;
+    if (hue_delta > 180)
+        hue_delta -= 360;
+    else if (hue_delta < -180)
+        hue_delta += 360;
+    int32_t hue = from->hue + hue_delta * t / RGBPIXEL_Q8_ONE;
+    segment->shown.hue = hue < 0 ? hue + 360 : hue % 360;
+    segment->shown.saturation = rgbpixel_lerp_q8(from->saturation, segment->saturation, t);
+    segment->shown.value = rgbpixel_lerp_q8(from->value, segment->value, t);
 }
 
-static void rgbpixel_anim(void *priv)
+static void IRAM_ATTR rgbpixel_tx_end(uint8_t segment)
 {
-    if (rgbpixel_anim_counter <= 23)
-        rgbpixel_anim_counter = rgbpixel_anim_counter + 1;
-    else
-        rgbpixel_anim_counter = 0;
-    if (rgbpixel_anim_counter == 0)
+    // Segments are kicked together, the last one to finish gives the frame transmit time
+    uint32_t tx_time_us = esp_timer_get_time() - g_rgbpixel_tx_start_us;
+    g_rgbpixel_stats.tx_time_us = tx_time_us;
+    if (tx_time_us > g_rgbpixel_stats.tx_time_max_us)
+        g_rgbpixel_stats.tx_time_max_us = tx_time_us;
+    rgbpixel_segment_t *seg = &g_rgbpixel_segments[segment];
+    if (seg->trace_tx)
     {
-        rgbpixel_anim_up = !rgbpixel_anim_up;
+        app_trace_point(seg->trace_tx, APP_TRACE_OUTPUT);
+        seg->trace_tx = APP_TRACE_NONE;
     }
+    app_pm_release(APP_PM_LOCK_OUTPUT);
+}
 
-    // 0.0->1.0 per duration
-    double ratio = rgbpixel_anim_counter * 0.041;
-    if (rgbpixel_anim_style == 0)
+static inline uint8_t *rgbpixel_shown_frame(const rgbpixel_segment_t *segment)
+{
+    return (segment->frame == segment->frames[0]) ? segment->frames[1] : segment->frames[0];
+}
+
+#if CONFIG_RGBPIXEL_FRAME_DUMP
+/* One log line per transmitted frame: the CRC of the GRB bytes, to compare
+ * effect output between builds, and one character per pixel. Space is off,
+ * r/g/b/y/c/m/w the hue, upper case above half brightness.
+ */
+static void rgbpixel_dump_frame(const rgbpixel_segment_t *segment, uint32_t number)
+{
+    static const char names[] = " brmgcyw";
+    char line[RGBPIXEL_DUMP_MAX_PIXELS + 1];
+    uint16_t count = segment->pixels < RGBPIXEL_DUMP_MAX_PIXELS ? segment->pixels : RGBPIXEL_DUMP_MAX_PIXELS;
+    for (uint16_t i = 0; i < count; i++)
     {
-        rgbpixel_anim_spinner(rgbpixel_spin_blue_bg, rgbpixel_spin_blue_fg, rgbpixel_anim_counter, 2);
+        const uint8_t *grb = &segment->frame[i * 3];
+        uint8_t max = grb[0] > grb[1] ? grb[0] : grb[1];
+        max = max > grb[2] ? max : grb[2];
+        // Channels above half of the brightest one take part in the hue
+        uint8_t threshold = max / 2;
+        int index = (grb[1] > threshold ? 4 : 0) | (grb[0] > threshold ? 2 : 0) | (grb[2] > threshold ? 1 : 0);
+        char c = max ? names[index] : ' ';
+        line[i] = max >= 128 ? c - ('a' - 'A') : c;
     }
-    else if (rgbpixel_anim_style == 1)
+    line[count] = '\0';
+    ESP_LOGI(TAG, "seg %d #%u crc %08x |%s|%s", segment->index, number,
+             esp_crc32_le(0, segment->frame, segment->pixels * 3), line, count < segment->pixels ? "..." : "");
+}
+#endif
+
+/* A frame that could not be sent is built again: the segment is marked
+ * dirty, so a static colour is not lost, and the next write re-encodes every
+ * pixel because the output may no longer hold the shown frame.
+ */
+static void rgbpixel_transmit_failed(rgbpixel_segment_t *segment)
+{
+    segment->frame_sent = false;
+    portENTER_CRITICAL(&g_rgbpixel_lock);
+    segment->dirty = true;
+    portEXIT_CRITICAL(&g_rgbpixel_lock);
+}
+
+// Returns false when the frame has to be sent again
+static bool rgbpixel_transmit(rgbpixel_segment_t *segment, uint16_t trace)
+{
+    size_t frame_bytes = segment->pixels * 3;
+    // Identical frames are not retransmitted, the strip latches the last one
+    if (segment->frame_sent && memcmp(segment->frame, rgbpixel_shown_frame(segment), frame_bytes) == 0)
     {
-        rgbpixel_anim_spinner(rgbpixel_spin_orange_bg, rgbpixel_spin_orange_fg, rgbpixel_anim_counter, 6);
+        g_rgbpixel_stats.skipped_frames++;
+        app_trace_point(trace, APP_TRACE_OUTPUT);
+        return true;
     }
-    else if (rgbpixel_anim_style == 2)
+
+    // The output may still be sending the previous frame; it must finish before the buffers swap
+    if (rgbpixel_output_wait(segment->index, pdMS_TO_TICKS(RGBPIXEL_TX_TIMEOUT_MS)) != ESP_OK)
     {
-        rgbpixel_anim_pulse(rgbpixel_pulse_blue_min, rgbpixel_pulse_blue_max, ratio, rgbpixel_anim_up);
+        APP_LOGW(APP_LOG_RGBPIXEL, "Previous frame still transmitting, dropping frame");
+        g_rgbpixel_stats.dropped_frames++;
+        rgbpixel_transmit_failed(segment);
+        return false;
     }
-    else if (rgbpixel_anim_style == 3)
+    uint32_t encoded_pixels = 0;
+    // Set before the write, the transmit may end before it returns
+    segment->trace_tx = trace;
+    // The bit timing comes from the APB clock, it must not scale until the end callback
+    app_pm_acquire(APP_PM_LOCK_OUTPUT);
+    esp_err_t err = rgbpixel_output_write(segment->index, segment->frame,
+                                          segment->frame_sent ? rgbpixel_shown_frame(segment) : NULL, &encoded_pixels);
+    g_rgbpixel_stats.encoded_pixels += encoded_pixels;
+    if (err != ESP_OK)
     {
-        rgbpixel_anim_pulse(rgbpixel_pulse_red_min, rgbpixel_pulse_red_max, ratio, rgbpixel_anim_up);
+        app_pm_release(APP_PM_LOCK_OUTPUT);
+        segment->trace_tx = APP_TRACE_NONE;
+        APP_LOGE(APP_LOG_RGBPIXEL, "Transmit frame failed");
+        rgbpixel_transmit_failed(segment);
+        return false;
     }
-    else if (rgbpixel_anim_style == 4)
+#if CONFIG_RGBPIXEL_FRAME_DUMP
+    rgbpixel_dump_frame(segment, g_rgbpixel_stats.frames);
+#endif
+    g_rgbpixel_stats.frames++;
+    segment->frame_sent = true;
+    segment->frame = rgbpixel_shown_frame(segment);
+    return true;
+}
+
+static TickType_t rgbpixel_ticks_until(int64_t deadline_us)
+{
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    if (remaining_us <= 0)
+        return 0;
+    // Round up so an early wake-up never turns into a busy loop
+    return (remaining_us * configTICK_RATE_HZ + 999999) / 1000000;
+}
+
+_Noreturn static void rgbpixel_render_task(void *priv)
+{
+    int64_t next_frame_us = esp_timer_get_time();
+    bool was_animating = false;
+    bool retry = false;
+    const rgbpixel_effect_t *effects[RGBPIXEL_SEGMENTS];
+    bool dirty[RGBPIXEL_SEGMENTS];
+    bool transitioning[RGBPIXEL_SEGMENTS];
+    uint16_t traces[RGBPIXEL_SEGMENTS];
+
+    for (;;)
     {
-        rgbpixel_anim_pulse(rgbpixel_pulse_green_min, rgbpixel_pulse_green_max, ratio, rgbpixel_anim_up);
+        // Without a running animation nothing ticks, the task sleeps until a state change
+        TickType_t wait = portMAX_DELAY;
+        if (rgbpixel_is_animating())
+            wait = rgbpixel_ticks_until(next_frame_us);
+        else if (retry)
+            wait = rgbpixel_ticks_until(esp_timer_get_time() + RGBPIXEL_FRAME_PERIOD_US);
+        ulTaskNotifyTake(pdTRUE, wait);
+        g_rgbpixel_stats.wakeups++;
+        // Full speed while the frame is built, the CPU scales down again in between
+        app_pm_acquire(APP_PM_LOCK_RENDER);
+
+        int64_t now = esp_timer_get_time();
+        bool anim_ended = false;
+        bool animating = false;
+        portENTER_CRITICAL(&g_rgbpixel_lock);
+        if (g_rgbpixel_anim && g_rgbpixel_anim_run_once && now >= g_rgbpixel_anim_end_us)
+        {
+            g_rgbpixel_anim = NULL;
+            anim_ended = true;
+        }
+        const rgbpixel_effect_t *anim = g_rgbpixel_anim;
+        for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
+        {
+            rgbpixel_segment_t *segment = &g_rgbpixel_segments[i];
+            effects[i] = rgbpixel_active_effect(segment);
+            if (segment->transitioning)
+                rgbpixel_transition_step(segment, now);
+            transitioning[i] = segment->transitioning;
+            traces[i] = segment->trace;
+            dirty[i] = segment->dirty || anim_ended;
+            if (!effects[i] && !transitioning[i])
+                segment->dirty = false;
+            animating |= effects[i] != NULL || transitioning[i];
+        }
+        portEXIT_CRITICAL(&g_rgbpixel_lock);
+
+        if (anim_ended)
+        {
+            APP_LOGI(APP_LOG_RGBPIXEL, "Enhanced rgbpixel animation is ending now");
+        }
+
+        // Coming out of idle nothing was missed, the cadence starts from this frame
+        if (!animating || !was_animating)
+            next_frame_us = now;
+        was_animating = animating;
+        // Woken early by a state change, animated segments keep their cadence
+        bool frame_due = now >= next_frame_us;
+        uint32_t advance = 1;
+        if (animating && frame_due)
+        {
+            // Skip the frame slots that were missed instead of bursting to catch up
+            uint32_t missed = (now - next_frame_us) / RGBPIXEL_FRAME_PERIOD_US;
+            g_rgbpixel_stats.dropped_frames += missed;
+            next_frame_us += (missed + 1) * RGBPIXEL_FRAME_PERIOD_US;
+            advance += missed;
+        }
+
+        int64_t build_start_us = esp_timer_get_time();
+        bool built[RGBPIXEL_SEGMENTS];
+        for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
+        {
+            rgbpixel_segment_t *segment = &g_rgbpixel_segments[i];
+            built[i] = (effects[i] || transitioning[i]) ? frame_due : dirty[i];
+            if (!built[i])
+                continue;
+            if (transitioning[i])
+                g_rgbpixel_stats.transition_frames++;
+            if (!effects[i])
+            {
+                rgbpixel_fill_static(segment);
+            }
+            else if (effects[i] == anim)
+            {
+                rgbpixel_render_effect(segment, anim, g_rgbpixel_anim_frame);
+            }
+            else
+            {
+                rgbpixel_render_effect(segment, effects[i], segment->effect_frame);
+                segment->effect_frame += advance;
+            }
+        }
+        if (anim && frame_due)
+            g_rgbpixel_anim_frame += advance;
+        uint32_t build_time_us = esp_timer_get_time() - build_start_us;
+        g_rgbpixel_stats.build_time_us = build_time_us;
+        if (build_time_us > g_rgbpixel_stats.build_time_max_us)
+            g_rgbpixel_stats.build_time_max_us = build_time_us;
+        if (build_time_us > RGBPIXEL_FRAME_PERIOD_US)
+            g_rgbpixel_stats.overruns++;
+
+        // Kick all segments back to back, their outputs transmit in parallel
+        g_rgbpixel_tx_start_us = esp_timer_get_time();
+        retry = false;
+        for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
+        {
+            if (built[i] && !rgbpixel_transmit(&g_rgbpixel_segments[i], traces[i]))
+            {
+                // The trace waits for the frame that gets through
+                built[i] = false;
+                retry = true;
+            }
+        }
+        // A traced update that came in after the snapshot waits for the next frame
+        portENTER_CRITICAL(&g_rgbpixel_lock);
+        for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
+        {
+            if (built[i] && g_rgbpixel_segments[i].trace == traces[i])
+                g_rgbpixel_segments[i].trace = APP_TRACE_NONE;
+        }
+        portEXIT_CRITICAL(&g_rgbpixel_lock);
+        app_pm_release(APP_PM_LOCK_RENDER);
     }
-    else if (rgbpixel_anim_style == 5)
+}
+
+static void rgbpixel_request_frame(void)
+{
+    if (g_rgbpixel_render_task)
+        xTaskNotifyGive(g_rgbpixel_render_task);
+}
+
+// Move the segment towards a new colour, called with the lock held
+static bool rgbpixel_set_pixels_locked(rgbpixel_segment_t *segment, uint32_t hue, uint32_t saturation, uint32_t brightness,
+                                       uint32_t duration_ms, int64_t now)
+{
+    bool changed = segment->hue != hue || segment->saturation != saturation || segment->value != brightness;
+    if (changed)
     {
-        rgbpixel_anim_pulse(rgbpixel_pulse_purple_min, rgbpixel_pulse_purple_max, ratio, rgbpixel_anim_up);
+        if (duration_ms == 0)
+        {
+            segment->transitioning = false;
+            segment->shown.hue = hue;
+            segment->shown.saturation = saturation;
+            segment->shown.value = brightness;
+        }
+        else if (!segment->transitioning || now - segment->transition_start_us >= RGBPIXEL_TRANSITION_MERGE_US)
+        {
+            // Retarget from wherever the running transition has got to
+            segment->transition_from = segment->shown;
+            segment->transition_start_us = now;
+            segment->transition_us = duration_ms * 1000;
+            segment->transitioning = true;
+        }
+        // else the change joins the transition that has just started
     }
-    g_rgbpixel_strip->refresh(g_rgbpixel_strip, 100);
+    segment->hue = hue;
+    segment->saturation = saturation;
+    segment->value = brightness;
+    segment->dirty |= changed;
+    return changed;
 }
 
-static void rgbpixel_anim_duration(void *priv)
+static bool rgbpixel_set_power_locked(rgbpixel_segment_t *segment, bool power)
 {
-    xTimerStop(rgbpixel_anim_timer, 0);
-    ESP_LOGI(TAG, "Enhanced rgbpixel animation is ending now");
-    if (!g_rgbpixel_power_state)
-        g_rgbpixel_strip->clear(g_rgbpixel_strip, 100);
-    else
-        rgbpixel_set(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value);
+    bool changed = segment->power_state != power;
+    segment->power_state = power;
+    segment->dirty |= changed;
+    return changed;
 }
 
-esp_err_t rgbpixel_start_anim(uint8_t anim_style, bool run_once)
+static bool rgbpixel_set_effect_locked(rgbpixel_segment_t *segment, const rgbpixel_effect_t *effect)
 {
-    rgbpixel_anim_style = anim_style;
-    if (!xTimerIsTimerActive(rgbpixel_anim_timer)) {
-		xTimerStart(rgbpixel_anim_timer, 0);
-    }
-    if (xTimerIsTimerActive(rgbpixel_anim_duration_timer)) {
-        xTimerStop(rgbpixel_anim_duration_timer, 0);
-    }
-    if (run_once) {
-		 xTimerStart(rgbpixel_anim_duration_timer, 0);
+    bool changed = segment->effect != effect;
+    if (changed)
+        segment->effect_frame = 0;
+    segment->effect = effect;
+    segment->dirty |= changed;
+    return changed;
+}
+
+static esp_err_t rgbpixel_lookup_effect(const char *name, const rgbpixel_effect_t **effect)
+{
+    *effect = NULL;
+    if (strcmp(name, RGBPIXEL_EFFECT_NONE_NAME) == 0)
+        return ESP_OK;
+    *effect = rgbpixel_effect_find(name);
+    if (!*effect)
+    {
+        ESP_LOGW(TAG, "Unknown effect %s", name);
+        return ESP_ERR_NOT_FOUND;
     }
     return ESP_OK;
 }
 
-esp_err_t app_driver_rgbpixel_init(void)
+esp_err_t rgbpixel_start_anim(rgbpixel_effect_id_t anim, bool run_once)
+{
+    const rgbpixel_effect_t *effect = rgbpixel_effect_get(anim);
+    if (!effect)
+        return ESP_ERR_INVALID_ARG;
+    portENTER_CRITICAL(&g_rgbpixel_lock);
+    if (g_rgbpixel_anim != effect)
+        g_rgbpixel_anim_frame = 0;
+    g_rgbpixel_anim = effect;
+    g_rgbpixel_anim_run_once = run_once;
+    g_rgbpixel_anim_end_us = esp_timer_get_time() + DEFAULT_ANIM_DURATION_RGBPIXEL * 1000000LL;
+    portEXIT_CRITICAL(&g_rgbpixel_lock);
+    rgbpixel_request_frame();
+    return ESP_OK;
+}
+
+/* Apply several changes to a segment at once, so the render task sees them
+ * together and draws one frame. A colour change without an explicit power
+ * state turns the segment on.
+ */
+esp_err_t rgbpixel_update(uint8_t segment, const rgbpixel_update_t *update)
 {
-    rgbpixel_spin_blue_bg = rgbpixel_color_rgb(0, 0, 255);
-    rgbpixel_spin_blue_fg = rgbpixel_color_rgb(0, 255, 255);
-    rgbpixel_spin_orange_bg = rgbpixel_color_rgb(0, 0, 0);
-    rgbpixel_spin_orange_fg = rgbpixel_color_rgb(255, 80, 0);
-    rgbpixel_pulse_blue_min = rgbpixel_color_rgb(0, 0, 255);
-    rgbpixel_pulse_blue_max = rgbpixel_color_rgb(0, 255, 255);
-    rgbpixel_pulse_red_min = rgbpixel_color_rgb(40, 17, 0);
-    rgbpixel_pulse_red_max = rgbpixel_color_rgb(255, 17, 0);
-    rgbpixel_pulse_green_min = rgbpixel_color_rgb(0, 17, 0);
-    rgbpixel_pulse_green_max = rgbpixel_color_rgb(0, 255, 0);
-    rgbpixel_pulse_purple_min = rgbpixel_color_rgb(40, 0, 50);
-    rgbpixel_pulse_purple_max = rgbpixel_color_rgb(200, 0, 255);
-
-    rmt_config_t config = RMT_DEFAULT_CONFIG_TX(RGBPIXEL_STRIP_GPIO, RMT_TX_CHANNEL);
-    // set counter clock to 40MHz
-    config.clk_div = 2;
-
-    ESP_ERROR_CHECK(rmt_config(&config));
-    ESP_ERROR_CHECK(rmt_driver_install(config.channel, 0, 0));
-
-    // Install WS2812 driver
-    led_strip_config_t strip_config = LED_STRIP_DEFAULT_CONFIG(g_rgbpixel_strip_pixels, (led_strip_dev_t)config.channel);
-    g_rgbpixel_strip = led_strip_new_rmt_ws2812(&strip_config);
-    if (!g_rgbpixel_strip)
+    if (segment >= RGBPIXEL_SEGMENTS)
+        return ESP_ERR_INVALID_ARG;
+    rgbpixel_segment_t *seg = &g_rgbpixel_segments[segment];
+    const rgbpixel_effect_t *effect = NULL;
+    if (update->fields & RGBPIXEL_UPDATE_EFFECT)
     {
-        ESP_LOGE(TAG, "Install WS2812 driver failed");
-        return ESP_FAIL;
+        esp_err_t err = rgbpixel_lookup_effect(update->effect, &effect);
+        if (err != ESP_OK)
+            return err;
     }
-    if (g_rgbpixel_power_state)
+    bool color = update->fields & (RGBPIXEL_UPDATE_HUE | RGBPIXEL_UPDATE_SATURATION | RGBPIXEL_UPDATE_BRIGHTNESS);
+
+    int64_t now = esp_timer_get_time();
+    bool changed = false;
+    portENTER_CRITICAL(&g_rgbpixel_lock);
+    bool power = (update->fields & RGBPIXEL_UPDATE_POWER) ? update->power : (color || seg->power_state);
+    bool turned_on = power && !seg->power_state;
+    if (color)
     {
-        rgbpixel_set_pixels(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value);
+        changed |= rgbpixel_set_pixels_locked(seg,
+                                              (update->fields & RGBPIXEL_UPDATE_HUE) ? update->hue : seg->hue,
+                                              (update->fields & RGBPIXEL_UPDATE_SATURATION) ? update->saturation : seg->saturation,
+                                              (update->fields & RGBPIXEL_UPDATE_BRIGHTNESS) ? update->brightness : seg->value,
+                                              CONFIG_RGBPIXEL_TRANSITION_MS, now);
     }
+    if (update->fields & RGBPIXEL_UPDATE_EFFECT)
+        changed |= rgbpixel_set_effect_locked(seg, effect);
+    changed |= rgbpixel_set_power_locked(seg, power);
+    // The oldest waiting update keeps the trace, it is the one the next frame answers first
+    if (changed && !seg->trace)
+        seg->trace = update->trace;
+    portEXIT_CRITICAL(&g_rgbpixel_lock);
+
+    if (changed)
+        rgbpixel_request_frame();
     else
+        app_trace_point(update->trace, APP_TRACE_OUTPUT); // The strip already shows it
+    if (turned_on && !(update->fields & RGBPIXEL_UPDATE_POWER))
     {
-        g_rgbpixel_strip->clear(g_rgbpixel_strip, 100);
+        app_report_param(esp_rmaker_device_get_param_by_type(rgb_ring_lights[segment], ESP_RMAKER_PARAM_POWER),
+                         esp_rmaker_bool(true));
     }
-
-    rgbpixel_anim_timer = xTimerCreate("rgbpixel_anim_tm", (DEFAULT_REFRESH_ANIM_PERIOD_RGBPIXEL) / portTICK_PERIOD_MS,
-                        pdTRUE, NULL, rgbpixel_anim);
-    rgbpixel_anim_duration_timer = xTimerCreate("rgbpixel_anim_duration_tm", (DEFAULT_ANIM_DURATION_RGBPIXEL * 1000) / portTICK_PERIOD_MS,
-                        pdFALSE, NULL, rgbpixel_anim_duration);
-
     return ESP_OK;
 }
 
-esp_err_t rgbpixel_set(uint32_t hue, uint32_t saturation, uint32_t brightness)
+static esp_err_t rgbpixel_segment_init(uint8_t index, const rgbpixel_segment_config_t *config)
 {
-    // Whenever this function is called, rgb power will be ON
-    if (!g_rgbpixel_power_state)
+    rgbpixel_segment_t *segment = &g_rgbpixel_segments[index];
+    segment->index = index;
+    segment->pixels = config->pixels;
+    segment->power_state = DEFAULT_RGBPIXEL_POWER_STATE;
+    segment->hue = DEFAULT_RGBPIXEL_HUE;
+    segment->saturation = DEFAULT_RGBPIXEL_SATURATION;
+    segment->value = DEFAULT_RGBPIXEL_BRIGHTNESS;
+    segment->shown.hue = segment->hue;
+    segment->shown.saturation = segment->saturation;
+    segment->shown.value = segment->value;
+    segment->dirty = true;
+
+    // Both frame buffers in one allocation
+    segment->frames[0] = calloc(2, config->pixels * 3);
+    if (!segment->frames[0])
     {
-        g_rgbpixel_power_state = true;
-        esp_rmaker_param_update_and_report(
-            esp_rmaker_device_get_param_by_type(rgb_ring_light, ESP_RMAKER_PARAM_POWER),
-            esp_rmaker_bool(g_rgbpixel_power_state));
+        ESP_LOGE(TAG, "Could not allocate frame buffers for segment %d", index);
+        return ESP_ERR_NO_MEM;
     }
-    return rgbpixel_set_pixels(hue, saturation, brightness);
+    segment->frames[1] = segment->frames[0] + config->pixels * 3;
+    segment->frame = segment->frames[0];
+
+    esp_err_t err = rgbpixel_output_init(index, config->gpio, config->pixels, rgbpixel_tx_end);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not setup output for segment %d: %s", index, esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Segment %d: %d pixels on GPIO %d over %s", index, segment->pixels, config->gpio, rgbpixel_output_name());
+    return ESP_OK;
 }
 
-esp_err_t rgbpixel_set_power_state(bool power)
+esp_err_t app_driver_rgbpixel_init(void)
 {
-    g_rgbpixel_power_state = power;
-    if (power)
+    rgbpixel_effects_init();
+
+    uint16_t max_pixels = 0;
+    for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
     {
-        rgbpixel_set(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value);
+        esp_err_t err = rgbpixel_segment_init(i, &g_rgbpixel_segment_config[i]);
+        if (err != ESP_OK)
+            return err;
+        if (g_rgbpixel_segment_config[i].pixels > max_pixels)
+            max_pixels = g_rgbpixel_segment_config[i].pixels;
     }
-    else
+    g_rgbpixel_pixels = calloc(max_pixels, sizeof(uint32_t));
+    if (!g_rgbpixel_pixels)
     {
-        g_rgbpixel_strip->clear(g_rgbpixel_strip, 100);
+        ESP_LOGE(TAG, "Could not allocate effect buffer");
+        return ESP_ERR_NO_MEM;
     }
+
+    // Off the network core, see app_tasks.h
+    esp_err_t err = app_task_create(APP_TASK_RENDER, rgbpixel_render_task, NULL, &g_rgbpixel_render_task);
+    if (err != ESP_OK)
+        return err;
+    // Show the initial state
+    rgbpixel_request_frame();
+
     return ESP_OK;
 }
 
-esp_err_t rgbpixel_set_hue(uint16_t hue)
+esp_err_t rgbpixel_set_power_state(uint8_t segment, bool power)
 {
-    g_rgbpixel_hue = hue;
-    return rgbpixel_set(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value);
+    rgbpixel_update_t update = {
+        .fields = RGBPIXEL_UPDATE_POWER,
+        .power = power,
+        .trace = APP_TRACE_NONE,
+    };
+    return rgbpixel_update(segment, &update);
 }
 
-esp_err_t rgbpixel_set_saturation(uint16_t saturation)
+void rgbpixel_get_stats(rgbpixel_stats_t *stats)
 {
-    g_rgbpixel_saturation = saturation;
-    return rgbpixel_set(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value);
+    portENTER_CRITICAL(&g_rgbpixel_lock);
+    *stats = g_rgbpixel_stats;
+    portEXIT_CRITICAL(&g_rgbpixel_lock);
 }
 
-esp_err_t rgbpixel_set_brightness(uint16_t brightness)
+const char *rgbpixel_get_effect(uint8_t segment)
 {
-    g_rgbpixel_value = brightness;
-    return rgbpixel_set(g_rgbpixel_hue, g_rgbpixel_saturation, g_rgbpixel_value);
+    const rgbpixel_effect_t *effect = g_rgbpixel_segments[segment].effect;
+    return effect ? effect->name : RGBPIXEL_EFFECT_NONE_NAME;
 }
 
-bool rgbpixel_get_power_state(void)
+bool rgbpixel_get_power_state(uint8_t segment)
 {
-    return g_rgbpixel_power_state;
+    return g_rgbpixel_segments[segment].power_state;
 }
 
-uint16_t rgbpixel_get_hue()
+uint16_t rgbpixel_get_hue(uint8_t segment)
 {
-    return g_rgbpixel_hue;
+    return g_rgbpixel_segments[segment].hue;
 }
 
-uint16_t rgbpixel_get_saturation()
+uint16_t rgbpixel_get_saturation(uint8_t segment)
 {
-    return g_rgbpixel_saturation;
+    return g_rgbpixel_segments[segment].saturation;
 }
 
-uint16_t rgbpixel_get_brightness()
+uint16_t rgbpixel_get_brightness(uint8_t segment)
 {
-    return g_rgbpixel_value;
+    return g_rgbpixel_segments[segment].value;
 }
\ No newline at end of file
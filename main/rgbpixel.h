@@ -30,18 +30,57 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <esp_err.h>
+#include <esp_rmaker_core.h>
+#include <sdkconfig.h>
+#include <rgbpixel_effects.h>
 
-extern esp_rmaker_device_t *rgb_ring_light;
+// Independently addressable parts of the strip, each on its own GPIO and output channel
+#define RGBPIXEL_SEGMENTS CONFIG_RGBPIXEL_SEGMENTS
+
+extern esp_rmaker_device_t *rgb_ring_lights[RGBPIXEL_SEGMENTS];
+
+typedef struct
+{
+    uint32_t frames;            // Frames handed to RMT
+    uint32_t skipped_frames;    // Frames identical to the one on the strip, not retransmitted
+    uint32_t encoded_pixels;    // Pixels re-encoded into the RMT symbol cache
+    uint32_t wakeups;           // Render task wake-ups, zero growth while idle
+    uint32_t dropped_frames;    // Frame slots missed because a frame was late or RMT was still busy
+    uint32_t build_time_us;     // Time spent building the last frame
+    uint32_t build_time_max_us;
+    uint32_t overruns;          // Frames that took longer to build than the frame period
+    uint32_t transition_frames; // Frames built while a colour transition was running
+    uint32_t tx_time_us;        // RMT transmit time of the last frame
+    uint32_t tx_time_max_us;
+} rgbpixel_stats_t;
+
+// Fields of rgbpixel_update_t to apply
+#define RGBPIXEL_UPDATE_POWER      (1 << 0)
+#define RGBPIXEL_UPDATE_HUE        (1 << 1)
+#define RGBPIXEL_UPDATE_SATURATION (1 << 2)
+#define RGBPIXEL_UPDATE_BRIGHTNESS (1 << 3)
+#define RGBPIXEL_UPDATE_EFFECT     (1 << 4)
+
+typedef struct
+{
+    uint8_t fields;
+    bool power;
+    uint16_t hue;
+    uint16_t saturation;
+    uint16_t brightness;
+    const char *effect;
+    uint16_t trace; // app_trace id, stamped once the change is on the strip
+} rgbpixel_update_t;
 
 esp_err_t app_driver_rgbpixel_init(void);
-esp_err_t rgbpixel_set(uint32_t hue, uint32_t saturation, uint32_t brightness);
-esp_err_t rgbpixel_set_power_state(bool power);
-esp_err_t rgbpixel_set_brightness(uint16_t brightness);
-esp_err_t rgbpixel_set_hue(uint16_t hue);
-esp_err_t rgbpixel_set_saturation(uint16_t saturation);
-esp_err_t rgbpixel_start_anim(uint8_t anim_style, bool run_once);
-
-bool rgbpixel_get_power_state(void);
-uint16_t rgbpixel_get_hue();
-uint16_t rgbpixel_get_saturation();
-uint16_t rgbpixel_get_brightness();
\ No newline at end of file
+esp_err_t rgbpixel_set_power_state(uint8_t segment, bool power);
+esp_err_t rgbpixel_start_anim(rgbpixel_effect_id_t anim, bool run_once);
+// An implicit power on is staged with app_report_param(), the caller flushes it
+esp_err_t rgbpixel_update(uint8_t segment, const rgbpixel_update_t *update);
+void rgbpixel_get_stats(rgbpixel_stats_t *stats);
+
+const char *rgbpixel_get_effect(uint8_t segment);
+bool rgbpixel_get_power_state(uint8_t segment);
+uint16_t rgbpixel_get_hue(uint8_t segment);
+uint16_t rgbpixel_get_saturation(uint8_t segment);
+uint16_t rgbpixel_get_brightness(uint8_t segment);
\ No newline at end of file
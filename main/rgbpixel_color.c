@@ -0,0 +1,124 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <rgbpixel_color.h>
+
+#define RGBPIXEL_CHANNEL_R(c) (((c) >> 16) & 0xFF)
+#define RGBPIXEL_CHANNEL_G(c) (((c) >> 8) & 0xFF)
+#define RGBPIXEL_CHANNEL_B(c) ((c) & 0xFF)
+
+// Integer division rounded to nearest, for non-negative operands
+#define RGBPIXEL_DIV_ROUND(n, d) (((n) + (d) / 2) / (d))
+
+uint32_t rgbpixel_color_rgb(uint8_t red, uint8_t green, uint8_t blue)
+{
+    return ((uint32_t)red << 16) | ((uint32_t)green << 8) | blue;
+}
+
+void rgbpixel_color_hsv2rgb(uint32_t hue, uint32_t saturation, uint32_t brightness, uint32_t *red, uint32_t *green, uint32_t *blue)
+{
+    hue %= 360; // hue -> [0,360]
+    if (saturation > 100)
+        saturation = 100;
+    if (brightness > 100)
+        brightness = 100;
+    // Truncating integer steps, same as the former float scaling but without its representation error
+    uint32_t rgb_max = brightness * 255 / 100;
+    uint32_t rgb_min = rgb_max * (100 - saturation) / 100;
+
+    uint32_t quadrant = hue / 60;
+    uint32_t diff = hue % 60;
+
+    // RGB adjustment amount by hue
+    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+
+    switch (quadrant)
+    {
+    case 0:
+        *red = rgb_max;
+        *green = rgb_min + rgb_adj;
+        *blue = rgb_min;
+        break;
+    case 1:
+        *red = rgb_max - rgb_adj;
+        *green = rgb_max;
+        *blue = rgb_min;
+        break;
+    case 2:
+        *red = rgb_min;
+        *green = rgb_max;
+        *blue = rgb_min + rgb_adj;
+        break;
+    case 3:
+        *red = rgb_min;
+        *green = rgb_max - rgb_adj;
+        *blue = rgb_max;
+        break;
+    case 4:
+        *red = rgb_min + rgb_adj;
+        *green = rgb_min;
+        *blue = rgb_max;
+        break;
+    default:
+        *red = rgb_max;
+        *green = rgb_min;
+        *blue = rgb_max - rgb_adj;
+        break;
+    }
+}
+
+static inline uint32_t rgbpixel_lerp_channel(uint32_t start, uint32_t end, uint32_t t)
+{
+    return (start * (RGBPIXEL_Q8_ONE - t) + end * t) >> 8;
+}
+
+uint32_t rgbpixel_color_lerp(uint32_t color_start, uint32_t color_end, uint16_t t)
+{
+    if (t > RGBPIXEL_Q8_ONE)
+        t = RGBPIXEL_Q8_ONE;
+    uint32_t red = rgbpixel_lerp_channel(RGBPIXEL_CHANNEL_R(color_start), RGBPIXEL_CHANNEL_R(color_end), t);
+    uint32_t green = rgbpixel_lerp_channel(RGBPIXEL_CHANNEL_G(color_start), RGBPIXEL_CHANNEL_G(color_end), t);
+    uint32_t blue = rgbpixel_lerp_channel(RGBPIXEL_CHANNEL_B(color_start), RGBPIXEL_CHANNEL_B(color_end), t);
+    return (red << 16) | (green << 8) | blue;
+}
+
+uint32_t rgbpixel_color_scale(uint32_t color, uint16_t scale)
+{
+    if (scale >= RGBPIXEL_Q8_ONE)
+        return color;
+    uint32_t red = (RGBPIXEL_CHANNEL_R(color) * scale + RGBPIXEL_Q8_ONE / 2) >> 8;
+    uint32_t green = (RGBPIXEL_CHANNEL_G(color) * scale + RGBPIXEL_Q8_ONE / 2) >> 8;
+    uint32_t blue = (RGBPIXEL_CHANNEL_B(color) * scale + RGBPIXEL_Q8_ONE / 2) >> 8;
+    return (red << 16) | (green << 8) | blue;
+}
+
+uint16_t rgbpixel_color_percent_to_q8(uint32_t percent)
+{
+    if (percent >= 100)
+        return RGBPIXEL_Q8_ONE;
+    return RGBPIXEL_DIV_ROUND(percent * RGBPIXEL_Q8_ONE, 100);
+}
@@ -0,0 +1,259 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sdkconfig.h>
+#include <string.h>
+#include <rgbpixel_color.h>
+#include <rgbpixel_effects.h>
+
+#define RGBPIXEL_EFFECT_FRAMES_PER_SECOND CONFIG_RGBPIXEL_FRAME_RATE
+
+// Quarter sine wave, sin(i * 90 / 64 degrees) * 255
+static const uint8_t rgbpixel_sin_quarter[65] = {
+    0, 6, 13, 19, 25, 31, 37, 44, 50, 56, 62, 68, 74,
+    80, 86, 92, 98, 103, 109, 115, 120, 126, 131, 136, 142, 147,
+    152, 157, 162, 167, 171, 176, 180, 185, 189, 193, 197, 201, 205,
+    208, 212, 215, 219, 222, 225, 228, 231, 233, 236, 238, 240, 242,
+    244, 246, 247, 249, 250, 251, 252, 253, 254, 254, 255, 255, 255,
+};
+
+static uint8_t rgbpixel_breath_table[256];
+static uint32_t rgbpixel_wheel_table[256];
+
+static void rgbpixel_effect_fill(uint32_t *pixels, uint16_t count, uint32_t color)
+{
+    for (uint16_t i = 0; i < count; i++)
+    {
+        pixels[i] = color;
+    }
+}
+
+static void rgbpixel_effect_spinner(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params)
+{
+    rgbpixel_effect_fill(pixels, count, params->color_a);
+    uint16_t position = frame % count;
+    for (uint16_t i = 0; i < params->width && i < count; i++)
+    {
+        uint16_t pixel = position + i;
+        pixels[pixel >= count ? pixel - count : pixel] = params->color_b;
+    }
+}
+
+static void rgbpixel_effect_pulse(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params)
+{
+    // Triangle wave from color_a to color_b and back, once per period
+    uint16_t half = params->period / 2;
+    uint16_t phase = frame % params->period;
+    uint16_t step = phase < half ? phase : params->period - phase;
+    uint16_t t = step * RGBPIXEL_Q8_ONE / half;
+    rgbpixel_effect_fill(pixels, count, rgbpixel_color_lerp(params->color_a, params->color_b, t));
+}
+
+static void rgbpixel_effect_rainbow_init(void)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint32_t red, green, blue;
+        rgbpixel_color_hsv2rgb(i * 360 / 256, 100, 100, &red, &green, &blue);
+        rgbpixel_wheel_table[i] = rgbpixel_color_rgb(red, green, blue);
+    }
+}
+
+static void rgbpixel_effect_rainbow(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params)
+{
+    // One full wheel across the strip, rotating once per period; positions are 8.8 fixed point
+    uint32_t step = (256u << 8) / count;
+    uint32_t position = (frame % params->period) * (256u << 8) / params->period;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        pixels[i] = rgbpixel_wheel_table[(position >> 8) & 0xFF];
+        position += step;
+    }
+}
+
+static void rgbpixel_effect_comet(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params)
+{
+    rgbpixel_effect_fill(pixels, count, params->color_a);
+    uint16_t width = params->width < count ? params->width : count;
+    uint16_t head = frame % count;
+    // Tail fades linearly to the background colour
+    uint16_t fade = RGBPIXEL_Q8_ONE / width;
+    uint16_t t = RGBPIXEL_Q8_ONE;
+    for (uint16_t i = 0; i < width; i++)
+    {
+        uint16_t pixel = head >= i ? head - i : head + count - i;
+        pixels[pixel] = rgbpixel_color_lerp(params->color_a, params->color_b, t);
+        t -= fade;
+    }
+}
+
+static void rgbpixel_effect_breathing_init(void)
+{
+    // (1 - cos) / 2 curve, so a cycle starts and ends dark
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t quarter = i & 0x3F;
+        int sin_value;
+        switch (i >> 6)
+        {
+        case 0:
+            sin_value = rgbpixel_sin_quarter[64 - quarter];
+            break;
+        case 1:
+            sin_value = -rgbpixel_sin_quarter[quarter];
+            break;
+        case 2:
+            sin_value = -rgbpixel_sin_quarter[64 - quarter];
+            break;
+        default:
+            sin_value = rgbpixel_sin_quarter[quarter];
+            break;
+        }
+        rgbpixel_breath_table[i] = (255 - sin_value) / 2;
+    }
+}
+
+static void rgbpixel_effect_breathing(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params)
+{
+    uint8_t angle = (frame % params->period) * 256 / params->period;
+    uint16_t t = rgbpixel_breath_table[angle] + 1;
+    rgbpixel_effect_fill(pixels, count, rgbpixel_color_lerp(params->color_a, params->color_b, t));
+}
+
+static void rgbpixel_effect_color_wipe(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params)
+{
+    // Wipe the colour in along the strip, then wipe it out again
+    uint16_t position = frame % (2 * count);
+    bool wipe_in = position < count;
+    uint16_t edge = wipe_in ? position : position - count;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        bool lit = (i <= edge) == wipe_in;
+        pixels[i] = lit ? params->color_b : params->color_a;
+    }
+}
+
+static const rgbpixel_effect_t rgbpixel_effects[RGBPIXEL_EFFECT_MAX] = {
+    [RGBPIXEL_EFFECT_SPIN_BLUE] = {
+        .name = "Spin Blue",
+        .render = rgbpixel_effect_spinner,
+        .params = {.color_a = 0x0000FF, .color_b = 0x00FFFF, .width = 2},
+    },
+    [RGBPIXEL_EFFECT_SPIN_ORANGE] = {
+        .name = "Spin Orange",
+        .render = rgbpixel_effect_spinner,
+        .params = {.color_a = 0x000000, .color_b = 0xFF5000, .width = 6},
+    },
+    [RGBPIXEL_EFFECT_PULSE_BLUE] = {
+        .name = "Pulse Blue",
+        .render = rgbpixel_effect_pulse,
+        .params = {.color_a = 0x0000FF, .color_b = 0x00FFFF, .period = 2 * RGBPIXEL_EFFECT_FRAMES_PER_SECOND},
+    },
+    [RGBPIXEL_EFFECT_PULSE_RED] = {
+        .name = "Pulse Red",
+        .render = rgbpixel_effect_pulse,
+        .params = {.color_a = 0x281100, .color_b = 0xFF1100, .period = 2 * RGBPIXEL_EFFECT_FRAMES_PER_SECOND},
+    },
+    [RGBPIXEL_EFFECT_PULSE_GREEN] = {
+        .name = "Pulse Green",
+        .render = rgbpixel_effect_pulse,
+        .params = {.color_a = 0x001100, .color_b = 0x00FF00, .period = 2 * RGBPIXEL_EFFECT_FRAMES_PER_SECOND},
+    },
+    [RGBPIXEL_EFFECT_PULSE_PURPLE] = {
+        .name = "Pulse Purple",
+        .render = rgbpixel_effect_pulse,
+        .params = {.color_a = 0x280032, .color_b = 0xC800FF, .period = 2 * RGBPIXEL_EFFECT_FRAMES_PER_SECOND},
+    },
+    [RGBPIXEL_EFFECT_RAINBOW] = {
+        .name = "Rainbow",
+        .init = rgbpixel_effect_rainbow_init,
+        .render = rgbpixel_effect_rainbow,
+        .params = {.period = 5 * RGBPIXEL_EFFECT_FRAMES_PER_SECOND},
+        .selectable = true,
+    },
+    [RGBPIXEL_EFFECT_COMET] = {
+        .name = "Comet",
+        .render = rgbpixel_effect_comet,
+        .params = {.color_a = 0x000000, .width = 8},
+        .selectable = true,
+        .use_light_color = true,
+    },
+    [RGBPIXEL_EFFECT_BREATHING] = {
+        .name = "Breathing",
+        .init = rgbpixel_effect_breathing_init,
+        .render = rgbpixel_effect_breathing,
+        .params = {.color_a = 0x000000, .period = 4 * RGBPIXEL_EFFECT_FRAMES_PER_SECOND},
+        .selectable = true,
+        .use_light_color = true,
+    },
+    [RGBPIXEL_EFFECT_COLOR_WIPE] = {
+        .name = "Color Wipe",
+        .render = rgbpixel_effect_color_wipe,
+        .params = {.color_a = 0x000000},
+        .selectable = true,
+        .use_light_color = true,
+    },
+};
+
+void rgbpixel_effects_init(void)
+{
+    for (int i = 0; i < RGBPIXEL_EFFECT_MAX; i++)
+    {
+        if (rgbpixel_effects[i].init)
+            rgbpixel_effects[i].init();
+    }
+}
+
+const rgbpixel_effect_t *rgbpixel_effect_get(rgbpixel_effect_id_t id)
+{
+    if (id >= RGBPIXEL_EFFECT_MAX)
+        return NULL;
+    return &rgbpixel_effects[id];
+}
+
+const rgbpixel_effect_t *rgbpixel_effect_find(const char *name)
+{
+    for (int i = 0; i < RGBPIXEL_EFFECT_MAX; i++)
+    {
+        if (rgbpixel_effects[i].selectable && strcmp(rgbpixel_effects[i].name, name) == 0)
+            return &rgbpixel_effects[i];
+    }
+    return NULL;
+}
+
+uint8_t rgbpixel_effect_names(const char *names[], uint8_t max)
+{
+    uint8_t count = 0;
+    if (count < max)
+        names[count++] = RGBPIXEL_EFFECT_NONE_NAME;
+    for (int i = 0; i < RGBPIXEL_EFFECT_MAX && count < max; i++)
+    {
+        if (rgbpixel_effects[i].selectable)
+            names[count++] = rgbpixel_effects[i].name;
+    }
+    return count;
+}
@@ -0,0 +1,79 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Effects render one frame of 0x00RRGGBB colours into a pixel buffer.
+ * Rendering is O(pixels) integer math, lookup tables are built once by
+ * rgbpixel_effects_init().
+ */
+typedef enum
+{
+    // Status animations, started by the application on Wi-Fi and RainMaker events
+    RGBPIXEL_EFFECT_SPIN_BLUE = 0,
+    RGBPIXEL_EFFECT_SPIN_ORANGE,
+    RGBPIXEL_EFFECT_PULSE_BLUE,
+    RGBPIXEL_EFFECT_PULSE_RED,
+    RGBPIXEL_EFFECT_PULSE_GREEN,
+    RGBPIXEL_EFFECT_PULSE_PURPLE,
+    // Light effects, selectable from the phone app
+    RGBPIXEL_EFFECT_RAINBOW,
+    RGBPIXEL_EFFECT_COMET,
+    RGBPIXEL_EFFECT_BREATHING,
+    RGBPIXEL_EFFECT_COLOR_WIPE,
+    RGBPIXEL_EFFECT_MAX,
+} rgbpixel_effect_id_t;
+
+#define RGBPIXEL_EFFECT_NONE_NAME "None"
+
+typedef struct
+{
+    uint32_t color_a;   // Background / start colour
+    uint32_t color_b;   // Foreground / end colour
+    uint16_t width;     // Lit pixels for spinner and comet
+    uint16_t period;    // Frames per effect cycle
+} rgbpixel_effect_params_t;
+
+typedef void (*rgbpixel_effect_render_fn)(uint32_t *pixels, uint16_t count, uint32_t frame, const rgbpixel_effect_params_t *params);
+
+typedef struct
+{
+    const char *name;
+    void (*init)(void);                 // Optional, builds the effect lookup tables
+    rgbpixel_effect_render_fn render;
+    rgbpixel_effect_params_t params;    // Defaults
+    bool selectable;                    // Exposed as a light effect in the phone app
+    bool use_light_color;               // color_b follows the light hue and saturation
+} rgbpixel_effect_t;
+
+void rgbpixel_effects_init(void);
+const rgbpixel_effect_t *rgbpixel_effect_get(rgbpixel_effect_id_t id);
+const rgbpixel_effect_t *rgbpixel_effect_find(const char *name);
+uint8_t rgbpixel_effect_names(const char *names[], uint8_t max);
@@ -0,0 +1,131 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <esp_attr.h>
+#include <string.h>
+#include <rgbpixel_encode.h>
+
+// WS2812 bit timings
+#define RGBPIXEL_WS2812_T0H_NS 350
+#define RGBPIXEL_WS2812_T0L_NS 1000
+#define RGBPIXEL_WS2812_T1H_NS 1000
+#define RGBPIXEL_WS2812_T1L_NS 350
+
+static rgbpixel_rmt_item_t g_rgbpixel_bit0;
+static rgbpixel_rmt_item_t g_rgbpixel_bit1;
+// SPI bit patterns of every byte value, MSB first
+static uint8_t g_rgbpixel_spi_table[256][3];
+
+void rgbpixel_encode_init(uint32_t counter_clk_hz)
+{
+    // ns -> ticks
+    float ratio = (float)counter_clk_hz / 1e9;
+    g_rgbpixel_bit0.duration0 = ratio * RGBPIXEL_WS2812_T0H_NS;
+    g_rgbpixel_bit0.level0 = 1;
+    g_rgbpixel_bit0.duration1 = ratio * RGBPIXEL_WS2812_T0L_NS;
+    g_rgbpixel_bit0.level1 = 0;
+    g_rgbpixel_bit1.duration0 = ratio * RGBPIXEL_WS2812_T1H_NS;
+    g_rgbpixel_bit1.level0 = 1;
+    g_rgbpixel_bit1.duration1 = ratio * RGBPIXEL_WS2812_T1L_NS;
+    g_rgbpixel_bit1.level1 = 0;
+}
+
+static inline IRAM_ATTR void rgbpixel_encode_byte(rgbpixel_rmt_item_t *items, uint8_t byte)
+{
+    // MSB first
+    for (int i = 0; i < 8; i++)
+    {
+        items[i].val = (byte & (0x80 >> i)) ? g_rgbpixel_bit1.val : g_rgbpixel_bit0.val;
+    }
+}
+
+// Called from the RMT sample translator, in interrupt context
+void IRAM_ATTR rgbpixel_encode_bytes(rgbpixel_rmt_item_t *items, const uint8_t *bytes, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        rgbpixel_encode_byte(&items[i * 8], bytes[i]);
+    }
+}
+
+void rgbpixel_encode_pixel(rgbpixel_rmt_item_t *items, const uint8_t *grb)
+{
+    rgbpixel_encode_byte(&items[0], grb[0]);
+    rgbpixel_encode_byte(&items[8], grb[1]);
+    rgbpixel_encode_byte(&items[16], grb[2]);
+}
+
+/* Bring the encoded items up to date with frame. When previous is the frame
+ * the items currently hold, only the pixels that differ are re-encoded;
+ * pass NULL to encode every pixel. Returns the number of pixels encoded.
+ */
+size_t rgbpixel_encode_frame(rgbpixel_rmt_item_t *items, const uint8_t *frame, const uint8_t *previous, uint16_t pixels)
+{
+    size_t encoded = 0;
+    for (uint16_t i = 0; i < pixels; i++)
+    {
+        const uint8_t *grb = &frame[i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+        if (previous && memcmp(grb, &previous[i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL], RGBPIXEL_ENCODE_BYTES_PER_PIXEL) == 0)
+            continue;
+        rgbpixel_encode_pixel(&items[i * RGBPIXEL_ENCODE_ITEMS_PER_PIXEL], grb);
+        encoded++;
+    }
+    return encoded;
+}
+
+void rgbpixel_encode_spi_init(void)
+{
+    for (int byte = 0; byte < 256; byte++)
+    {
+        uint32_t bits = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            bits = (bits << 3) | ((byte & (1 << i)) ? 0x6 : 0x4);
+        }
+        g_rgbpixel_spi_table[byte][0] = bits >> 16;
+        g_rgbpixel_spi_table[byte][1] = bits >> 8;
+        g_rgbpixel_spi_table[byte][2] = bits;
+    }
+}
+
+// Same as rgbpixel_encode_frame(), producing the SPI bitstream
+size_t rgbpixel_encode_spi_frame(uint8_t *out, const uint8_t *frame, const uint8_t *previous, uint16_t pixels)
+{
+    size_t encoded = 0;
+    for (uint16_t i = 0; i < pixels; i++)
+    {
+        const uint8_t *grb = &frame[i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+        if (previous && memcmp(grb, &previous[i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL], RGBPIXEL_ENCODE_BYTES_PER_PIXEL) == 0)
+            continue;
+        uint8_t *dest = &out[i * RGBPIXEL_ENCODE_SPI_BYTES_PER_PIXEL];
+        memcpy(&dest[0], g_rgbpixel_spi_table[grb[0]], 3);
+        memcpy(&dest[3], g_rgbpixel_spi_table[grb[1]], 3);
+        memcpy(&dest[6], g_rgbpixel_spi_table[grb[2]], 3);
+        encoded++;
+    }
+    return encoded;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* WS2812 pixels are sent as 24 bits, green, red, blue, MSB first. Each bit
+ * becomes one RMT item, so a pixel takes RGBPIXEL_ENCODE_ITEMS_PER_PIXEL items.
+ */
+#define RGBPIXEL_ENCODE_BYTES_PER_PIXEL 3
+#define RGBPIXEL_ENCODE_ITEMS_PER_PIXEL (RGBPIXEL_ENCODE_BYTES_PER_PIXEL * 8)
+
+// Same layout as rmt_item32_t, so the encoder does not depend on the RMT driver
+typedef union
+{
+    struct
+    {
+        uint32_t duration0 : 15;
+        uint32_t level0 : 1;
+        uint32_t duration1 : 15;
+        uint32_t level1 : 1;
+    };
+    uint32_t val;
+} rgbpixel_rmt_item_t;
+
+/* For SPI every WS2812 bit is three SPI bits at RGBPIXEL_ENCODE_SPI_CLOCK_HZ,
+ * 100 for a zero and 110 for a one, so a pixel takes nine bytes.
+ */
+#define RGBPIXEL_ENCODE_SPI_CLOCK_HZ 2500000
+#define RGBPIXEL_ENCODE_SPI_BYTES_PER_PIXEL (RGBPIXEL_ENCODE_BYTES_PER_PIXEL * 3)
+// WS2812 latches after the line is low for 280 us, 300 us of zero bytes closes every frame
+#define RGBPIXEL_ENCODE_SPI_RESET_US 300
+#define RGBPIXEL_ENCODE_SPI_RESET_BYTES ((RGBPIXEL_ENCODE_SPI_CLOCK_HZ / 8 * RGBPIXEL_ENCODE_SPI_RESET_US + 999999) / 1000000)
+
+void rgbpixel_encode_init(uint32_t counter_clk_hz);
+void rgbpixel_encode_bytes(rgbpixel_rmt_item_t *items, const uint8_t *bytes, size_t count);
+void rgbpixel_encode_pixel(rgbpixel_rmt_item_t *items, const uint8_t *grb);
+size_t rgbpixel_encode_frame(rgbpixel_rmt_item_t *items, const uint8_t *frame, const uint8_t *previous, uint16_t pixels);
+void rgbpixel_encode_spi_init(void);
+size_t rgbpixel_encode_spi_frame(uint8_t *out, const uint8_t *frame, const uint8_t *previous, uint16_t pixels);
\ No newline at end of file
@@ -0,0 +1,150 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sdkconfig.h>
+
+#if CONFIG_RGBPIXEL_OUTPUT_RMT
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <driver/rmt.h>
+#include <rgbpixel.h>
+#include <rgbpixel_encode.h>
+#include <rgbpixel_output.h>
+
+// Each segment gets two RMT memory blocks, so long strips need half the refill interrupts
+#define RGBPIXEL_RMT_MEM_BLOCKS 2
+#define RGBPIXEL_RMT_CHANNEL(segment) ((rmt_channel_t)((segment) * RGBPIXEL_RMT_MEM_BLOCKS))
+
+_Static_assert(sizeof(rgbpixel_rmt_item_t) == sizeof(rmt_item32_t), "Encoder items must match the RMT item layout");
+
+typedef struct
+{
+    rmt_channel_t channel;
+    uint16_t pixels;
+    // Shown frame pre-encoded as RMT items, NULL when the sample translator is used instead
+    rgbpixel_rmt_item_t *items;
+} rgbpixel_rmt_output_t;
+
+static rgbpixel_rmt_output_t g_rgbpixel_rmt_outputs[RGBPIXEL_SEGMENTS];
+static rgbpixel_output_done_cb_t g_rgbpixel_rmt_done_cb;
+
+static const char *TAG = "rgbpixel_rmt";
+
+static void IRAM_ATTR rgbpixel_rmt_tx_end(rmt_channel_t channel, void *arg)
+{
+    if (g_rgbpixel_rmt_done_cb)
+        g_rgbpixel_rmt_done_cb(channel / RGBPIXEL_RMT_MEM_BLOCKS);
+}
+
+// Sample translator for rmt_write_sample(), used when there is no room for the encoded items
+static void IRAM_ATTR rgbpixel_rmt_translator(const void *src, rmt_item32_t *dest, size_t src_size,
+                                              size_t wanted_num, size_t *translated_size, size_t *item_num)
+{
+    if (src == NULL || dest == NULL)
+    {
+        *translated_size = 0;
+        *item_num = 0;
+        return;
+    }
+    // Whole bytes only, each takes eight items
+    size_t size = src_size;
+    if (size > (wanted_num + 7) / 8)
+        size = (wanted_num + 7) / 8;
+    rgbpixel_encode_bytes((rgbpixel_rmt_item_t *)dest, src, size);
+    *translated_size = size;
+    *item_num = size * 8;
+}
+
+esp_err_t rgbpixel_output_init(uint8_t segment, int gpio, uint16_t pixels, rgbpixel_output_done_cb_t done_cb)
+{
+    rgbpixel_rmt_output_t *output = &g_rgbpixel_rmt_outputs[segment];
+    output->channel = RGBPIXEL_RMT_CHANNEL(segment);
+    output->pixels = pixels;
+
+    rmt_config_t config = RMT_DEFAULT_CONFIG_TX(gpio, output->channel);
+    // set counter clock to 40MHz
+    config.clk_div = 2;
+    config.mem_block_num = RGBPIXEL_RMT_MEM_BLOCKS;
+
+    esp_err_t err = rmt_config(&config);
+    if (err == ESP_OK)
+        err = rmt_driver_install(output->channel, 0, 0);
+    if (err == ESP_OK)
+        err = rmt_translator_init(output->channel, rgbpixel_rmt_translator);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not setup RMT channel %d: %s", output->channel, esp_err_to_name(err));
+        return err;
+    }
+
+    uint32_t counter_clk_hz = 0;
+    if (rmt_get_counter_clock(output->channel, &counter_clk_hz) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not get RMT counter clock");
+        return ESP_FAIL;
+    }
+    rgbpixel_encode_init(counter_clk_hz);
+    // One callback serves all channels
+    g_rgbpixel_rmt_done_cb = done_cb;
+    rmt_register_tx_end_callback(rgbpixel_rmt_tx_end, NULL);
+
+#if CONFIG_RGBPIXEL_SYMBOL_CACHE
+    // The RMT ISR reads the items directly, they must be in internal RAM
+    output->items = heap_caps_malloc(pixels * RGBPIXEL_ENCODE_ITEMS_PER_PIXEL * sizeof(rgbpixel_rmt_item_t),
+                                     MALLOC_CAP_INTERNAL | MALLOC_CAP_32BIT);
+    if (!output->items)
+    {
+        ESP_LOGW(TAG, "No room for the symbol cache of RMT channel %d, translating every frame", output->channel);
+    }
+#endif
+    return ESP_OK;
+}
+
+esp_err_t rgbpixel_output_wait(uint8_t segment, TickType_t timeout)
+{
+    return rmt_wait_tx_done(g_rgbpixel_rmt_outputs[segment].channel, timeout);
+}
+
+esp_err_t rgbpixel_output_write(uint8_t segment, const uint8_t *frame, const uint8_t *previous, uint32_t *encoded_pixels)
+{
+    rgbpixel_rmt_output_t *output = &g_rgbpixel_rmt_outputs[segment];
+    if (!output->items)
+    {
+        *encoded_pixels = output->pixels;
+        return rmt_write_sample(output->channel, frame, output->pixels * RGBPIXEL_ENCODE_BYTES_PER_PIXEL, false);
+    }
+    // Only pixels that changed since the shown frame are re-encoded, RMT reads the items in place
+    *encoded_pixels = rgbpixel_encode_frame(output->items, frame, previous, output->pixels);
+    return rmt_write_items(output->channel, (const rmt_item32_t *)output->items,
+                           output->pixels * RGBPIXEL_ENCODE_ITEMS_PER_PIXEL, false);
+}
+
+const char *rgbpixel_output_name(void)
+{
+    return "RMT";
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,138 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sdkconfig.h>
+
+#if CONFIG_RGBPIXEL_OUTPUT_SPI
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <driver/spi_master.h>
+#include <string.h>
+#include <rgbpixel.h>
+#include <rgbpixel_encode.h>
+#include <rgbpixel_output.h>
+
+typedef struct
+{
+    spi_device_handle_t device;
+    spi_transaction_t transaction;
+    bool busy;          // Transaction queued and its result not collected yet
+    uint16_t pixels;
+    uint8_t *buffer;    // Encoded bitstream of the shown frame followed by the reset
+} rgbpixel_spi_output_t;
+
+// Each segment owns a whole SPI peripheral, only MOSI is routed
+static const spi_host_device_t g_rgbpixel_spi_hosts[] = {SPI2_HOST, SPI3_HOST};
+static rgbpixel_spi_output_t g_rgbpixel_spi_outputs[RGBPIXEL_SEGMENTS];
+static rgbpixel_output_done_cb_t g_rgbpixel_spi_done_cb;
+
+static const char *TAG = "rgbpixel_spi";
+
+static void IRAM_ATTR rgbpixel_spi_post_cb(spi_transaction_t *transaction)
+{
+    if (g_rgbpixel_spi_done_cb)
+        g_rgbpixel_spi_done_cb((uint8_t)(uintptr_t)transaction->user);
+}
+
+esp_err_t rgbpixel_output_init(uint8_t segment, int gpio, uint16_t pixels, rgbpixel_output_done_cb_t done_cb)
+{
+    if (segment >= sizeof(g_rgbpixel_spi_hosts) / sizeof(g_rgbpixel_spi_hosts[0]))
+    {
+        ESP_LOGE(TAG, "No SPI peripheral left for segment %d", segment);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    rgbpixel_spi_output_t *output = &g_rgbpixel_spi_outputs[segment];
+    size_t length = pixels * RGBPIXEL_ENCODE_SPI_BYTES_PER_PIXEL + RGBPIXEL_ENCODE_SPI_RESET_BYTES;
+    output->pixels = pixels;
+    // Zeroed, so the reset tail never has to be written
+    output->buffer = heap_caps_calloc(1, length, MALLOC_CAP_DMA);
+    if (!output->buffer)
+    {
+        ESP_LOGE(TAG, "Could not allocate DMA buffer for segment %d", segment);
+        return ESP_ERR_NO_MEM;
+    }
+
+    spi_bus_config_t bus_config = {
+        .mosi_io_num = gpio,
+        .miso_io_num = -1,
+        .sclk_io_num = -1,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = length,
+    };
+    spi_device_interface_config_t device_config = {
+        .clock_speed_hz = RGBPIXEL_ENCODE_SPI_CLOCK_HZ,
+        .mode = 0,
+        .spics_io_num = -1,
+        .queue_size = 1,
+        .post_cb = rgbpixel_spi_post_cb,
+    };
+    esp_err_t err = spi_bus_initialize(g_rgbpixel_spi_hosts[segment], &bus_config, SPI_DMA_CH_AUTO);
+    if (err == ESP_OK)
+        err = spi_bus_add_device(g_rgbpixel_spi_hosts[segment], &device_config, &output->device);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not setup SPI for segment %d: %s", segment, esp_err_to_name(err));
+        return err;
+    }
+
+    output->transaction.length = length * 8;
+    output->transaction.tx_buffer = output->buffer;
+    output->transaction.user = (void *)(uintptr_t)segment;
+    g_rgbpixel_spi_done_cb = done_cb;
+    rgbpixel_encode_spi_init();
+    return ESP_OK;
+}
+
+esp_err_t rgbpixel_output_wait(uint8_t segment, TickType_t timeout)
+{
+    rgbpixel_spi_output_t *output = &g_rgbpixel_spi_outputs[segment];
+    if (!output->busy)
+        return ESP_OK;
+    spi_transaction_t *transaction;
+    esp_err_t err = spi_device_get_trans_result(output->device, &transaction, timeout);
+    if (err == ESP_OK)
+        output->busy = false;
+    return err;
+}
+
+esp_err_t rgbpixel_output_write(uint8_t segment, const uint8_t *frame, const uint8_t *previous, uint32_t *encoded_pixels)
+{
+    rgbpixel_spi_output_t *output = &g_rgbpixel_spi_outputs[segment];
+    // The DMA buffer keeps the shown frame, so only changed pixels are re-encoded
+    *encoded_pixels = rgbpixel_encode_spi_frame(output->buffer, frame, previous, output->pixels);
+    esp_err_t err = spi_device_queue_trans(output->device, &output->transaction, 0);
+    if (err == ESP_OK)
+        output->busy = true;
+    return err;
+}
+
+const char *rgbpixel_output_name(void)
+{
+    return "SPI";
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <esp_err.h>
+
+typedef struct esp_rmaker_device esp_rmaker_device_t;
+typedef struct esp_rmaker_param esp_rmaker_param_t;
+
+typedef enum
+{
+    RMAKER_VAL_TYPE_INVALID,
+    RMAKER_VAL_TYPE_BOOLEAN,
+    RMAKER_VAL_TYPE_INTEGER,
+    RMAKER_VAL_TYPE_FLOAT,
+    RMAKER_VAL_TYPE_STRING,
+} esp_rmaker_val_type_t;
+
+typedef union
+{
+    bool b;
+    int i;
+    float f;
+    char *s;
+} esp_rmaker_val_t;
+
+typedef struct
+{
+    esp_rmaker_val_type_t type;
+    esp_rmaker_val_t val;
+} esp_rmaker_param_val_t;
+
+typedef enum
+{
+    ESP_RMAKER_REQ_SRC_INIT,
+    ESP_RMAKER_REQ_SRC_CLOUD,
+    ESP_RMAKER_REQ_SRC_SCHEDULE,
+    ESP_RMAKER_REQ_SRC_SCENE_ACTIVATE,
+    ESP_RMAKER_REQ_SRC_SCENE_DEACTIVATE,
+    ESP_RMAKER_REQ_SRC_LOCAL,
+    ESP_RMAKER_REQ_SRC_MAX,
+} esp_rmaker_req_src_t;
+
+esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param);
+esp_rmaker_param_t *esp_rmaker_device_get_param_by_name(const esp_rmaker_device_t *device, const char *name);
+esp_rmaker_param_t *esp_rmaker_device_get_param_by_type(const esp_rmaker_device_t *device, const char *type);
+esp_rmaker_param_val_t esp_rmaker_bool(bool val);
\ No newline at end of file
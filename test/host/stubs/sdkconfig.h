@@ -0,0 +1,74 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+/* Host build configuration, the Kconfig defaults of main/ unless a test
+ * passes its own with -D.
+ */
+#ifndef CONFIG_RGBPIXEL_STRIP_OUTPUT_GPIO
+#define CONFIG_RGBPIXEL_STRIP_OUTPUT_GPIO 5
+#endif
+#ifndef CONFIG_RGBPIXEL_STRIP_PIXELS
+#define CONFIG_RGBPIXEL_STRIP_PIXELS 24
+#endif
+#ifndef CONFIG_RGBPIXEL_FRAME_RATE
+#define CONFIG_RGBPIXEL_FRAME_RATE 25
+#endif
+#ifndef CONFIG_RGBPIXEL_TRANSITION_MS
+#define CONFIG_RGBPIXEL_TRANSITION_MS 400
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENTS
+#define CONFIG_RGBPIXEL_SEGMENTS 1
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENT_1_OUTPUT_GPIO
+#define CONFIG_RGBPIXEL_SEGMENT_1_OUTPUT_GPIO 4
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENT_1_PIXELS
+#define CONFIG_RGBPIXEL_SEGMENT_1_PIXELS 24
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENT_2_OUTPUT_GPIO
+#define CONFIG_RGBPIXEL_SEGMENT_2_OUTPUT_GPIO 2
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENT_2_PIXELS
+#define CONFIG_RGBPIXEL_SEGMENT_2_PIXELS 24
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENT_3_OUTPUT_GPIO
+#define CONFIG_RGBPIXEL_SEGMENT_3_OUTPUT_GPIO 15
+#endif
+#ifndef CONFIG_RGBPIXEL_SEGMENT_3_PIXELS
+#define CONFIG_RGBPIXEL_SEGMENT_3_PIXELS 24
+#endif
+#ifndef CONFIG_APP_ACTUATOR_SETTLE_MS
+#define CONFIG_APP_ACTUATOR_SETTLE_MS 10
+#endif
+
+// Logs go straight to stderr, there is no log task on the host
+#define CONFIG_APP_LOG_DEFERRED 0
+#define CONFIG_APP_LOG_RATE_LIMIT 10
+#define CONFIG_APP_TRACE 0
+#define CONFIG_RGBPIXEL_FRAME_DUMP 0
\ No newline at end of file
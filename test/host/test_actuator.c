@@ -0,0 +1,279 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <setjmp.h>
+#include <stdlib.h>
+
+#include <app_actuator.h>
+#include <app_log.h>
+#include <app_pm.h>
+#include <app_priv.h>
+#include <app_report.h>
+#include <app_tasks.h>
+#include <app_trace.h>
+#include <esp_timer.h>
+#include <rgbpixel.h>
+
+#include "host_test.h"
+
+HOST_TEST_DEFINE();
+
+/* The actuator task of main/app_actuator.c on a simulated clock. Each
+ * scenario is a list of writes as write_cb makes them, one call per param.
+ * They are delivered while the task waits, the first one wakes it, so the
+ * task is always ready to apply before the rest of a request has arrived.
+ * The fakes count the hardware updates and report flushes that result.
+ */
+#define TEST_TICK_US (1000000 / configTICK_RATE_HZ)
+
+typedef struct
+{
+    uint32_t at_us;
+    bool batch; // Cloud, scene or schedule request
+    app_actuator_target_t target;
+    app_actuator_value_t value;
+} test_write_t;
+
+struct host_task
+{
+    TaskFunction_t function;
+    bool notified;
+};
+
+static struct host_task g_test_task;
+static int64_t g_test_now_us;
+static jmp_buf g_test_idle;
+static const test_write_t *g_test_writes;
+static size_t g_test_write_count;
+static size_t g_test_write_next;
+static int64_t g_test_start_us;
+
+static uint32_t g_test_rgb_updates;
+static rgbpixel_update_t g_test_rgb_update;
+static uint32_t g_test_light0_updates;
+static bool g_test_light0_power;
+static uint16_t g_test_light0_brightness;
+static uint32_t g_test_flushes;
+
+/* Services used by app_actuator.c */
+
+int64_t esp_timer_get_time(void)
+{
+    return g_test_now_us;
+}
+
+esp_err_t rgbpixel_update(uint8_t segment, const rgbpixel_update_t *update)
+{
+    g_test_rgb_updates++;
+    g_test_rgb_update = *update;
+    return ESP_OK;
+}
+
+esp_err_t rgbpixel_start_anim(rgbpixel_effect_id_t anim, bool run_once)
+{
+    return ESP_OK;
+}
+
+esp_err_t app_driver_set_light0_state(bool power, uint16_t brightness)
+{
+    g_test_light0_updates++;
+    g_test_light0_power = power;
+    g_test_light0_brightness = brightness;
+    return ESP_OK;
+}
+
+esp_err_t app_driver_set_light0_brightness(uint16_t brightness)
+{
+    return app_driver_set_light0_state(true, brightness);
+}
+
+uint16_t app_driver_get_light0_brightness(void)
+{
+    return g_test_light0_brightness;
+}
+
+int app_driver_set_light3_power_state(bool state)
+{
+    return ESP_OK;
+}
+
+esp_err_t app_report_flush(void)
+{
+    g_test_flushes++;
+    return ESP_OK;
+}
+
+bool app_log_admit(app_log_site_t *site)
+{
+    return true;
+}
+
+const char *app_log_module_name(app_log_module_t module)
+{
+    return "actuator";
+}
+
+void app_pm_acquire(app_pm_lock_t lock)
+{
+}
+
+void app_pm_release(app_pm_lock_t lock)
+{
+}
+
+esp_err_t app_task_create(app_task_t task, TaskFunction_t function, void *arg, TaskHandle_t *handle)
+{
+    g_test_task.function = function;
+    *handle = &g_test_task;
+    return ESP_OK;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    task->notified = true;
+    return pdPASS;
+}
+
+// Scripted writes arrive while the task waits, an idle task ends the scenario
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    int64_t wake_us = ticks_to_wait == portMAX_DELAY ? INT64_MAX : g_test_now_us + (int64_t)ticks_to_wait * TEST_TICK_US;
+    while (!g_test_task.notified)
+    {
+        const test_write_t *write = g_test_write_next < g_test_write_count ? &g_test_writes[g_test_write_next] : NULL;
+        if (write && g_test_start_us + write->at_us <= wake_us)
+        {
+            if (g_test_start_us + write->at_us > g_test_now_us)
+                g_test_now_us = g_test_start_us + write->at_us;
+            g_test_write_next++;
+            // What write_cb does for the param
+            if (write->batch)
+                app_actuator_batch_begin();
+            CHECK(app_actuator_submit(write->target, 0, write->value, APP_TRACE_NONE) == ESP_OK, "submit failed");
+            if (write->batch)
+                app_actuator_batch_end();
+            continue;
+        }
+        if (ticks_to_wait == portMAX_DELAY)
+            longjmp(g_test_idle, 1);
+        g_test_now_us = wake_us;
+        return 0;
+    }
+    g_test_task.notified = false;
+    return 1;
+}
+
+static void test_run(const test_write_t *writes, size_t count, app_actuator_stats_t *delta)
+{
+    app_actuator_stats_t before;
+    app_actuator_get_stats(&before);
+    g_test_writes = writes;
+    g_test_write_count = count;
+    g_test_write_next = 0;
+    g_test_start_us = g_test_now_us;
+    g_test_rgb_updates = 0;
+    g_test_light0_updates = 0;
+    g_test_flushes = 0;
+    memset(&g_test_rgb_update, 0, sizeof(g_test_rgb_update));
+    if (setjmp(g_test_idle) == 0)
+        g_test_task.function(NULL);
+    app_actuator_get_stats(delta);
+    delta->submitted -= before.submitted;
+    delta->transactions -= before.transactions;
+    delta->settled -= before.settled;
+    delta->updates -= before.updates;
+    delta->coalesced -= before.coalesced;
+}
+
+// A scene sets power, hue, saturation and brightness of the RGB light and both params of the dimmer
+static void test_scene(void)
+{
+    static const test_write_t writes[] = {
+        {0, true, APP_ACTUATOR_RGB_POWER, {.b = true}},
+        {150, true, APP_ACTUATOR_RGB_HUE, {.i = 120}},
+        {300, true, APP_ACTUATOR_RGB_SATURATION, {.i = 80}},
+        {450, true, APP_ACTUATOR_RGB_BRIGHTNESS, {.i = 60}},
+        {600, true, APP_ACTUATOR_LIGHT0_POWER, {.b = true}},
+        {750, true, APP_ACTUATOR_LIGHT0_BRIGHTNESS, {.i = 40}},
+    };
+    app_actuator_stats_t stats;
+    test_run(writes, sizeof(writes) / sizeof(writes[0]), &stats);
+
+    uint8_t all = RGBPIXEL_UPDATE_POWER | RGBPIXEL_UPDATE_HUE | RGBPIXEL_UPDATE_SATURATION | RGBPIXEL_UPDATE_BRIGHTNESS;
+    CHECK(g_test_rgb_updates == 1, "scene: %u RGB updates", g_test_rgb_updates);
+    CHECK(g_test_rgb_update.fields == all && g_test_rgb_update.hue == 120 && g_test_rgb_update.saturation == 80 &&
+              g_test_rgb_update.brightness == 60 && g_test_rgb_update.power,
+          "scene: RGB update with fields %02x", g_test_rgb_update.fields);
+    CHECK(g_test_light0_updates == 1 && g_test_light0_power && g_test_light0_brightness == 40,
+          "scene: %u dimmer updates", g_test_light0_updates);
+    CHECK(g_test_flushes == 1, "scene: %u report flushes", g_test_flushes);
+    CHECK(stats.submitted == 6 && stats.transactions == 1 && stats.settled == 1 && stats.updates == 2,
+          "scene: %u params, %u transactions, %u updates", stats.submitted, stats.transactions, stats.updates);
+    // Applied one settle window after the last param
+    CHECK(stats.latency_max_us <= 750 + (CONFIG_APP_ACTUATOR_SETTLE_MS * 1000 / TEST_TICK_US + 1) * TEST_TICK_US,
+          "scene: applied %u us after the first param", stats.latency_max_us);
+}
+
+// Local control and the device itself do not wait
+static void test_local(void)
+{
+    static const test_write_t writes[] = {
+        {0, false, APP_ACTUATOR_RGB_HUE, {.i = 200}},
+        {150, false, APP_ACTUATOR_RGB_BRIGHTNESS, {.i = 30}},
+    };
+    app_actuator_stats_t stats;
+    test_run(writes, sizeof(writes) / sizeof(writes[0]), &stats);
+    CHECK(stats.settled == 0 && stats.transactions == 2 && g_test_rgb_updates == 2,
+          "local: %u transactions, %u settled", stats.transactions, stats.settled);
+    CHECK(stats.latency_us == 0, "local: applied %u us after the write", stats.latency_us);
+}
+
+// A schedule that keeps writing is still applied within the settle bound
+static void test_stream(void)
+{
+    static test_write_t writes[40];
+    for (size_t i = 0; i < sizeof(writes) / sizeof(writes[0]); i++)
+    {
+        writes[i] = (test_write_t){i * 5000, true, APP_ACTUATOR_RGB_HUE, {.i = i}};
+    }
+    app_actuator_stats_t stats;
+    test_run(writes, sizeof(writes) / sizeof(writes[0]), &stats);
+    CHECK(stats.transactions >= 200 / (5 * CONFIG_APP_ACTUATOR_SETTLE_MS + TEST_TICK_US / 1000),
+          "stream: %u transactions in 200 ms", stats.transactions);
+    CHECK(g_test_rgb_update.hue == 39, "stream: last hue %u", g_test_rgb_update.hue);
+}
+
+int main(int argc, char **argv)
+{
+    CHECK(app_actuator_init() == ESP_OK && g_test_task.function, "init failed");
+    if (!g_test_task.function)
+        return host_test_result("test_actuator");
+    test_scene();
+    test_local();
+    test_stream();
+    return host_test_result("test_actuator");
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+
+#include <rgbpixel_color.h>
+
+#include "host_test.h"
+
+HOST_TEST_DEFINE();
+
+/* The float and double colour code rgbpixel used before the fixed point
+ * version, kept as the reference the integer math is held to.
+ */
+static void reference_hsv2rgb(uint32_t hue, uint32_t saturation, uint32_t brightness, uint32_t *red, uint32_t *green,
+                              uint32_t *blue)
+{
+    hue %= 360;
+    uint32_t rgb_max = brightness * 2.55f;
+    uint32_t rgb_min = rgb_max * (100 - saturation) / 100.0f;
+    uint32_t quadrant = hue / 60;
+    uint32_t diff = hue % 60;
+    uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+    switch (quadrant)
+    {
+    case 0:
+        *red = rgb_max;
+        *green = rgb_min + rgb_adj;
+        *blue = rgb_min;
+        break;
+    case 1:
+        *red = rgb_max - rgb_adj;
+        *green = rgb_max;
+        *blue = rgb_min;
+        break;
+    case 2:
+        *red = rgb_min;
+        *green = rgb_max;
+        *blue = rgb_min + rgb_adj;
+        break;
+    case 3:
+        *red = rgb_min;
+        *green = rgb_max - rgb_adj;
+        *blue = rgb_max;
+        break;
+    case 4:
+        *red = rgb_min + rgb_adj;
+        *green = rgb_min;
+        *blue = rgb_max;
+        break;
+    default:
+        *red = rgb_max;
+        *green = rgb_min;
+        *blue = rgb_max - rgb_adj;
+        break;
+    }
+}
+
+static uint8_t reference_lerp_channel(uint8_t start, uint8_t end, double t)
+{
+    return start * (1 - t) + end * t;
+}
+
+static uint8_t reference_scale_channel(uint8_t channel, uint32_t percent)
+{
+    return channel * percent * 0.01f;
+}
+
+static void test_hsv2rgb(void)
+{
+    uint32_t diffs = 0;
+    for (uint32_t hue = 0; hue < 360; hue++)
+    {
+        for (uint32_t saturation = 0; saturation <= 100; saturation++)
+        {
+            for (uint32_t brightness = 0; brightness <= 100; brightness++)
+            {
+                uint32_t r, g, b, ref_r, ref_g, ref_b;
+                rgbpixel_color_hsv2rgb(hue, saturation, brightness, &r, &g, &b);
+                reference_hsv2rgb(hue, saturation, brightness, &ref_r, &ref_g, &ref_b);
+                if (r != ref_r || g != ref_g || b != ref_b)
+                    diffs++;
+            }
+        }
+    }
+    CHECK(diffs == 0, "hsv2rgb differs from the float version for %u inputs", diffs);
+}
+
+static void test_lerp(void)
+{
+    int max_error = 0;
+    for (uint32_t start = 0; start < 256; start++)
+    {
+        for (uint32_t end = 0; end < 256; end++)
+        {
+            for (uint16_t t = 0; t <= RGBPIXEL_Q8_ONE; t++)
+            {
+                // The channel under test is red, green and blue get the mirrored values
+                uint32_t from = rgbpixel_color_rgb(start, end, 255 - start);
+                uint32_t to = rgbpixel_color_rgb(end, start, 255 - end);
+                uint32_t color = rgbpixel_color_lerp(from, to, t);
+                double weight = (double)t / RGBPIXEL_Q8_ONE;
+                int errors[3] = {
+                    (int)((color >> 16) & 0xFF) - reference_lerp_channel(start, end, weight),
+                    (int)((color >> 8) & 0xFF) - reference_lerp_channel(end, start, weight),
+                    (int)(color & 0xFF) - reference_lerp_channel(255 - start, 255 - end, weight),
+                };
+                for (int i = 0; i < 3; i++)
+                {
+                    int error = abs(errors[i]);
+                    if (error > max_error)
+                        max_error = error;
+                }
+            }
+        }
+    }
+    CHECK(max_error <= 1, "lerp is %d LSB off the double version", max_error);
+    CHECK(rgbpixel_color_lerp(0x102030, 0xF0E0D0, 0) == 0x102030, "lerp at 0 is not the start colour");
+    CHECK(rgbpixel_color_lerp(0x102030, 0xF0E0D0, RGBPIXEL_Q8_ONE) == 0xF0E0D0, "lerp at one is not the end colour");
+}
+
+static void test_scale(void)
+{
+    int max_error = 0;
+    for (uint32_t percent = 0; percent <= 100; percent++)
+    {
+        uint16_t scale = rgbpixel_color_percent_to_q8(percent);
+        for (uint32_t channel = 0; channel < 256; channel++)
+        {
+            uint32_t color = rgbpixel_color_scale(rgbpixel_color_rgb(channel, channel, channel), scale);
+            int error = abs((int)(color & 0xFF) - reference_scale_channel(channel, percent));
+            if (error > max_error)
+                max_error = error;
+            CHECK(color == ((color & 0xFF) * 0x010101), "scale treats the channels differently");
+        }
+    }
+    CHECK(max_error <= 1, "scale is %d LSB off the float version", max_error);
+    CHECK(rgbpixel_color_scale(0xFFFFFF, RGBPIXEL_Q8_ONE) == 0xFFFFFF, "full scale changes the colour");
+}
+
+#define BENCH_ROUNDS 2000000
+
+static void bench(void)
+{
+    uint32_t r, g, b;
+    uint64_t start = host_test_now_ns();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        rgbpixel_color_hsv2rgb(i % 360, i % 101, (i >> 3) % 101, &r, &g, &b);
+        host_test_keep(r + g + b);
+    }
+    uint64_t fixed_ns = host_test_now_ns() - start;
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        reference_hsv2rgb(i % 360, i % 101, (i >> 3) % 101, &r, &g, &b);
+        host_test_keep(r + g + b);
+    }
+    uint64_t float_ns = host_test_now_ns() - start;
+    printf("hsv2rgb: %.2f ns fixed, %.2f ns float\n", (double)fixed_ns / BENCH_ROUNDS, (double)float_ns / BENCH_ROUNDS);
+
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        host_test_keep(rgbpixel_color_lerp(i * 0x9E3779B9u, ~i, i & 0xFF));
+    }
+    fixed_ns = host_test_now_ns() - start;
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        uint32_t from = i * 0x9E3779B9u;
+        uint32_t to = ~i;
+        double t = (double)(i & 0xFF) / RGBPIXEL_Q8_ONE;
+        host_test_keep(reference_lerp_channel(from >> 16, to >> 16, t) + reference_lerp_channel(from >> 8, to >> 8, t) +
+                       reference_lerp_channel(from, to, t));
+    }
+    float_ns = host_test_now_ns() - start;
+    printf("lerp: %.2f ns fixed, %.2f ns double\n", (double)fixed_ns / BENCH_ROUNDS, (double)float_ns / BENCH_ROUNDS);
+
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        host_test_keep(rgbpixel_color_scale(i * 0x9E3779B9u, rgbpixel_color_percent_to_q8(i % 101)));
+    }
+    fixed_ns = host_test_now_ns() - start;
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        uint32_t color = i * 0x9E3779B9u;
+        host_test_keep(reference_scale_channel(color >> 16, i % 101) + reference_scale_channel(color >> 8, i % 101) +
+                       reference_scale_channel(color, i % 101));
+    }
+    float_ns = host_test_now_ns() - start;
+    printf("scale: %.2f ns fixed, %.2f ns float\n", (double)fixed_ns / BENCH_ROUNDS, (double)float_ns / BENCH_ROUNDS);
+}
+
+int main(int argc, char **argv)
+{
+    test_hsv2rgb();
+    test_lerp();
+    test_scale();
+    if (host_test_bench_requested(argc, argv))
+        bench();
+    return host_test_result("test_color");
+}
\ No newline at end of file
@@ -0,0 +1,322 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+
+#include <app_device.h>
+#include <ioc_standard_params.h>
+
+#include "host_test.h"
+
+HOST_TEST_DEFINE();
+
+/* The params of the node are registered through app_device_add_param() and
+ * app_device_bind_param() as app_devices_init() does, then write_cb's
+ * app_device_find_handler() resolves a write to every one of them. Before
+ * it, a chain of strcmp on the device and then the param name picked the
+ * branch. Both must agree, and --bench times them per write.
+ */
+#define TEST_SEGMENTS 4
+#define TEST_MAX_DEVICES (TEST_SEGMENTS + 3)
+#define TEST_DEVICE_PARAMS 8
+#define TEST_MAX_PARAMS (TEST_MAX_DEVICES * TEST_DEVICE_PARAMS)
+#define BENCH_ROUNDS 200000
+
+// Opaque in RainMaker, just enough here to hold what write_cb is given
+struct esp_rmaker_param
+{
+    const char *name;
+};
+
+struct esp_rmaker_device
+{
+    char name[16];
+    app_device_ctx_t ctx;
+    uint8_t count;
+    esp_rmaker_param_t *params[TEST_DEVICE_PARAMS];
+};
+
+typedef struct
+{
+    const esp_rmaker_device_t *device;
+    const esp_rmaker_param_t *param;
+} test_write_t;
+
+enum
+{
+    TEST_POWER,
+    TEST_BRIGHTNESS,
+    TEST_HUE,
+    TEST_SATURATION,
+    TEST_EFFECT,
+    TEST_NAME,
+    TEST_REBOOT,
+    TEST_WIFI_RESET,
+    TEST_FACTORY_RESET,
+    TEST_HANDLERS,
+};
+
+static uint32_t g_test_calls[TEST_HANDLERS];
+
+// Distinct bodies, so the handlers keep distinct addresses
+#define TEST_HANDLER(fn, id)                                                              \
+    static esp_err_t fn(const app_device_ctx_t *device, const esp_rmaker_param_val_t val, uint16_t trace) \
+    {                                                                                     \
+        g_test_calls[id]++;                                                               \
+        return ESP_OK;                                                                    \
+    }
+
+TEST_HANDLER(power_cb, TEST_POWER)
+TEST_HANDLER(brightness_cb, TEST_BRIGHTNESS)
+TEST_HANDLER(hue_cb, TEST_HUE)
+TEST_HANDLER(saturation_cb, TEST_SATURATION)
+TEST_HANDLER(effect_cb, TEST_EFFECT)
+TEST_HANDLER(name_cb, TEST_NAME)
+TEST_HANDLER(reboot_cb, TEST_REBOOT)
+TEST_HANDLER(wifi_reset_cb, TEST_WIFI_RESET)
+TEST_HANDLER(factory_reset_cb, TEST_FACTORY_RESET)
+
+static esp_rmaker_device_t g_test_devices[TEST_MAX_DEVICES];
+static uint8_t g_test_device_count;
+static esp_rmaker_param_t g_test_params[TEST_MAX_PARAMS];
+static uint8_t g_test_param_count;
+static test_write_t g_test_writes[TEST_MAX_PARAMS];
+static size_t g_test_write_count;
+
+/* RainMaker device and param registry, every param added gets a write */
+
+esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param)
+{
+    esp_rmaker_device_t *dev = (esp_rmaker_device_t *)device;
+    if (!param || dev->count >= TEST_DEVICE_PARAMS)
+        return ESP_ERR_INVALID_ARG;
+    dev->params[dev->count++] = (esp_rmaker_param_t *)param;
+    g_test_writes[g_test_write_count].device = dev;
+    g_test_writes[g_test_write_count].param = param;
+    g_test_write_count++;
+    return ESP_OK;
+}
+
+esp_rmaker_param_t *esp_rmaker_device_get_param_by_name(const esp_rmaker_device_t *device, const char *name)
+{
+    for (uint8_t i = 0; i < device->count; i++)
+    {
+        if (strcmp(device->params[i]->name, name) == 0)
+            return device->params[i];
+    }
+    return NULL;
+}
+
+static esp_rmaker_param_t *test_param_create(const char *name)
+{
+    esp_rmaker_param_t *param = &g_test_params[g_test_param_count++];
+    param->name = name;
+    return param;
+}
+
+static esp_rmaker_device_t *test_device_create(const char *name)
+{
+    esp_rmaker_device_t *device = &g_test_devices[g_test_device_count++];
+    snprintf(device->name, sizeof(device->name), "%s", name);
+    esp_rmaker_device_add_param(device, test_param_create(IOC_DEF_NAME_PARAM));
+    return device;
+}
+
+// What ioc_lightbulb_device_create() registers: name and power
+static esp_rmaker_device_t *test_light_create(const char *name)
+{
+    esp_rmaker_device_t *device = test_device_create(name);
+    esp_rmaker_device_add_param(device, test_param_create(IOC_DEF_POWER_NAME));
+    return device;
+}
+
+static void test_add(esp_rmaker_device_t *device, const char *name, app_param_handler_t handler)
+{
+    CHECK(app_device_add_param(&device->ctx, device, test_param_create(name), handler) == ESP_OK,
+          "%s - %s not registered", device->name, name);
+}
+
+static void test_bind(esp_rmaker_device_t *device, const char *name, app_param_handler_t handler)
+{
+    CHECK(app_device_bind_param(&device->ctx, esp_rmaker_device_get_param_by_name(device, name), handler) == ESP_OK,
+          "%s - %s not bound", device->name, name);
+}
+
+// The node of app_devices_init(), the sensors take no writes
+static void test_devices_init(void)
+{
+    esp_rmaker_device_t *device = test_light_create("Bedroom Light");
+    test_bind(device, IOC_DEF_POWER_NAME, power_cb);
+    test_add(device, IOC_DEF_BRIGHTNESS_NAME, brightness_cb);
+
+    device = test_light_create("Wall Light");
+    test_bind(device, IOC_DEF_POWER_NAME, power_cb);
+
+    for (int i = 0; i < TEST_SEGMENTS; i++)
+    {
+        char name[16] = "RGB Light";
+        if (i > 0)
+            snprintf(name, sizeof(name), "RGB Light %d", i + 1);
+        device = test_light_create(name);
+        device->ctx.index = i;
+        test_bind(device, IOC_DEF_POWER_NAME, power_cb);
+        test_add(device, IOC_DEF_HUE_NAME, hue_cb);
+        test_add(device, IOC_DEF_SATURATION_NAME, saturation_cb);
+        test_add(device, IOC_DEF_BRIGHTNESS_NAME, brightness_cb);
+        test_add(device, IOC_DEF_EFFECT_NAME, effect_cb);
+    }
+
+    device = test_device_create("ESP Device");
+    test_bind(device, IOC_DEF_NAME_PARAM, name_cb);
+    test_add(device, IOC_DEF_REBOOT_NAME, reboot_cb);
+    test_add(device, IOC_DEF_WIFI_RESET_NAME, wifi_reset_cb);
+    test_add(device, IOC_DEF_FACTORY_RESET_NAME, factory_reset_cb);
+}
+
+// Bindings past the table, of a missing param or without a handler are refused and leave it as it was
+static void test_bind_limits(void)
+{
+    static esp_rmaker_param_t params[APP_DEVICE_MAX_PARAMS + 1];
+    app_device_ctx_t ctx = {0};
+    for (int i = 0; i < APP_DEVICE_MAX_PARAMS; i++)
+    {
+        CHECK(app_device_bind_param(&ctx, &params[i], power_cb) == ESP_OK, "binding %d refused", i);
+    }
+    CHECK(app_device_bind_param(&ctx, &params[APP_DEVICE_MAX_PARAMS], power_cb) == ESP_ERR_NO_MEM,
+          "binding past APP_DEVICE_MAX_PARAMS accepted");
+    CHECK(ctx.count == APP_DEVICE_MAX_PARAMS, "%u bindings", ctx.count);
+    CHECK(!app_device_find_handler(&ctx, &params[APP_DEVICE_MAX_PARAMS]), "refused binding resolves");
+
+    app_device_ctx_t empty = {0};
+    CHECK(app_device_bind_param(&empty, NULL, power_cb) == ESP_ERR_INVALID_ARG, "binding of a missing param accepted");
+    CHECK(app_device_bind_param(&empty, &params[0], NULL) == ESP_ERR_INVALID_ARG, "binding without a handler accepted");
+    CHECK(empty.count == 0, "%u bindings after refusals", empty.count);
+}
+
+// The strcmp chain write_cb used to run, with the params it has gained since
+static app_param_handler_t legacy_find_handler(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param)
+{
+    const char *device_name = device->name;
+    const char *param_name = param->name;
+    if (strcmp(device_name, "Bedroom Light") == 0)
+    {
+        if (strcmp(param_name, IOC_DEF_POWER_NAME) == 0)
+            return power_cb;
+        else if (strcmp(param_name, IOC_DEF_BRIGHTNESS_NAME) == 0)
+            return brightness_cb;
+    }
+    else if (strcmp(device_name, "Wall Light") == 0)
+    {
+        if (strcmp(param_name, IOC_DEF_POWER_NAME) == 0)
+            return power_cb;
+    }
+    else if (strncmp(device_name, "RGB Light", strlen("RGB Light")) == 0)
+    {
+        if (strcmp(param_name, IOC_DEF_POWER_NAME) == 0)
+            return power_cb;
+        else if (strcmp(param_name, IOC_DEF_BRIGHTNESS_NAME) == 0)
+            return brightness_cb;
+        else if (strcmp(param_name, IOC_DEF_HUE_NAME) == 0)
+            return hue_cb;
+        else if (strcmp(param_name, IOC_DEF_SATURATION_NAME) == 0)
+            return saturation_cb;
+        else if (strcmp(param_name, IOC_DEF_EFFECT_NAME) == 0)
+            return effect_cb;
+    }
+    else if (strcmp(device_name, "ESP Device") == 0)
+    {
+        if (strcmp(param_name, IOC_DEF_NAME_PARAM) == 0)
+            return name_cb;
+        else if (strcmp(param_name, IOC_DEF_REBOOT_NAME) == 0)
+            return reboot_cb;
+        else if (strcmp(param_name, IOC_DEF_WIFI_RESET_NAME) == 0)
+            return wifi_reset_cb;
+        else if (strcmp(param_name, IOC_DEF_FACTORY_RESET_NAME) == 0)
+            return factory_reset_cb;
+    }
+    return NULL;
+}
+
+static void test_dispatch(void)
+{
+    esp_rmaker_param_val_t val = {.type = RMAKER_VAL_TYPE_BOOLEAN};
+    for (size_t i = 0; i < g_test_write_count; i++)
+    {
+        const test_write_t *write = &g_test_writes[i];
+        app_param_handler_t handler = app_device_find_handler(&write->device->ctx, write->param);
+        CHECK(handler == legacy_find_handler(write->device, write->param), "%s - %s resolved to another handler",
+              write->device->name, write->param->name);
+        if (handler)
+            handler(&write->device->ctx, val, 0);
+    }
+    // Each light takes power and brightness, the RGB lights the colour and effect as well
+    CHECK(g_test_calls[TEST_POWER] == 2 + TEST_SEGMENTS, "%u power writes", g_test_calls[TEST_POWER]);
+    CHECK(g_test_calls[TEST_BRIGHTNESS] == 1 + TEST_SEGMENTS, "%u brightness writes", g_test_calls[TEST_BRIGHTNESS]);
+    CHECK(g_test_calls[TEST_EFFECT] == TEST_SEGMENTS, "%u effect writes", g_test_calls[TEST_EFFECT]);
+    CHECK(g_test_calls[TEST_FACTORY_RESET] == 1, "%u factory reset writes", g_test_calls[TEST_FACTORY_RESET]);
+
+    // A device without bindings and a param of another device resolve to nothing
+    CHECK(!app_device_find_handler(NULL, g_test_writes[0].param), "write without a device context resolved");
+    CHECK(!app_device_find_handler(&g_test_devices[0].ctx, g_test_writes[g_test_write_count - 1].param),
+          "param of another device resolved");
+}
+
+static double bench_writes(const test_write_t *writes, size_t count, bool legacy)
+{
+    uint64_t start = host_test_now_ns();
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const test_write_t *write = &writes[i];
+            app_param_handler_t handler = legacy ? legacy_find_handler(write->device, write->param)
+                                                 : app_device_find_handler(&write->device->ctx, write->param);
+            host_test_keep((uint32_t)(uintptr_t)handler);
+        }
+    }
+    return (double)(host_test_now_ns() - start) / ((double)BENCH_ROUNDS * count);
+}
+
+static void bench_dispatch(void)
+{
+    // Every param once, then the one furthest down the chain
+    const test_write_t *last = &g_test_writes[g_test_write_count - 1];
+    printf("dispatch, %zu params: %.1f ns per write by param pointer, %.1f ns by name\n", g_test_write_count,
+           bench_writes(g_test_writes, g_test_write_count, false), bench_writes(g_test_writes, g_test_write_count, true));
+    printf("dispatch, %s - %s: %.1f ns by param pointer, %.1f ns by name\n", last->device->name, last->param->name,
+           bench_writes(last, 1, false), bench_writes(last, 1, true));
+}
+
+int main(int argc, char **argv)
+{
+    test_devices_init();
+    test_dispatch();
+    test_bind_limits();
+    if (host_test_bench_requested(argc, argv))
+        bench_dispatch();
+    return host_test_result("test_dispatch");
+}
\ No newline at end of file
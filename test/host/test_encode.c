@@ -0,0 +1,248 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+
+#include <rgbpixel_encode.h>
+
+#include "host_test.h"
+
+HOST_TEST_DEFINE();
+
+#define TEST_PIXELS 300
+#define TEST_RMT_CLOCK_HZ 40000000 // APB / 2, as the RMT output sets it up
+
+/* Reference decoder: a WS2812 bit is a high pulse followed by a low one, the
+ * chip tells the values apart by sampling the line about 0.6 us after the
+ * rising edge. Zeros must be high for 200-500 ns, ones for more than 550 ns,
+ * and a bit may not take longer than 5 us, that would latch the frame.
+ */
+static bool reference_decode_rmt(const rgbpixel_rmt_item_t *items, size_t bytes, uint32_t clock_hz, uint8_t *out)
+{
+    for (size_t i = 0; i < bytes; i++)
+    {
+        uint8_t byte = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            const rgbpixel_rmt_item_t *item = &items[i * 8 + bit];
+            uint64_t high_ns = (uint64_t)item->duration0 * 1000000000ULL / clock_hz;
+            uint64_t low_ns = (uint64_t)item->duration1 * 1000000000ULL / clock_hz;
+            if (item->level0 != 1 || item->level1 != 0 || high_ns + low_ns > 5000 || low_ns < 200)
+                return false;
+            if (high_ns >= 200 && high_ns <= 500)
+                byte <<= 1;
+            else if (high_ns > 550)
+                byte = (byte << 1) | 1;
+            else
+                return false;
+        }
+        out[i] = byte;
+    }
+    return true;
+}
+
+static void random_frame(uint8_t *frame, uint16_t pixels)
+{
+    for (size_t i = 0; i < pixels * RGBPIXEL_ENCODE_BYTES_PER_PIXEL; i++)
+    {
+        frame[i] = rand();
+    }
+}
+
+static void test_rmt_frame(uint32_t clock_hz)
+{
+    static rgbpixel_rmt_item_t items[TEST_PIXELS * RGBPIXEL_ENCODE_ITEMS_PER_PIXEL];
+    static uint8_t frames[2][TEST_PIXELS * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+    static uint8_t decoded[TEST_PIXELS * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+    rgbpixel_encode_init(clock_hz);
+
+    random_frame(frames[0], TEST_PIXELS);
+    size_t encoded = rgbpixel_encode_frame(items, frames[0], NULL, TEST_PIXELS);
+    CHECK(encoded == TEST_PIXELS, "full encode at %u Hz did %zu pixels", clock_hz, encoded);
+    CHECK(reference_decode_rmt(items, sizeof(decoded), clock_hz, decoded), "bit timing out of spec at %u Hz", clock_hz);
+    CHECK(memcmp(decoded, frames[0], sizeof(decoded)) == 0, "full encode at %u Hz decodes to other pixels", clock_hz);
+
+    // Every 7th pixel changes, only those are encoded again and the items still hold the whole frame
+    memcpy(frames[1], frames[0], sizeof(frames[1]));
+    size_t changed = 0;
+    for (uint16_t i = 0; i < TEST_PIXELS; i += 7)
+    {
+        frames[1][i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL + (i % 3)] ^= 0x5A;
+        changed++;
+    }
+    encoded = rgbpixel_encode_frame(items, frames[1], frames[0], TEST_PIXELS);
+    CHECK(encoded == changed, "cached encode did %zu pixels for %zu changes", encoded, changed);
+    CHECK(reference_decode_rmt(items, sizeof(decoded), clock_hz, decoded) && memcmp(decoded, frames[1], sizeof(decoded)) == 0,
+          "cached encode at %u Hz decodes to other pixels", clock_hz);
+
+    encoded = rgbpixel_encode_frame(items, frames[1], frames[1], TEST_PIXELS);
+    CHECK(encoded == 0, "unchanged frame encoded %zu pixels", encoded);
+}
+
+static void test_rmt_bytes(void)
+{
+    static const uint8_t bytes[] = {0x00, 0xFF, 0x80, 0x01, 0xA5, 0x5A};
+    rgbpixel_rmt_item_t items[sizeof(bytes) * 8];
+    uint8_t decoded[sizeof(bytes)];
+    rgbpixel_encode_init(TEST_RMT_CLOCK_HZ);
+    // The sample translator path, MSB first
+    rgbpixel_encode_bytes(items, bytes, sizeof(bytes));
+    CHECK(reference_decode_rmt(items, sizeof(bytes), TEST_RMT_CLOCK_HZ, decoded) && memcmp(decoded, bytes, sizeof(bytes)) == 0,
+          "encoded bytes decode to other values");
+    CHECK(items[8].val == items[9].val && items[0].val != items[8].val, "0x00 and 0xFF do not use the two bit items");
+}
+
+/* Reference decoder of the SPI bitstream, one bit per 1 / 2.5 MHz = 400 ns.
+ * Every WS2812 bit must be exactly three SPI bits: a high first, a low last
+ * and the middle one giving the value, so high pulses are 400 ns (zero) or
+ * 800 ns (one) in a 1.2 us period.
+ */
+static bool reference_decode_spi(const uint8_t *stream, size_t bytes, uint8_t *out)
+{
+    const uint32_t bit_ns = 1000000000 / RGBPIXEL_ENCODE_SPI_CLOCK_HZ;
+    CHECK(bit_ns == 400, "SPI clock is not 2.5 MHz");
+    for (size_t i = 0; i < bytes; i++)
+    {
+        uint8_t byte = 0;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            size_t first = (i * 8 + bit) * 3;
+            bool level[3];
+            for (int j = 0; j < 3; j++)
+            {
+                size_t n = first + j;
+                level[j] = stream[n / 8] & (0x80 >> (n % 8));
+            }
+            if (!level[0] || level[2])
+                return false;
+            uint32_t high_ns = (level[1] ? 2 : 1) * bit_ns;
+            byte = (byte << 1) | (high_ns > 550);
+        }
+        out[i] = byte;
+    }
+    return true;
+}
+
+static void test_spi_frame(void)
+{
+    static uint8_t stream[TEST_PIXELS * RGBPIXEL_ENCODE_SPI_BYTES_PER_PIXEL + RGBPIXEL_ENCODE_SPI_RESET_BYTES];
+    static uint8_t frames[2][TEST_PIXELS * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+    static uint8_t decoded[TEST_PIXELS * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+    const uint8_t *tail = &stream[TEST_PIXELS * RGBPIXEL_ENCODE_SPI_BYTES_PER_PIXEL];
+    static const uint8_t zeros[RGBPIXEL_ENCODE_SPI_RESET_BYTES];
+    rgbpixel_encode_spi_init();
+
+    // Zeroed like the DMA buffer, the tail is never written
+    memset(stream, 0, sizeof(stream));
+    random_frame(frames[0], TEST_PIXELS);
+    size_t encoded = rgbpixel_encode_spi_frame(stream, frames[0], NULL, TEST_PIXELS);
+    CHECK(encoded == TEST_PIXELS, "full SPI encode did %zu pixels", encoded);
+    CHECK(reference_decode_spi(stream, sizeof(decoded), decoded) && memcmp(decoded, frames[0], sizeof(decoded)) == 0,
+          "full SPI encode decodes to other pixels");
+
+    memcpy(frames[1], frames[0], sizeof(frames[1]));
+    for (uint16_t i = 0; i < TEST_PIXELS; i += 5)
+    {
+        frames[1][i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL + 2] = ~frames[1][i * RGBPIXEL_ENCODE_BYTES_PER_PIXEL + 2];
+    }
+    encoded = rgbpixel_encode_spi_frame(stream, frames[1], frames[0], TEST_PIXELS);
+    CHECK(encoded == (TEST_PIXELS + 4) / 5, "cached SPI encode did %zu pixels", encoded);
+    CHECK(reference_decode_spi(stream, sizeof(decoded), decoded) && memcmp(decoded, frames[1], sizeof(decoded)) == 0,
+          "cached SPI encode decodes to other pixels");
+
+    // The reset closing the frame: all low, and long enough to latch
+    CHECK(memcmp(tail, zeros, sizeof(zeros)) == 0, "SPI reset tail was written");
+    uint64_t reset_ns = (uint64_t)RGBPIXEL_ENCODE_SPI_RESET_BYTES * 8 * 1000000000ULL / RGBPIXEL_ENCODE_SPI_CLOCK_HZ;
+    CHECK(reset_ns >= 280000, "SPI reset is only %llu ns low", (unsigned long long)reset_ns);
+}
+
+#define BENCH_FRAMES 2000
+
+static void bench_rmt(void)
+{
+    static rgbpixel_rmt_item_t items[TEST_PIXELS * RGBPIXEL_ENCODE_ITEMS_PER_PIXEL];
+    static uint8_t frames[2][TEST_PIXELS * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+    rgbpixel_encode_init(TEST_RMT_CLOCK_HZ);
+    random_frame(frames[0], TEST_PIXELS);
+    random_frame(frames[1], TEST_PIXELS);
+
+    uint64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_FRAMES; i++)
+    {
+        host_test_keep(rgbpixel_encode_frame(items, frames[i & 1], NULL, TEST_PIXELS));
+    }
+    uint64_t full_ns = host_test_now_ns() - start;
+    // A static colour: nothing changes and the cache is only compared
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_FRAMES; i++)
+    {
+        host_test_keep(rgbpixel_encode_frame(items, frames[0], frames[0], TEST_PIXELS));
+    }
+    uint64_t cached_ns = host_test_now_ns() - start;
+    printf("rmt encode, %d pixels: %.0f ns per frame full, %.0f ns unchanged\n", TEST_PIXELS,
+           (double)full_ns / BENCH_FRAMES, (double)cached_ns / BENCH_FRAMES);
+}
+
+static void bench_spi(void)
+{
+    static uint8_t stream[TEST_PIXELS * RGBPIXEL_ENCODE_SPI_BYTES_PER_PIXEL];
+    static uint8_t frames[2][TEST_PIXELS * RGBPIXEL_ENCODE_BYTES_PER_PIXEL];
+    rgbpixel_encode_spi_init();
+    random_frame(frames[0], TEST_PIXELS);
+    random_frame(frames[1], TEST_PIXELS);
+
+    uint64_t start = host_test_now_ns();
+    for (int i = 0; i < BENCH_FRAMES; i++)
+    {
+        host_test_keep(rgbpixel_encode_spi_frame(stream, frames[i & 1], NULL, TEST_PIXELS));
+    }
+    uint64_t full_ns = host_test_now_ns() - start;
+    start = host_test_now_ns();
+    for (int i = 0; i < BENCH_FRAMES; i++)
+    {
+        host_test_keep(rgbpixel_encode_spi_frame(stream, frames[0], frames[0], TEST_PIXELS));
+    }
+    uint64_t cached_ns = host_test_now_ns() - start;
+    printf("spi encode, %d pixels: %.0f ns per frame full, %.0f ns unchanged\n", TEST_PIXELS,
+           (double)full_ns / BENCH_FRAMES, (double)cached_ns / BENCH_FRAMES);
+}
+
+int main(int argc, char **argv)
+{
+    srand(1);
+    test_rmt_frame(TEST_RMT_CLOCK_HZ);
+    test_rmt_frame(80000000);
+    test_rmt_frame(10000000);
+    test_rmt_bytes();
+    test_spi_frame();
+    if (host_test_bench_requested(argc, argv))
+    {
+        bench_rmt();
+        bench_spi();
+    }
+    return host_test_result("test_encode");
+}
\ No newline at end of file
@@ -0,0 +1,467 @@
+/*
+ * BSD 2-Clause License
+ * 
+ * Copyright (c) 2021, Codor Stelian <codor.stelian.n@gmail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <setjmp.h>
+#include <stdlib.h>
+
+#include <app_log.h>
+#include <app_pm.h>
+#include <app_report.h>
+#include <app_tasks.h>
+#include <app_trace.h>
+#include <esp_crc.h>
+#include <esp_timer.h>
+#include <rgbpixel.h>
+#include <rgbpixel_output.h>
+
+#include "host_test.h"
+
+HOST_TEST_DEFINE();
+
+/* The render task of main/rgbpixel.c run on the host. A scripted sequence
+ * of light changes drives it on a simulated clock: ulTaskNotifyTake() is
+ * where time moves on, to the next frame deadline or the next script step.
+ * A fake output backend takes the frames instead of RMT, checks the double
+ * buffering contract, chains a CRC over every frame of a step and can write
+ * them all to a PPM image, one row per frame.
+ *
+ *   test_render                  check the golden CRCs
+ *   test_render --bench          and report the time spent per frame
+ *   test_render --ppm FILE       and write the frames to FILE
+ */
+#define HOST_FRAME_PERIOD_US (1000000 / CONFIG_RGBPIXEL_FRAME_RATE)
+// Goldens were taken with the sdkconfig.h defaults, other layouts only run the checks
+#define HOST_GOLDEN_LAYOUT (RGBPIXEL_SEGMENTS == 1 && CONFIG_RGBPIXEL_STRIP_PIXELS == 24 && CONFIG_RGBPIXEL_FRAME_RATE == 25)
+// WS2812 wire time: 24 bits of 1.25 us per pixel, then the reset
+#define HOST_WIRE_US_PER_PIXEL 30
+#define HOST_WIRE_RESET_US 300
+
+typedef enum
+{
+    HOST_STEP_IDLE,
+    HOST_STEP_COLOR,
+    HOST_STEP_EFFECT,
+    HOST_STEP_ANIM,
+    HOST_STEP_OFF,
+} host_step_kind_t;
+
+typedef struct
+{
+    const char *name;
+    host_step_kind_t kind;
+    uint32_t duration_ms;
+    const char *effect;         // HOST_STEP_EFFECT
+    rgbpixel_effect_id_t anim;  // HOST_STEP_ANIM, played once
+    uint16_t hue;               // HOST_STEP_COLOR
+    uint16_t saturation;
+    uint16_t brightness;
+    uint32_t golden_crc;        // Of every frame sent during the step
+} host_step_t;
+
+static const host_step_t g_host_steps[] = {
+    {"boot", HOST_STEP_IDLE, 500, .golden_crc = 0x0fc2bb52},
+    {"dim", HOST_STEP_COLOR, 1000, .hue = 180, .saturation = 100, .brightness = 50, .golden_crc = 0x8ea3ded7},
+    {"transition", HOST_STEP_COLOR, 1000, .hue = 0, .saturation = 100, .brightness = 100, .golden_crc = 0x842d7a34},
+    {"Rainbow", HOST_STEP_EFFECT, 4000, .effect = "Rainbow", .golden_crc = 0x27613acd},
+    {"Comet", HOST_STEP_EFFECT, 4000, .effect = "Comet", .golden_crc = 0x32c5e381},
+    {"Breathing", HOST_STEP_EFFECT, 4000, .effect = "Breathing", .golden_crc = 0xbbaedc4d},
+    {"Color Wipe", HOST_STEP_EFFECT, 4000, .effect = "Color Wipe", .golden_crc = 0x675b2a7c},
+    {"None", HOST_STEP_EFFECT, 500, .effect = RGBPIXEL_EFFECT_NONE_NAME, .golden_crc = 0x88ff56b3},
+    {"Spin Blue", HOST_STEP_ANIM, 4000, .anim = RGBPIXEL_EFFECT_SPIN_BLUE, .golden_crc = 0xcfed817b},
+    {"Spin Orange", HOST_STEP_ANIM, 4000, .anim = RGBPIXEL_EFFECT_SPIN_ORANGE, .golden_crc = 0xe060868d},
+    {"Pulse Blue", HOST_STEP_ANIM, 4000, .anim = RGBPIXEL_EFFECT_PULSE_BLUE, .golden_crc = 0xe0184cf8},
+    {"Pulse Red", HOST_STEP_ANIM, 4000, .anim = RGBPIXEL_EFFECT_PULSE_RED, .golden_crc = 0xdf40449c},
+    {"Pulse Green", HOST_STEP_ANIM, 4000, .anim = RGBPIXEL_EFFECT_PULSE_GREEN, .golden_crc = 0xed174500},
+    {"Pulse Purple", HOST_STEP_ANIM, 4000, .anim = RGBPIXEL_EFFECT_PULSE_PURPLE, .golden_crc = 0x9ad29f29},
+    {"off", HOST_STEP_OFF, 2000, .golden_crc = 0x0fc2bb52},
+};
+#define HOST_STEPS (sizeof(g_host_steps) / sizeof(g_host_steps[0]))
+
+// What happened while a step ran
+typedef struct
+{
+    uint32_t crc;
+    uint32_t frames;    // Sent by the fake output
+    rgbpixel_stats_t stats;
+    uint64_t start_ns;
+} host_window_t;
+
+struct host_task
+{
+    TaskFunction_t function;
+    void *arg;
+    bool notified;
+};
+
+typedef struct
+{
+    uint16_t pixels;
+    rgbpixel_output_done_cb_t done_cb;
+    uint8_t *shown; // Last frame written, what the strip shows
+    bool written;
+} host_output_t;
+
+esp_rmaker_device_t *rgb_ring_lights[RGBPIXEL_SEGMENTS];
+
+static struct host_task g_host_task;
+static int64_t g_host_now_us;
+static jmp_buf g_host_script_done;
+static size_t g_host_step;
+static int64_t g_host_step_end_us;
+static host_window_t g_host_window;
+static host_output_t g_host_outputs[RGBPIXEL_SEGMENTS];
+static int g_host_pm_locks[APP_PM_LOCK_MAX];
+static uint32_t g_host_reports;
+static bool g_host_bench;
+static uint64_t g_host_bench_ns;
+static uint32_t g_host_bench_frames;
+static const char *g_host_ppm_path;
+static uint16_t g_host_ppm_width;
+static uint8_t *g_host_ppm;
+static size_t g_host_ppm_rows;
+
+/* ESP-IDF and application services used by rgbpixel.c */
+
+int64_t esp_timer_get_time(void)
+{
+    return g_host_now_us;
+}
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    // CRC-32 as the ROM computes it, table driven so it stays out of the benchmark
+    static uint32_t table[256];
+    if (!table[1])
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                c = (c >> 1) ^ (0xedb88320 & -(c & 1));
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc = (crc >> 8) ^ table[(crc ^ buf[i]) & 0xff];
+    }
+    return ~crc;
+}
+
+esp_rmaker_param_t *esp_rmaker_device_get_param_by_type(const esp_rmaker_device_t *device, const char *type)
+{
+    return NULL;
+}
+
+esp_rmaker_param_val_t esp_rmaker_bool(bool val)
+{
+    esp_rmaker_param_val_t param_val = {.type = RMAKER_VAL_TYPE_BOOLEAN, .val.b = val};
+    return param_val;
+}
+
+esp_err_t app_report_param(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val)
+{
+    g_host_reports++;
+    return ESP_OK;
+}
+
+bool app_log_admit(app_log_site_t *site)
+{
+    return true;
+}
+
+const char *app_log_module_name(app_log_module_t module)
+{
+    return "rgbpixel";
+}
+
+void app_pm_acquire(app_pm_lock_t lock)
+{
+    g_host_pm_locks[lock]++;
+}
+
+void app_pm_release(app_pm_lock_t lock)
+{
+    CHECK(g_host_pm_locks[lock] > 0, "pm lock %d released while free", lock);
+    g_host_pm_locks[lock]--;
+}
+
+esp_err_t app_task_create(app_task_t task, TaskFunction_t function, void *arg, TaskHandle_t *handle)
+{
+    g_host_task.function = function;
+    g_host_task.arg = arg;
+    *handle = &g_host_task;
+    return ESP_OK;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    task->notified = true;
+    return pdPASS;
+}
+
+/* Fake output backend */
+
+esp_err_t rgbpixel_output_init(uint8_t segment, int gpio, uint16_t pixels, rgbpixel_output_done_cb_t done_cb)
+{
+    host_output_t *output = &g_host_outputs[segment];
+    output->pixels = pixels;
+    output->done_cb = done_cb;
+    output->shown = calloc(pixels, 3);
+    if (pixels > g_host_ppm_width)
+        g_host_ppm_width = pixels;
+    return output->shown ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t rgbpixel_output_wait(uint8_t segment, TickType_t timeout)
+{
+    // Every frame is done by the time write returns
+    return ESP_OK;
+}
+
+static void host_ppm_add_row(const uint8_t *frame, uint16_t pixels)
+{
+    if (!g_host_ppm)
+        return;
+    size_t row_bytes = g_host_ppm_width * 3;
+    uint8_t *ppm = realloc(g_host_ppm, (g_host_ppm_rows + 1) * row_bytes);
+    if (!ppm)
+        return;
+    g_host_ppm = ppm;
+    uint8_t *row = &ppm[g_host_ppm_rows++ * row_bytes];
+    memset(row, 0, row_bytes);
+    for (uint16_t i = 0; i < pixels; i++)
+    {
+        // GRB on the wire, RGB in the image
+        row[i * 3] = frame[i * 3 + 1];
+        row[i * 3 + 1] = frame[i * 3];
+        row[i * 3 + 2] = frame[i * 3 + 2];
+    }
+}
+
+esp_err_t rgbpixel_output_write(uint8_t segment, const uint8_t *frame, const uint8_t *previous, uint32_t *encoded_pixels)
+{
+    host_output_t *output = &g_host_outputs[segment];
+    size_t bytes = output->pixels * 3;
+    // A previous frame lets the backend keep the unchanged pixels, it has to be the one on the strip
+    CHECK(!previous || (output->written && memcmp(previous, output->shown, bytes) == 0),
+          "segment %d: previous frame is not the one shown", segment);
+    uint32_t encoded = 0;
+    for (uint16_t i = 0; i < output->pixels; i++)
+    {
+        encoded += !previous || memcmp(&frame[i * 3], &previous[i * 3], 3) != 0;
+    }
+    *encoded_pixels = encoded;
+    memcpy(output->shown, frame, bytes);
+    output->written = true;
+
+    g_host_window.crc = esp_crc32_le(g_host_window.crc, frame, bytes);
+    g_host_window.frames++;
+    host_ppm_add_row(frame, output->pixels);
+    output->done_cb(segment);
+    return ESP_OK;
+}
+
+const char *rgbpixel_output_name(void)
+{
+    return "host";
+}
+
+/* Script */
+
+static void host_step_apply(const host_step_t *step)
+{
+    rgbpixel_update_t update = {.trace = APP_TRACE_NONE};
+    switch (step->kind)
+    {
+    case HOST_STEP_IDLE:
+        return;
+    case HOST_STEP_COLOR:
+        update.fields = RGBPIXEL_UPDATE_HUE | RGBPIXEL_UPDATE_SATURATION | RGBPIXEL_UPDATE_BRIGHTNESS;
+        update.hue = step->hue;
+        update.saturation = step->saturation;
+        update.brightness = step->brightness;
+        break;
+    case HOST_STEP_EFFECT:
+        update.fields = RGBPIXEL_UPDATE_POWER | RGBPIXEL_UPDATE_EFFECT;
+        update.power = true;
+        update.effect = step->effect;
+        break;
+    case HOST_STEP_ANIM:
+        CHECK(rgbpixel_start_anim(step->anim, true) == ESP_OK, "%s: animation not started", step->name);
+        return;
+    case HOST_STEP_OFF:
+        update.fields = RGBPIXEL_UPDATE_POWER;
+        update.power = false;
+        break;
+    }
+    for (uint8_t i = 0; i < RGBPIXEL_SEGMENTS; i++)
+    {
+        CHECK(rgbpixel_update(i, &update) == ESP_OK, "%s: update of segment %d failed", step->name, i);
+    }
+}
+
+static void host_step_start(size_t index)
+{
+    const host_step_t *step = &g_host_steps[index];
+    g_host_step = index;
+    g_host_step_end_us = g_host_now_us + step->duration_ms * 1000LL;
+    memset(&g_host_window, 0, sizeof(g_host_window));
+    rgbpixel_get_stats(&g_host_window.stats);
+    g_host_window.start_ns = host_test_now_ns();
+    host_step_apply(step);
+}
+
+static void host_step_end(void)
+{
+    uint64_t elapsed_ns = host_test_now_ns() - g_host_window.start_ns;
+    const host_step_t *step = &g_host_steps[g_host_step];
+    rgbpixel_stats_t stats;
+    rgbpixel_get_stats(&stats);
+    uint32_t built = stats.frames + stats.skipped_frames - g_host_window.stats.frames - g_host_window.stats.skipped_frames;
+    uint32_t wakeups = stats.wakeups - g_host_window.stats.wakeups;
+
+    CHECK(stats.frames - g_host_window.stats.frames == g_host_window.frames,
+          "%s: %u frames counted, %u written", step->name, stats.frames - g_host_window.stats.frames, g_host_window.frames);
+    CHECK(stats.dropped_frames == g_host_window.stats.dropped_frames, "%s: frames dropped", step->name);
+    if (step->kind == HOST_STEP_EFFECT && strcmp(step->effect, RGBPIXEL_EFFECT_NONE_NAME) != 0)
+    {
+        /* One frame per period on every segment, from the change on. Waits
+         * round up to whole ticks, so the last slot may only be built after
+         * the step has ended.
+         */
+        uint32_t slots = (step->duration_ms * 1000 + HOST_FRAME_PERIOD_US - 1) / HOST_FRAME_PERIOD_US;
+        CHECK(built <= slots * RGBPIXEL_SEGMENTS && built >= (slots - 1) * RGBPIXEL_SEGMENTS,
+              "%s: %u frames built, expected %u", step->name, built, slots * RGBPIXEL_SEGMENTS);
+    }
+    if (step->kind == HOST_STEP_IDLE || step->kind == HOST_STEP_OFF)
+    {
+        // A static strip is drawn once, then the task sleeps
+        CHECK(wakeups == 1 && g_host_window.frames == RGBPIXEL_SEGMENTS,
+              "%s: %u wakeups and %u frames while idle", step->name, wakeups, g_host_window.frames);
+    }
+#if HOST_GOLDEN_LAYOUT
+    CHECK(g_host_window.crc == step->golden_crc, "%s: crc %08x, golden %08x", step->name, g_host_window.crc, step->golden_crc);
+#endif
+    if (g_host_bench && built)
+    {
+        printf("render %-12s %4u frames, %6.0f ns per frame\n", step->name, built, (double)elapsed_ns / built);
+        g_host_bench_ns += elapsed_ns;
+        g_host_bench_frames += built;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    int64_t wake_us = ticks_to_wait == portMAX_DELAY ? INT64_MAX
+                                                     : g_host_now_us + (int64_t)ticks_to_wait * 1000000 / configTICK_RATE_HZ;
+    while (!g_host_task.notified)
+    {
+        if (wake_us < g_host_step_end_us)
+        {
+            g_host_now_us = wake_us;
+            return 0;
+        }
+        // The task sleeps past the end of the step, the script moves on
+        g_host_now_us = g_host_step_end_us;
+        host_step_end();
+        if (g_host_step + 1 == HOST_STEPS)
+            longjmp(g_host_script_done, 1);
+        host_step_start(g_host_step + 1);
+    }
+    g_host_task.notified = false;
+    return 1;
+}
+
+/* Throughput of the segment layout. Segments are built one after the other
+ * and sent in parallel, so a frame costs the build time of all of them but
+ * only the wire time of the longest one.
+ */
+static void host_bench_summary(void)
+{
+    uint32_t pixels = 0;
+    uint32_t wire_us = 0;
+    for (int i = 0; i < RGBPIXEL_SEGMENTS; i++)
+    {
+        pixels += g_host_outputs[i].pixels;
+        uint32_t segment_us = g_host_outputs[i].pixels * HOST_WIRE_US_PER_PIXEL + HOST_WIRE_RESET_US;
+        if (segment_us > wire_us)
+            wire_us = segment_us;
+    }
+    double build_ns = (double)g_host_bench_ns * RGBPIXEL_SEGMENTS / g_host_bench_frames;
+    printf("render %d x %d pixels: %.0f ns per frame, %.1f ns per pixel, wire %u us, %.0f fps at most (%d fps asked)\n",
+           RGBPIXEL_SEGMENTS, (int)(pixels / RGBPIXEL_SEGMENTS), build_ns, build_ns / pixels, wire_us,
+           1e9 / (build_ns > wire_us * 1000.0 ? build_ns : wire_us * 1000.0), CONFIG_RGBPIXEL_FRAME_RATE);
+}
+
+static void host_ppm_write(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    CHECK(file, "cannot open %s", path);
+    if (!file)
+        return;
+    fprintf(file, "P6\n%u %zu\n255\n", g_host_ppm_width, g_host_ppm_rows);
+    fwrite(g_host_ppm, g_host_ppm_width * 3, g_host_ppm_rows, file);
+    fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+    // One binary per segment layout, each reports under its own name
+    const char *name = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    g_host_bench = host_test_bench_requested(argc, argv);
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--ppm") == 0)
+            g_host_ppm_path = argv[i + 1];
+    }
+    if (g_host_ppm_path)
+        g_host_ppm = malloc(1);
+
+    CHECK(app_driver_rgbpixel_init() == ESP_OK, "init failed");
+    CHECK(g_host_task.function, "render task not created");
+    if (!g_host_task.function)
+        return host_test_result(name);
+    host_step_start(0);
+    if (setjmp(g_host_script_done) == 0)
+        g_host_task.function(g_host_task.arg);
+
+    for (int i = 0; i < APP_PM_LOCK_MAX; i++)
+    {
+        CHECK(g_host_pm_locks[i] == 0, "pm lock %d still held", i);
+    }
+    // Only the first colour change turns the light on without a power field
+    CHECK(g_host_reports == RGBPIXEL_SEGMENTS, "%u implicit power reports", g_host_reports);
+    if (g_host_ppm_path)
+        host_ppm_write(g_host_ppm_path);
+    if (g_host_bench && g_host_bench_frames)
+        host_bench_summary();
+    return host_test_result(name);
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Decode the command trace dumped by app_trace_dump().
+
+Feed it the device log, from a file or stdin:
+
+    idf.py monitor | tee monitor.log
+    python3 tools/trace_decode.py monitor.log
+
+Every "app_trace: R <hex>" line holds 12 byte records (sequence, time_us, id,
+point, source, little endian). Records are grouped by command id and each
+command is printed with the time of every stage relative to its receipt,
+followed by receive to output latency per request source.
+"""
+
+import argparse
+import re
+import struct
+import sys
+from collections import defaultdict
+
+RECORD = struct.Struct('<IIHBB')
+LINE = re.compile(r'app_trace: R ([0-9a-fA-F]+)')
+
+POINTS = ['received', 'queued', 'dispatched', 'output', 'reported']
+SOURCES = ['init', 'cloud', 'schedule', 'scene on', 'scene off', 'local', 'device']
+
+
+def read_records(stream):
+    records = {}
+    for line in stream:
+        match = LINE.search(line)
+        if not match:
+            continue
+        data = bytes.fromhex(match.group(1))
+        for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+            sequence, time_us, trace_id, point, source = RECORD.unpack_from(data, offset)
+            # Later dumps repeat records still in the ring
+            records[sequence] = (time_us, trace_id, point, source)
+    return [records[sequence] for sequence in sorted(records)]
+
+
+def source_name(source):
+    return SOURCES[source] if source < len(SOURCES) else '?'
+
+
+def percentile(values, fraction):
+    return values[min(len(values) - 1, int(len(values) * fraction))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('log', nargs='?', type=argparse.FileType('r'), default=sys.stdin)
+    parser.add_argument('-q', '--quiet', action='store_true', help='only print the latency summary')
+    args = parser.parse_args()
+
+    commands = defaultdict(list)
+    order = []
+    for time_us, trace_id, point, source in read_records(args.log):
+        # Ids wrap at 65535, a new receipt starts a new command
+        if point == 0 or trace_id not in commands:
+            if trace_id in commands:
+                order.append(commands.pop(trace_id))
+            commands[trace_id] = []
+        commands[trace_id].append((time_us, point, source))
+    order.extend(commands.values())
+
+    latencies = defaultdict(list)
+    for stages in order:
+        start, first_point, source = stages[0]
+        if first_point != 0:
+            continue  # Receipt already overwritten in the ring
+        line = []
+        output = None
+        for time_us, point, _ in stages:
+            elapsed = ((time_us - start) & 0xffffffff) / 1000.0
+            name = POINTS[point] if point < len(POINTS) else str(point)
+            line.append('%s +%.1f' % (name, elapsed))
+            if point == 3 and output is None:
+                output = elapsed
+        if output is not None:
+            latencies[source].append(output)
+        elif not any(point == 2 for _, point, _ in stages):
+            line.append('(coalesced or pending)')
+        if not args.quiet:
+            print('%-9s %s' % (source_name(source), ', '.join(line)))
+
+    if latencies:
+        print('\nreceive to output latency (ms)')
+        for source in sorted(latencies):
+            values = sorted(latencies[source])
+            print('%-9s n=%-5d p50 %7.1f  p90 %7.1f  max %7.1f' % (
+                source_name(source), len(values), percentile(values, 0.5), percentile(values, 0.9), values[-1]))
+
+
+if __name__ == '__main__':
+    main()